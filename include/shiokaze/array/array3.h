@@ -32,7 +32,11 @@
 #include <algorithm>
 #include <utility>
 #include <shiokaze/math/shape.h>
+#include <atomic>
+#include <cstdint>
 #include "array_core3.h"
+#include "linear_kernel3.h"
+#include "array_version.h"
 //
 SHKZ_BEGIN_NAMESPACE
 //
@@ -98,7 +102,9 @@ private:
 				m_core_name.insert(pos,shkz_default_array_core3);
 			}
 		}
-		m_core = array_core3::quick_load_module(config,m_core_name);
+		//
+		// Pick the core specialized for the element type when one is available
+		m_core = array_core3::quick_load_module(config,linear_kernel3::resolve<T>(m_core_name));
 	}
 	//
 	virtual void configure( configuration &config ) override {
@@ -186,6 +192,9 @@ public:
 				m_core->copy(*array.get_core(),[&](void *target, const void *src) {
 					new (target) T(*static_cast<const T *>(src));
 				},m_parallel);
+				//
+				// An unmodified copy holds the same content, so it inherits the version of the source
+				m_version.store(array.get_version(),std::memory_order_relaxed);
 			}
 		}
 	}
@@ -225,6 +234,7 @@ public:
 	 @param[in] value 初期値。
 	 */
 	void initialize( const shape3 &shape, T value=T()) {
+		mark_modified();
 		clear();
 		m_core->initialize(shape.w,shape.h,shape.d,sizeof(T));
 		m_shape = shape;
@@ -240,6 +250,7 @@ public:
 	 @param[in] bandwidth_half レベルセットの半分のバンド幅。
 	 */
 	void set_as_levelset( double bandwidth_half ) {
+		mark_modified();
 		m_levelset = true;
 		m_fillable = false;
 		m_background_value = bandwidth_half;
@@ -252,6 +263,7 @@ public:
 	 @param[in] fill_value 塗りつぶしの値。
 	 */
 	void set_as_fillable( const T& fill_value ) {
+		mark_modified();
 		m_levelset = false;
 		m_fillable = true;
 		m_fill_value = fill_value;
@@ -297,6 +309,7 @@ public:
 	 \~japanese @brief 塗りつぶし処理を行う。グリッドは事前にレベルセットかぶり潰し可能に設定されている必要がある。
 	 */
 	void flood_fill() {
+		mark_modified();
 		if( m_fillable ) {
 			m_core->flood_fill([&](const void *value_ptr) {
 				return *static_cast<const T *>(value_ptr) == m_fill_value;
@@ -481,7 +494,7 @@ public:
 	 \~japanese @brief グリッドのバックグランドの値（あるいは初期値）を設定する。
 	 @param[in] value 新しい初期値
 	 */
-	void set_background_value( const T& value ) { m_background_value = value; }
+	void set_background_value( const T& value ) { mark_modified(); m_background_value = value; }
 	/**
 	 \~english @brief Clear out the grid.
 	 *
@@ -520,6 +533,7 @@ public:
 	 @param[in] value この位置で設定する値。
 	 */
 	void set( int i, int j, int k, const T& value ) {
+		mark_modified();
 		m_core->set(i,j,k,[&](void *value_ptr, bool &active){
 			if( ! active ) new (value_ptr) T(value);
 			else *static_cast<T *>(value_ptr) = value;
@@ -602,6 +616,7 @@ public:
 	 @param[in] k z 座標上の位置。
 	 */
 	void set_off( int i, int j, int k ) {
+		mark_modified();
 		m_core->set(i,j,k,[&](void *value_ptr, bool &active){
 			if( active ) (static_cast<T *>(value_ptr))->~T();
 			active = false;
@@ -629,6 +644,7 @@ public:
 	 @param[in] value この位置で加算する値。
 	 */
 	void increment( int i, int j, int k, const T& value) {
+		mark_modified();
 		m_core->set(i,j,k,[&](void *value_ptr, bool &active){
 			if( active ) *static_cast<T *>(value_ptr) += value;
 			else {
@@ -661,6 +677,7 @@ public:
 	 @param[in] value この位置で減算する値。
 	 */
 	void subtract( int i, int j, int k, const T& value) {
+		mark_modified();
 		m_core->set(i,j,k,[&](void *value_ptr, bool &active){
 			if( active ) *static_cast<T *>(value_ptr) -= value;
 			else {
@@ -693,6 +710,7 @@ public:
 	 @param[in] value この位置で乗算する値。
 	 */
 	void multiply( int i, int j, int k, const T& value ) {
+		mark_modified();
 		m_core->set(i,j,k,[&](void *value_ptr, bool &active){
 			if( active ) *static_cast<T *>(value_ptr) *= value;
 			else {
@@ -749,6 +767,7 @@ public:
 	 @param[in] k z 座標上の位置。
 	 */
 	T* ptr(unsigned i, unsigned j, unsigned k ) {
+		mark_modified();
 		bool filled (false);
 		return const_cast<T *>(static_cast<const T *>((*m_core)(i,j,k,filled)));
 	}
@@ -860,6 +879,9 @@ public:
 	 @param[in] v 設定する値。
 	 */
 	void operator=(const T &v) {
+		mark_modified();
+		linear_kernel3::fill_payload payload = { &v, m_touch_only_actives, &m_parallel };
+		if( m_core->send_message("fill",&payload)) return;
 		parallel_op([&](iterator& it) {
 			it.set(v);
 		},m_touch_only_actives);
@@ -872,6 +894,11 @@ public:
 	 */
 	void operator+=(const array3<T> &v) {
 		assert(shape()==v.shape());
+		if( ! m_touch_only_actives ) {
+			mark_modified();
+			linear_kernel3::axpy_payload payload = { v.get_core(), 1.0, &m_background_value, &v.m_background_value, &m_parallel };
+			if( m_core->send_message("axpy",&payload)) return;
+		}
 		parallel_op([&](int i ,int j, int k, iterator& it, int tn) {
 			if( ! m_touch_only_actives || v.active(i,j,k)) {
 				it.increment(v(i,j,k));
@@ -886,6 +913,11 @@ public:
 	 */
 	void operator-=(const array3<T> &v) {
 		assert(shape()==v.shape());
+		if( ! m_touch_only_actives ) {
+			mark_modified();
+			linear_kernel3::axpy_payload payload = { v.get_core(), -1.0, &m_background_value, &v.m_background_value, &m_parallel };
+			if( m_core->send_message("axpy",&payload)) return;
+		}
 		parallel_op([&](int i, int j, int k, iterator& it, int tn) {
 			if( ! m_touch_only_actives || v.active(i,j,k)) {
 				it.subtract(v(i,j,k));
@@ -1211,6 +1243,7 @@ public:
 	 @param[in] type ターゲットセルのタイプ. ACTIVE か ALL。
 	 */
 	void parallel_op( std::function<void(int i, int j, int k, iterator& it, int thread_index)> func, bool type=ALL ) {
+		mark_modified();
 		if( type == ACTIVES ) {
 			m_core->parallel_actives([&](int i, int j, int k, void *value_ptr, bool &active, const bool &filled, int thread_n ){
 				iterator it(value_ptr,active,filled,filled ? m_fill_value : m_background_value);
@@ -1397,6 +1430,7 @@ public:
 	 @param[in] type ターゲットセルのタイプ. ACTIVE か ALL。
 	 */
 	void serial_op( std::function<void(int i, int j, int k, iterator& it)> func, bool type=ALL ) {
+		mark_modified();
 		if( type == ACTIVES ) {
 			m_core->serial_actives([&](int i, int j, int k, void *value_ptr, bool &active, const bool &filled ){
 				iterator it(value_ptr,active,filled,filled ? m_fill_value : m_background_value);
@@ -1550,6 +1584,7 @@ public:
 	 @param[in] type ターゲットセルのタイプ. ACTIVE か ALL。
 	 */
 	void interruptible_serial_op( std::function<bool(int i, int j, int k, iterator& it)> func, bool type=ALL ) {
+		mark_modified();
 		if( type == ACTIVES ) {
 			m_core->serial_actives([&](int i, int j, int k, void *value_ptr, bool &active, const bool &filled ){
 				iterator it(value_ptr,active,filled,filled ? m_fill_value : m_background_value);
@@ -1659,6 +1694,7 @@ public:
 	 @param[in] count 拡張の回数。
 	 */
 	void dilate( std::function<void(int i, int j, int k, iterator& it, int thread_index )> func, int count=1 ) {
+		mark_modified();
 		while( count -- ) {
 			m_core->dilate([&](int i, int j, int k, void *value_ptr, bool &active, const bool &filled, int thread_index) {
 				iterator it(value_ptr,active,filled,filled ? m_fill_value : m_background_value);
@@ -1761,6 +1797,11 @@ public:
 		std::swap(m_levelset,rhs.m_levelset);
 		std::swap(m_fillable,rhs.m_fillable);
 		std::swap(m_fill_value,rhs.m_fill_value);
+		//
+		// Each stamp follows the content it was issued for
+		const uint64_t version = m_version.load(std::memory_order_relaxed);
+		m_version.store(rhs.m_version.load(std::memory_order_relaxed),std::memory_order_relaxed);
+		rhs.m_version.store(version,std::memory_order_relaxed);
 	}
 	/**
 	 \~english @brief Get the instance of `parallel_driver` of this grid.
@@ -1883,6 +1924,7 @@ public:
 	 @param[in] type セットする type のインスタンス。
 	 */
 	void set_type( const type3 &type ) {
+		mark_modified();
 		m_core_name = type.core_name;
 		m_shape = type.shape;
 		m_background_value = type.background_value;
@@ -1891,8 +1933,29 @@ public:
 		m_fill_value = type.fill_value;
 		m_levelset = type.is_levelset;
 	}
+	/**
+	 \~english @brief Get the version stamp of this grid. The stamp is renewed if the grid has been modified through its member functions since the last query. Two grids share the same stamp only when one is an unmodified copy of the other.
+	 @return Version stamp.
+	 \~japanese @brief グリッドのバージョンを取得する。前回の取得以降にメンバー関数を通してグリッドが変更されていればバージョンは更新される。異なるグリッドが同じバージョンを持つのは、一方が他方の変更されていないコピーである場合に限る。
+	 @return バージョン。
+	 */
+	uint64_t get_version() const {
+		//
+		// A zero stamp means modified since the last query. When several threads query at once,
+		// only the first one to swap in a fresh stamp succeeds and the others return that stamp.
+		uint64_t version = m_version.load(std::memory_order_acquire);
+		if( ! version ) {
+			const uint64_t fresh = array_version::issue();
+			if( m_version.compare_exchange_strong(version,fresh,std::memory_order_acq_rel)) version = fresh;
+		}
+		return version;
+	}
 	//
 private:
+	//
+	void mark_modified() {
+		if( m_version.load(std::memory_order_relaxed)) m_version.store(0,std::memory_order_relaxed);
+	}
 	//
 	shape3 m_shape;
 	parallel_driver m_parallel{this};
@@ -1901,6 +1964,7 @@ private:
 	char m_levelset_halfwidth {0};
 	array3_ptr m_core;
 	std::string m_core_name;
+	mutable std::atomic<uint64_t> m_version {array_version::issue()};
 };
 //
 SHKZ_END_NAMESPACE
@@ -110,6 +110,11 @@ namespace array_utility3 {
 	 @return もしグリッドが負の値と正の値の両方の値を持っていれば \c true そうでなければ \c false を返す。
 	 */
 	template <class T> bool levelset_exist( const array3<T> &levelset ) {
+		//
+		// Cores with a min_max kernel scan the buffer in one vectorized pass; others stop at the first inside cell
+		T min_value, max_value;
+		linear_kernel3::min_max_payload payload = { &min_value, &max_value, false, &levelset.get_parallel_driver() };
+		if( levelset.const_send_message("min_max",&payload)) return payload.found && min_value < 0.0;
 		//
 		bool hasInside (false);
 		levelset.interruptible_const_serial_actives([&](int i, int j, int k, const auto &it){
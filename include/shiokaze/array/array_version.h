@@ -0,0 +1,49 @@
+/*
+**	array_version.h
+**
+**	This is part of Shiokaze, a research-oriented fluid solver for computer graphics.
+**	Created by Ryoichi Ando <rand@nii.ac.jp> on Oct 18, 2026.
+**
+**	Permission is hereby granted, free of charge, to any person obtaining a copy of
+**	this software and associated documentation files (the "Software"), to deal in
+**	the Software without restriction, including without limitation the rights to use,
+**	copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+**	Software, and to permit persons to whom the Software is furnished to do so,
+**	subject to the following conditions:
+**
+**	The above copyright notice and this permission notice shall be included in all copies
+**	or substantial portions of the Software.
+**
+**	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+**	INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+**	PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+**	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+**	CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+**	OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+//
+#ifndef SHKZ_ARRAY_VERSION_H
+#define SHKZ_ARRAY_VERSION_H
+//
+#include <shiokaze/core/common.h>
+#include <cstdint>
+//
+SHKZ_BEGIN_NAMESPACE
+//
+/** @file */
+/// \~english @brief Issuer of version stamps shared by all the grids across modules.
+/// \~japanese @brief モジュール間で全てのグリッドが共有するバージョン番号の発行クラス。
+class array_version {
+public:
+	/**
+	 \~english @brief Issue a new version stamp. Every call returns a value larger than any stamp issued before.
+	 @return New version stamp.
+	 \~japanese @brief 新しいバージョン番号を発行する。常にそれ以前に発行された番号より大きい値を返す。
+	 @return 新しいバージョン番号。
+	 */
+	static uint64_t issue();
+};
+//
+SHKZ_END_NAMESPACE
+//
+#endif
@@ -0,0 +1,105 @@
+/*
+**	full_velocity_cache3.h
+**
+**	This is part of Shiokaze, a research-oriented fluid solver for computer graphics.
+**	Created by Ryoichi Ando <rand@nii.ac.jp> on Oct 18, 2026.
+**
+**	Permission is hereby granted, free of charge, to any person obtaining a copy of
+**	this software and associated documentation files (the "Software"), to deal in
+**	the Software without restriction, including without limitation the rights to use,
+**	copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+**	Software, and to permit persons to whom the Software is furnished to do so,
+**	subject to the following conditions:
+**
+**	The above copyright notice and this permission notice shall be included in all copies
+**	or substantial portions of the Software.
+**
+**	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+**	INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+**	PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+**	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+**	CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+**	OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+//
+#ifndef SHKZ_FULL_VELOCITY_CACHE3_H
+#define SHKZ_FULL_VELOCITY_CACHE3_H
+//
+#include <typeinfo>
+#include <memory>
+//
+#include "full_velocity_cache_core3.h"
+#include "array3.h"
+#include "macarray3.h"
+//
+SHKZ_BEGIN_NAMESPACE
+//
+/** @file */
+/// \~english @brief Service that shares the full velocity reconstructed from a staggered velocity among modules. Entries are keyed by the versions of the three faces of the velocity and recomputed only when any of them changes.
+/// \~japanese @brief スタッガード格子の速度から再構成されたフル速度をモジュール間で共有するクラス。エントリーは速度の三つの面のバージョンで管理され、いずれかが変更された時のみ再計算される。
+class full_velocity_cache3 {
+public:
+	/**
+	 \~english @brief Get the cell centered full velocity.
+	 @param[in] velocity Staggered velocity.
+	 @return Shared pointer to the cell centered full velocity.
+	 \~japanese @brief セルセンターで定義されたフル速度を得る。
+	 @param[in] velocity スタッガード格子の速度。
+	 @return セルセンターで定義されたフル速度への共有ポインター。
+	 */
+	template<class T> static std::shared_ptr<const array3<vec3<T> > > get_cell_velocity( const macarray3<T> &velocity ) {
+		//
+		const shape3 shape = velocity.shape();
+		return std::static_pointer_cast<const array3<vec3<T> > >(full_velocity_cache_core3::fetch(
+			shape.hash() ^ typeid(array3<vec3<T> >).hash_code(),{velocity[0].get_version(),velocity[1].get_version(),velocity[2].get_version()},
+			[&]() {
+				configuration::auto_group group(configurable::get_global_configuration(),
+					credit("Full Velocity Cache 3D","FullVelocityCache"));
+				return (void *)(new array3<vec3<T> >(shape));
+			},
+			[]( void *ptr ) {
+				delete reinterpret_cast<array3<vec3<T> > *>(ptr);
+			},
+			[&]( void *ptr ) {
+				velocity.convert_to_full(*reinterpret_cast<array3<vec3<T> > *>(ptr));
+			}));
+	}
+	/**
+	 \~english @brief Get the face located full velocity.
+	 @param[in] velocity Staggered velocity.
+	 @return Shared pointer to the face located full velocity.
+	 \~japanese @brief セルの面で定義されたフル速度を得る。
+	 @param[in] velocity スタッガード格子の速度。
+	 @return セルの面で定義されたフル速度への共有ポインター。
+	 */
+	template<class T> static std::shared_ptr<const macarray3<vec3<T> > > get_face_velocity( const macarray3<T> &velocity ) {
+		//
+		const shape3 shape = velocity.shape();
+		return std::static_pointer_cast<const macarray3<vec3<T> > >(full_velocity_cache_core3::fetch(
+			shape.hash() ^ typeid(macarray3<vec3<T> >).hash_code(),{velocity[0].get_version(),velocity[1].get_version(),velocity[2].get_version()},
+			[&]() {
+				configuration::auto_group group(configurable::get_global_configuration(),
+					credit("Full Velocity Cache 3D","FullVelocityCache"));
+				return (void *)(new macarray3<vec3<T> >(shape));
+			},
+			[]( void *ptr ) {
+				delete reinterpret_cast<macarray3<vec3<T> > *>(ptr);
+			},
+			[&]( void *ptr ) {
+				velocity.convert_to_full(*reinterpret_cast<macarray3<vec3<T> > *>(ptr));
+			}));
+	}
+	/**
+	 \~english @brief Get the ratio of requests that were served from the cache.
+	 @return Hit rate.
+	 \~japanese @brief キャッシュから取得された割合を得る。
+	 @return ヒット率。
+	 */
+	static double get_hit_rate() {
+		return full_velocity_cache_core3::get_hit_rate();
+	}
+};
+//
+SHKZ_END_NAMESPACE
+//
+#endif
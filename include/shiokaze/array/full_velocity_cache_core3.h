@@ -0,0 +1,76 @@
+/*
+**	full_velocity_cache_core3.h
+**
+**	This is part of Shiokaze, a research-oriented fluid solver for computer graphics.
+**	Created by Ryoichi Ando <rand@nii.ac.jp> on Oct 18, 2026.
+**
+**	Permission is hereby granted, free of charge, to any person obtaining a copy of
+**	this software and associated documentation files (the "Software"), to deal in
+**	the Software without restriction, including without limitation the rights to use,
+**	copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+**	Software, and to permit persons to whom the Software is furnished to do so,
+**	subject to the following conditions:
+**
+**	The above copyright notice and this permission notice shall be included in all copies
+**	or substantial portions of the Software.
+**
+**	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+**	INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+**	PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+**	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+**	CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+**	OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+//
+#ifndef SHKZ_FULL_VELOCITY_CACHE_CORE3_H
+#define SHKZ_FULL_VELOCITY_CACHE_CORE3_H
+//
+#include <shiokaze/core/common.h>
+#include <functional>
+#include <memory>
+#include <array>
+#include <cstdint>
+//
+SHKZ_BEGIN_NAMESPACE
+//
+/** @file */
+/// \~english @brief Abstract storage class that keeps the most recent full velocity per kind, shared among modules.
+/// \~japanese @brief モジュール間で共有される、種類ごとに最新のフル速度を保持する抽象クラス。
+class full_velocity_cache_core3 {
+public:
+	/**
+	 \~english @brief Fetch a cached entry, or rebuild it if the version does not match.
+	 @param[in] key Hash indicator for the kind and the shape of the entry.
+	 @param[in] version Version stamps of the three faces of the source velocity.
+	 @param[in] alloc_func Allocation function for a new entry.
+	 @param[in] dealloc_func Deallocation function for an entry.
+	 @param[in] update_func Function that recomputes an entry from the source velocity.
+	 @return Shared pointer to the entry. The entry stays alive while the pointer is held.
+	 \~japanese @brief キャッシュされたエントリーを取得する。バージョンが一致しなければ再計算する。
+	 @param[in] key エントリーの種類と形を示すハッシュ値。
+	 @param[in] version 元の速度の三つの面のバージョン。
+	 @param[in] alloc_func 新しいエントリーのメモリアロケーター関数。
+	 @param[in] dealloc_func エントリーのメモリ解放関数。
+	 @param[in] update_func 元の速度からエントリーを再計算する関数。
+	 @return エントリーへの共有ポインター。ポインターが保持されている間はエントリーは解放されない。
+	 */
+	static std::shared_ptr<void> fetch( size_t key, const std::array<uint64_t,DIM3> &version, std::function<void *()> alloc_func, std::function<void( void *ptr )> dealloc_func, std::function<void( void *ptr )> update_func );
+	/**
+	 \~english @brief Get the ratio of fetches that were served from the cache.
+	 @return Hit rate.
+	 \~japanese @brief キャッシュから取得された割合を得る。
+	 @return ヒット率。
+	 */
+	static double get_hit_rate();
+	/**
+	 \~english @brief Release all the cached entries.
+	 @return Number of the released entries.
+	 \~japanese @brief 全てのキャッシュを解放する。
+	 @return 解放されたエントリーの数。
+	 */
+	static size_t clear();
+};
+//
+SHKZ_END_NAMESPACE
+//
+#endif
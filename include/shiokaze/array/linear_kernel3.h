@@ -0,0 +1,143 @@
+/*
+**	linear_kernel3.h
+**
+**	This is part of Shiokaze, a research-oriented fluid solver for computer graphics.
+**	Created by Ryoichi Ando <rand@nii.ac.jp> on Oct 18, 2026.
+**
+**	Permission is hereby granted, free of charge, to any person obtaining a copy of
+**	this software and associated documentation files (the "Software"), to deal in
+**	the Software without restriction, including without limitation the rights to use,
+**	copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+**	Software, and to permit persons to whom the Software is furnished to do so,
+**	subject to the following conditions:
+**
+**	The above copyright notice and this permission notice shall be included in all copies
+**	or substantial portions of the Software.
+**
+**	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+**	INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+**	PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+**	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+**	CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+**	OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+//
+#ifndef SHKZ_LINEAR_KERNEL3_H
+#define SHKZ_LINEAR_KERNEL3_H
+//
+#include <shiokaze/math/vec.h>
+#include <shiokaze/parallel/parallel_driver.h>
+#include <string>
+//
+SHKZ_BEGIN_NAMESPACE
+//
+class array_core3;
+//
+/** @file */
+/// \~english @brief Message payloads and module name resolution for the type specialized linear array kernels.
+/// \~japanese @brief 型に特化した線形配列カーネルのメッセージの引数とモジュール名の解決。
+namespace linear_kernel3 {
+	/**
+	 \~english @brief Payload of the "fill" message. Sets the value of every cell (or only active cells) and activates them.
+	 \~japanese @brief "fill" メッセージの引数。全てのセル (またはアクティブセルのみ) に値を設定し、アクティブにする。
+	 */
+	struct fill_payload {
+		/**
+		 \~english @brief Pointer to the value to fill.
+		 \~japanese @brief 設定する値へのポインタ。
+		 */
+		const void *value;
+		/**
+		 \~english @brief Whether to fill only active cells.
+		 \~japanese @brief アクティブセルだけに設定するか。
+		 */
+		bool only_actives;
+		/**
+		 \~english @brief Parallel driver.
+		 \~japanese @brief 並列処理のドライバ。
+		 */
+		const parallel_driver *parallel;
+	};
+	/**
+	 \~english @brief Payload of the "axpy" message. Computes y = y + alpha * x on every cell, where inactive cells take their background values.
+	 \~japanese @brief "axpy" メッセージの引数。全てのセルで y = y + alpha * x を計算する。非アクティブなセルはバックグラウンド値をとる。
+	 */
+	struct axpy_payload {
+		/**
+		 \~english @brief Core of the array x.
+		 \~japanese @brief 配列 x のコア。
+		 */
+		const array_core3 *x;
+		/**
+		 \~english @brief Scaling factor.
+		 \~japanese @brief スケーリング係数。
+		 */
+		double alpha;
+		/**
+		 \~english @brief Pointer to the background value of y.
+		 \~japanese @brief y のバックグラウンド値へのポインタ。
+		 */
+		const void *y_background;
+		/**
+		 \~english @brief Pointer to the background value of x.
+		 \~japanese @brief x のバックグラウンド値へのポインタ。
+		 */
+		const void *x_background;
+		/**
+		 \~english @brief Parallel driver.
+		 \~japanese @brief 並列処理のドライバ。
+		 */
+		const parallel_driver *parallel;
+	};
+	/**
+	 \~english @brief Payload of the const "min_max" message. Minimal and maximal values are taken component-wise over active cells.
+	 \~japanese @brief const な "min_max" メッセージの引数。最小値と最大値はアクティブセルに対して成分ごとに取られる。
+	 */
+	struct min_max_payload {
+		/**
+		 \~english @brief Pointer to the minimal value to write.
+		 \~japanese @brief 書き込む最小値へのポインタ。
+		 */
+		void *min_value;
+		/**
+		 \~english @brief Pointer to the maximal value to write.
+		 \~japanese @brief 書き込む最大値へのポインタ。
+		 */
+		void *max_value;
+		/**
+		 \~english @brief Whether any active cell was found.
+		 \~japanese @brief アクティブセルが見つかったか。
+		 */
+		bool found;
+		/**
+		 \~english @brief Parallel driver.
+		 \~japanese @brief 並列処理のドライバ。
+		 */
+		const parallel_driver *parallel;
+	};
+	/**
+	 \~english @brief Suffix of the module specialized for an element type. Empty if no specialization exists.
+	 \~japanese @brief 要素の型に特化したモジュールの接尾辞。特化したモジュールが無ければ空。
+	 */
+	template <class T> struct suffix { static const char *get() { return ""; } };
+	template <> struct suffix<float> { static const char *get() { return "_float1"; } };
+	template <> struct suffix<double> { static const char *get() { return "_double1"; } };
+	template <> struct suffix<vec3f> { static const char *get() { return "_float3"; } };
+	template <> struct suffix<vec3d> { static const char *get() { return "_double3"; } };
+	/**
+	 \~english @brief Resolve the name of the core module specialized for an element type.
+	 @param[in] core_name Name of the core module.
+	 @return Name of the specialized module if exists. Otherwise core_name is returned.
+	 \~japanese @brief 要素の型に特化したコアモジュールの名前を解決する。
+	 @param[in] core_name コアモジュールの名前。
+	 @return 特化したモジュールがあればその名前を、なければ core_name を返す。
+	 */
+	template <class T> std::string resolve( const std::string &core_name ) {
+		if( core_name == "lineararray3" ) return core_name+suffix<T>::get();
+		return core_name;
+	}
+};
+//
+SHKZ_END_NAMESPACE
+//
+#endif
@@ -394,6 +394,7 @@ public:
 	 */
 	void clear() {
 		for( int dim : DIMS3 ) (*this)[dim].clear();
+		m_array_0.send_message("compact",nullptr);
 	}
 	/**
 	 \~english @brief Clear out the grid with the new backgroud value.
@@ -405,6 +406,7 @@ public:
 	 */
 	void clear(vec3<T> v) {
 		for( int dim : DIMS3 ) (*this)[dim].clear(v[dim]);
+		m_array_0.send_message("compact",nullptr);
 	}
 	/**
 	 \~english @brief Return if the grid is different from an input array.
@@ -1099,7 +1101,24 @@ public:
 		m_array_1.set_type(type.type1);
 		m_array_2.set_type(type.type2);
 	}
+	/**
+	 \~english @brief Get the version stamps of the three faces of this grid. Two grids hold the same content only when all the three stamps match.
+	 @return Version stamps of the faces.
+	 \~japanese @brief グリッドの三つの面のバージョンを取得する。二つのグリッドが同じ内容を持つのは三つのバージョンが全て一致する場合に限る。
+	 @return 各面のバージョン。
+	 */
+	std::array<uint64_t,DIM3> get_version() const {
+		return {m_array_0.get_version(),m_array_1.get_version(),m_array_2.get_version()};
+	}
 private:
+	//
+	virtual void post_load() override {
+		//
+		// Cores such as "mactiledarray3" co-locate the three faces in shared tiles when bound together
+		array_core3 *cores[] = { m_array_0.get_core(), m_array_1.get_core(), m_array_2.get_core() };
+		m_array_0.send_message("bind_mac_faces",cores);
+	}
+	//
 	parallel_driver m_parallel{this};
 	array3<T> m_array_0;
 	array3<T> m_array_1;
@@ -0,0 +1,93 @@
+/*
+**	version_cache.h
+**
+**	This is part of Shiokaze, a research-oriented fluid solver for computer graphics.
+**	Created by Ryoichi Ando <rand@nii.ac.jp> on Oct 18, 2026.
+**
+**	Permission is hereby granted, free of charge, to any person obtaining a copy of
+**	this software and associated documentation files (the "Software"), to deal in
+**	the Software without restriction, including without limitation the rights to use,
+**	copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+**	Software, and to permit persons to whom the Software is furnished to do so,
+**	subject to the following conditions:
+**
+**	The above copyright notice and this permission notice shall be included in all copies
+**	or substantial portions of the Software.
+**
+**	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+**	INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+**	PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+**	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+**	CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+**	OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+//
+#ifndef SHKZ_VERSION_CACHE_H
+#define SHKZ_VERSION_CACHE_H
+//
+#include <shiokaze/core/console.h>
+#include <string>
+#include <mutex>
+//
+SHKZ_BEGIN_NAMESPACE
+//
+/** @file */
+/// \~english @brief Bookkeeping of a result derived from versioned grids. It remembers the key of the stored result, guards it with a mutex and writes the cumulative hit rate to the record once per time step.
+/// \~japanese @brief バージョン付きのグリッドから計算された結果の管理クラス。保存された結果のキーを記憶し、ミューテックスで保護し、累積のヒット率をタイムステップ毎に一度記録する。
+template <class K> class version_cache {
+public:
+	/**
+	 \~english @brief Lock the cache. The lock must be held while the stored result is checked, updated or read.
+	 @return Lock of the cache.
+	 \~japanese @brief キャッシュをロックする。保存された結果を確認、更新、読み込みする間はロックを保持する必要がある。
+	 @return キャッシュのロック。
+	 */
+	std::unique_lock<std::mutex> lock() {
+		return std::unique_lock<std::mutex>(m_mutex);
+	}
+	/**
+	 \~english @brief Check if the stored result was computed from the given key, and count the query.
+	 @param[in] name Name of the hit rate record.
+	 @param[in] key Key of the query.
+	 @return \c true if the stored result can be reused.
+	 \~japanese @brief 保存された結果が与えられたキーから計算されたか確認し、問い合わせを数える。
+	 @param[in] name ヒット率の記録の名前。
+	 @param[in] key 問い合わせのキー。
+	 @return 保存された結果が再利用できれば \c true を返す。
+	 */
+	bool check( std::string name, const K &key ) {
+		//
+		// The first query of a time step writes the hit rate up to the previous step
+		const double time = console::get_time();
+		if( time != m_time ) {
+			if( m_query_count ) console::write(name,m_hit_count/(double)m_query_count);
+			m_time = time;
+		}
+		const bool hit = m_valid && m_key == key;
+		m_query_count ++;
+		if( hit ) m_hit_count ++;
+		return hit;
+	}
+	/**
+	 \~english @brief Remember the key of a newly stored result.
+	 @param[in] key Key of the stored result.
+	 \~japanese @brief 新しく保存された結果のキーを記憶する。
+	 @param[in] key 保存された結果のキー。
+	 */
+	void store( const K &key ) {
+		m_key = key;
+		m_valid = true;
+	}
+	//
+private:
+	//
+	std::mutex m_mutex;
+	K m_key;
+	bool m_valid {false};
+	double m_time {-1.0};
+	size_t m_hit_count {0}, m_query_count {0};
+};
+//
+SHKZ_END_NAMESPACE
+//
+#endif
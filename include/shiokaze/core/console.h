@@ -27,6 +27,7 @@
 //
 #include <shiokaze/core/common.h>
 #include <string>
+#include <vector>
 //
 SHKZ_BEGIN_NAMESPACE
 //
@@ -116,6 +117,13 @@ namespace console {
 	 @param[in] time 設定する時間。主に、ミリセカンド秒を想定。
 	*/
 	void set_time( double time );
+	/**
+	 \~english @brief Get the time set for logging.
+	 @return Time set by set_time.
+	 \~japanese @brief ログに記録されるシミュレーションの時間を得る。
+	 @return set_time で設定された時間。
+	*/
+	double get_time();
 	/**
 	 \~english @brief Export number associated with the name as log file.
 	 @param[in] name Name associated with the number.
@@ -125,6 +133,15 @@ namespace console {
 	 @param[in] number ログファイルに記録する数字。
 	*/
 	void write( std::string name, double number );
+	/**
+	 \~english @brief Export a sequence of numbers associated with the name as a single line of the log file.
+	 @param[in] name Name associated with the numbers.
+	 @param[in] numbers Numbers to record.
+	 \~japanese @brief ラベル名前に関する数字の列をログファイルの一行として出力する。
+	 @param[in] name 数字に関連した名前。
+	 @param[in] numbers ログファイルに記録する数字の列。
+	*/
+	void write( std::string name, const std::vector<double> &numbers );
 }
 //
 SHKZ_END_NAMESPACE
@@ -27,6 +27,7 @@
 //
 #include <shiokaze/core/recursive_configurable_module.h>
 #include <shiokaze/math/RCMatrix_interface.h>
+#include <shiokaze/core/console.h>
 //
 SHKZ_BEGIN_NAMESPACE
 //
@@ -54,7 +55,40 @@ public:
 		/// \~english @brief Vector absolute residual.
 		/// \~japanese @brief ベクトル絶対誤差。
 		std::vector<T> vector_absresid;
+		/// \~english @brief Relative residual after each iteration. Empty if the solver does not track it.
+		/// \~japanese @brief 各反復後の比例誤差。ソルバーが記録しない場合は空。
+		std::vector<T> residual_history;
+		/// \~english @brief Time spent converting the matrix into the internal format of the solver in milliseconds.
+		/// \~japanese @brief 行列をソルバー内部の形式に変換するのにかかった時間 (ミリ秒)。
+		double conversion_time {0.0};
+		/// \~english @brief Time spent setting up the preconditioner in milliseconds.
+		/// \~japanese @brief 前処理の準備にかかった時間 (ミリ秒)。
+		double setup_time {0.0};
+		/// \~english @brief Time spent on the iterations in milliseconds.
+		/// \~japanese @brief 反復にかかった時間 (ミリ秒)。
+		double iteration_time {0.0};
 	};
+	/**
+	 \~english @brief Write the iteration count and the timings of a result to the record directory, optionally followed by the residual history as a single line.
+	 @param[in] name Prefix of the record names.
+	 @param[in] result Result to write.
+	 @param[in] history Whether to write the residual history.
+	 \~japanese @brief 結果の反復回数と時間を記録ディレクトリに書き出す。オプションで誤差の履歴も一行で書き出す。
+	 @param[in] name 記録の名前の接頭辞。
+	 @param[in] result 書き出す結果。
+	 @param[in] history 誤差の履歴を書き出すか。
+	 */
+	static void write_result( std::string name, const Result &result, bool history=false ) {
+		console::write(name+"_iterations",result.count);
+		console::write(name+"_reresid",result.reresid);
+		console::write(name+"_conversion",result.conversion_time);
+		console::write(name+"_setup",result.setup_time);
+		console::write(name+"_iteration_time",result.iteration_time);
+		if( result.count ) console::write(name+"_time_per_iteration",result.iteration_time/result.count);
+		if( history && ! result.residual_history.empty()) {
+			console::write(name+"_residual_history",std::vector<double>(result.residual_history.begin(),result.residual_history.end()));
+		}
+	}
 	/**
 	 \~english @brief Register a vector norm class.
 	 @param[in] kind Vector kind.
@@ -62,6 +96,13 @@ public:
 	 @param[in] kind ベクトルの種類。
 	 */
 	virtual void register_vector_norm_kind( const std::vector<unsigned char> &kind ) {}
+	/**
+	 \~english @brief Register keys that identify each row of the next system across solves, such as linear cell indices. Solvers may use them to reuse their preconditioner when the set of unknowns changes only slightly.
+	 @param[in] keys Key of each row.
+	 \~japanese @brief 次に解く行列の各行を解をまたいで識別するキー (セルの通し番号など) を登録する。未知数の集合がわずかに変化しただけの場合に、ソルバーが前処理を再利用するために使われる。
+	 @param[in] keys 各行のキー。
+	 */
+	virtual void register_row_keys( const std::vector<N> &keys ) {}
 	/**
 	 \~english @brief Solve a linear system of the form: Ax = b.
 	 @param[in] A Sparse Row Compressed Matrix.
@@ -75,6 +116,50 @@ public:
 	 @return 結果のステート。
 	 */
 	virtual Result solve( const RCMatrix_interface<N,T> *A, const RCMatrix_vector_interface<N,T> *b, RCMatrix_vector_interface<N,T> *x ) const = 0;
+	/**
+	 \~english @brief Solve linear systems of the form: Ax = b that share the same matrix for several right hand sides. Solvers may convert the matrix and set up the preconditioner only once, and multiply the matrix to all the vectors in a single pass.
+	 @param[in] A Sparse Row Compressed Matrix.
+	 @param[in] b Right hand side vectors.
+	 @param[in] x Solution vectors.
+	 @return result status for each right hand side.
+	 \~japanese @brief 同じ行列を持つ複数の右側のベクトルについて Ax = b で表される線形一次方程式を解く。ソルバーは行列の変換と前処理の準備を一度だけ行い、全てのベクトルへの行列のかけ算を一度に行っても良い。
+	 @param[in] A 行圧縮の疎行列。
+	 @param[in] b 右側のベクトルたち。
+	 @param[in] x 解となるベクトルたち。
+	 @return それぞれの右側のベクトルに対する結果のステート。
+	 */
+	virtual std::vector<Result> solve_many( const RCMatrix_interface<N,T> *A, const std::vector<const RCMatrix_vector_interface<N,T> *> &b, const std::vector<RCMatrix_vector_interface<N,T> *> &x ) const {
+		std::vector<Result> results;
+		for( size_t n=0; n<b.size(); ++n ) results.push_back(solve(A,b[n],x[n]));
+		return results;
+	}
+	/**
+	 \~english @brief Get if this solver accepts a matrix-free operator via solve_operator().
+	 @return \c true if supported. \c false otherwise.
+	 \~japanese @brief このソルバーが solve_operator() で行列を用いない演算子を受け付けるか取得する。
+	 @return もしサポートされていれば \c true そうでなければ \c false を返す。
+	 */
+	virtual bool supports_operator() const { return false; }
+	/**
+	 \~english @brief Solve a linear system of the form: Ax = b, where A is only given as an operator that applies the multiplication. Solvers that do not support operators print a warning and return a result with no residual reduction.
+	 @param[in] A Operator that applies the matrix multiplication.
+	 @param[in] M Operator that applies the inverse of the preconditioner. Can be \c nullptr.
+	 @param[in] b Right hand side vector.
+	 @param[in] x Solution vector.
+	 @return result status.
+	 \~japanese @brief 行列のかけ算を行う演算子としてのみ与えられた A について、Ax = b で表される線形一次方程式を解く。演算子をサポートしないソルバーは警告を出力し、誤差が減少しなかった結果を返す。
+	 @param[in] A 行列のかけ算を行う演算子。
+	 @param[in] M 前処理行列の逆行列を適用する演算子。\c nullptr でも良い。
+	 @param[in] b 右側のベクトル。
+	 @param[in] x 解となるベクトル。
+	 @return 結果のステート。
+	 */
+	virtual Result solve_operator( const RCFixedMatrix_interface<N,T> *A, const RCFixedMatrix_interface<N,T> *M, const RCMatrix_vector_interface<N,T> *b, RCMatrix_vector_interface<N,T> *x ) const {
+		//
+		// Solvers without an operator path leave x untouched and report no residual reduction
+		console::dump("Warning: %s does not support matrix-free operators. Check supports_operator() before calling solve_operator().\n",this->get_argument_name().c_str());
+		return {N(),(T)1.0};
+	}
 	/**
 	 \~english @brief Solve a linear system of the form: Ax = b. Provided to preserve std::vector compatibility.
 	 @param[in] A Sparse Row Compressed Matrix.
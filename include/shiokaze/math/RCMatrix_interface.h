@@ -224,6 +224,20 @@ public:
 	 @param[in] x x.
 	 */
 	virtual void add_scaled( T alpha, const RCMatrix_vector_interface<N,T> *x ) = 0;
+	/**
+	 \~english @brief Get the pointer to the contiguous storage of the vector.
+	 @return Pointer to the first element. \c nullptr if the vector is not stored contiguously.
+	 \~japanese @brief ベクトルの連続したメモリ領域へのポインタを取得する。
+	 @return 最初の要素へのポインタ。連続したメモリ領域に格納されていない場合は \c nullptr を返す。
+	 */
+	virtual T * data() { return nullptr; }
+	/**
+	 \~english @brief Get the constant pointer to the contiguous storage of the vector.
+	 @return Pointer to the first element. \c nullptr if the vector is not stored contiguously.
+	 \~japanese @brief ベクトルの連続したメモリ領域への const ポインタを取得する。
+	 @return 最初の要素へのポインタ。連続したメモリ領域に格納されていない場合は \c nullptr を返す。
+	 */
+	virtual const T * data() const { return nullptr; }
 	/**
 	 \~english @brief Duplicate this vector.
 	 @return Duplicated vector.
@@ -294,6 +308,17 @@ public:
 	 @param[out] result 結果のベクトル。
 	 */
 	virtual void multiply( const RCMatrix_vector_interface<N,T> *rhs, RCMatrix_vector_interface<N,T> *result ) const = 0;
+	/**
+	 \~english @brief Apply multiplication to several input vectors at once. Implementations may read the matrix only once for all the vectors.
+	 @param[in] rhs Input vectors to apply.
+	 @param[out] result Result vectors. Must not alias any of the input vectors.
+	 \~japanese @brief 複数の入力のベクトルに一度にかけ算を行う。実装は全てのベクトルについて行列を一度だけ読み込んでも良い。
+	 @param[in] rhs 入力のベクトルたち。
+	 @param[out] result 結果のベクトルたち。入力のベクトルと重なってはならない。
+	 */
+	virtual void multiply_many( const std::vector<const RCMatrix_vector_interface<N,T> *> &rhs, const std::vector<RCMatrix_vector_interface<N,T> *> &result ) const {
+		for( size_t n=0; n<rhs.size(); ++n ) multiply(rhs[n],result[n]);
+	}
 	/**
 	 \~english @brief Apply multiplication to an input vector.
 	 @param[in-out] rhs Input vector to apply.
@@ -628,6 +653,19 @@ public:
 	//
 	DEFINE_MODULE(RCMatrix_factory_interface,"Row Compressed Matrix Factory","RCMatrix","Row compressed matrix module")
 	//
+	/**
+	 \~english @brief Allocate a matrix that reserves a fixed number of entries per row. Rows can be filled concurrently without heap allocations, and make_fixed() shares the storage instead of copying it as long as no row exceeds the reserved count.
+	 @param[in] rows Number of rows.
+	 @param[in] columns Number of columns.
+	 @param[in] entries_per_row Number of entries reserved per row.
+	 \~japanese @brief 行ごとに決まった数の要素を予約した行列を生成する。各行はヒープ確保なしに並列に埋めることができ、予約数を超える行がない限り make_fixed() は記憶領域をコピーせずに共有する。
+	 @param[in] rows 行の数。
+	 @param[in] columns 列の数。
+	 @param[in] entries_per_row 行ごとに予約する要素の数。
+	 */
+	virtual RCMatrix_ptr<N,T> allocate_stencil_matrix( N rows, N columns, N entries_per_row ) const {
+		return this->allocate_matrix(rows,columns);
+	}
 };
 //
 template <class N, class T> using RCMatrix_factory_driver = recursive_configurable_driver<RCMatrix_factory_interface<N,T> >;
@@ -27,6 +27,8 @@
 //
 #include <shiokaze/math/RCMatrix_interface.h>
 #include <shiokaze/core/console.h>
+#include <cstring>
+#include <cstdio>
 #include <cmath>
 //
 SHKZ_BEGIN_NAMESPACE
@@ -128,9 +130,90 @@ public:
 		if( symmetric_error ) symm_postive_diag = false;
 		return symm_postive_diag;
 	}
+	/**
+	 \~english @brief Write a linear system to a binary file, so that it can be replayed by solver benchmarks.
+	 @param[in] path Path to the file.
+	 @param[in] matrix Matrix to write.
+	 @param[in] rhs Right hand side vector to write.
+	 @return \c true if successful, \c false otherwise.
+	 \~japanese @brief ソルバーのベンチマークで再現できるように、線形システムをバイナリファイルに書き出す。
+	 @param[in] path ファイルのパス。
+	 @param[in] matrix 書き出す行列。
+	 @param[in] rhs 書き出す右側のベクトル。
+	 @return 成功すれば \c true を、そうでなければ \c false を返す。
+	 */
+	static bool write_system( std::string path, const RCMatrix_interface<N,T> *matrix, const RCMatrix_vector_interface<N,T> *rhs ) {
+		//
+		FILE *fp = std::fopen(path.c_str(),"wb");
+		if( ! fp ) return false;
+		const auto write_u64 = [&]( uint64_t value ) { std::fwrite(&value,sizeof(uint64_t),1,fp); };
+		const auto write_f64 = [&]( double value ) { std::fwrite(&value,sizeof(double),1,fp); };
+		std::fwrite(system_magic,1,8,fp);
+		write_u64(matrix->rows());
+		write_u64(matrix->columns());
+		for( N row=0; row<matrix->rows(); ++row ) {
+			write_u64(matrix->non_zeros(row));
+			matrix->const_for_each(row,[&]( N column, T value ) {
+				write_u64(column);
+				write_f64(value);
+			});
+		}
+		write_u64(rhs->size());
+		for( N row=0; row<rhs->size(); ++row ) write_f64(rhs->at(row));
+		const bool success = ! std::ferror(fp);
+		std::fclose(fp);
+		return success;
+	}
+	/**
+	 \~english @brief Read a linear system written by write_system.
+	 @param[in] path Path to the file.
+	 @param[out] matrix Matrix to read into.
+	 @param[out] rhs Right hand side vector to read into.
+	 @return \c true if successful, \c false otherwise.
+	 \~japanese @brief write_system で書き出された線形システムを読み込む。
+	 @param[in] path ファイルのパス。
+	 @param[out] matrix 読み込む先の行列。
+	 @param[out] rhs 読み込む先の右側のベクトル。
+	 @return 成功すれば \c true を、そうでなければ \c false を返す。
+	 */
+	static bool read_system( std::string path, RCMatrix_interface<N,T> *matrix, RCMatrix_vector_interface<N,T> *rhs ) {
+		//
+		FILE *fp = std::fopen(path.c_str(),"rb");
+		if( ! fp ) return false;
+		bool success (true);
+		const auto read_u64 = [&]() { uint64_t value (0); success = success && std::fread(&value,sizeof(uint64_t),1,fp) == 1; return value; };
+		const auto read_f64 = [&]() { double value (0.0); success = success && std::fread(&value,sizeof(double),1,fp) == 1; return value; };
+		char magic[8];
+		success = std::fread(magic,1,8,fp) == 8 && ! std::memcmp(magic,system_magic,8);
+		const N rows = read_u64();
+		const N columns = read_u64();
+		if( success ) {
+			matrix->initialize(rows,columns);
+			for( N row=0; success && row<rows; ++row ) {
+				const uint64_t non_zeros = read_u64();
+				for( uint64_t n=0; success && n<non_zeros; ++n ) {
+					const N column = read_u64();
+					const T value = read_f64();
+					if( success ) matrix->add_to_element(row,column,value);
+				}
+			}
+			const N size = read_u64();
+			if( success ) {
+				rhs->resize(size);
+				for( N row=0; success && row<size; ++row ) rhs->set(row,read_f64());
+			}
+		}
+		std::fclose(fp);
+		return success;
+	}
 	//
+private:
+	//
+	static constexpr const char *system_magic = "SHKZRCM1";
 };
 //
+template <class N, class T> constexpr const char *RCMatrix_utility<N,T>::system_magic;
+//
 SHKZ_END_NAMESPACE
 //
 #endif
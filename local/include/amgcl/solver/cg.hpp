@@ -156,6 +156,7 @@ class cg {
             scalar_type res_norm = norm(*r);
 
             size_t iter = 0;
+            residual_history.clear();
             for(; iter < prm.maxiter && math::norm(res_norm) > eps; ++iter) {
                 P.apply(*r, *s);
 
@@ -175,6 +176,7 @@ class cg {
                 backend::axpby(-alpha, *q, one, *r);
 
                 res_norm = norm(*r);
+                residual_history.push_back(res_norm / norm_rhs);
             }
 
             return std::make_tuple(iter, res_norm / norm_rhs);
@@ -199,6 +201,7 @@ class cg {
         }
     public:
         params prm;
+        mutable std::vector<scalar_type> residual_history;
 
     private:
         size_t n;
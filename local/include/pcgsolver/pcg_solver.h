@@ -11,6 +11,7 @@
 #include <functional>
 #include <numeric>
 #include <limits>
+#include <chrono>
 #include "sparse_matrix.h"
 #include "blas_wrapper.h"
 
@@ -257,7 +258,10 @@ struct PCGSolver
 		}
 		double tol= abs_tol ? abs_tol : tolerance_factor*residual_out;
 
+		residual_history.clear();
+		const auto setup_start = std::chrono::steady_clock::now();
 		form_preconditioner(matrix);
+		setup_time = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-setup_start).count();
 		apply_preconditioner(r, z);
 		double rho=BLAS::dot(z, r);
 		if(rho==0) {
@@ -278,6 +282,7 @@ struct PCGSolver
 			BLAS::add_scaled(alpha, s, result);
 			BLAS::add_scaled(-alpha, z, r);
 			residual_out=BLAS::abs_max(r);
+			residual_history.push_back(residual_out/residual0);
 			if(residual_out<=tol) {
 				iterations_out=iteration+1;
 				residual_out /= residual0;
@@ -358,6 +363,10 @@ struct PCGSolver
 		return false;
 	}
 
+	// telemetry of the last solve: relative residual after each iteration and preconditioner setup time in milliseconds
+	std::vector<T> residual_history;
+	double setup_time {0.0};
+
 	protected:
 
 	// internal structures
@@ -380,7 +389,6 @@ struct PCGSolver
 	{
 		solve_lower(ic_factor, x, result);
 		solve_lower_transpose_in_place(ic_factor,result);
-		result = x;
 	}
 };
 
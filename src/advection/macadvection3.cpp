@@ -26,6 +26,7 @@
 #include <shiokaze/core/console.h>
 #include <shiokaze/core/timer.h>
 #include <shiokaze/array/shared_array3.h>
+#include <shiokaze/array/full_velocity_cache3.h>
 #include <shiokaze/array/array_interpolator3.h>
 #include <shiokaze/math/WENO3.h>
 #include <limits>
@@ -42,6 +43,7 @@ protected:
 		//
 		shared_array3<Real> scalar0(scalar);
 		advect_cell(scalar0(),velocity,scalar,fluid,dt,m_param.use_maccormack,m_param.weno_interpolation,name);
+		write_cache_hit_rate();
 	}
 	//
 	virtual void advect_vector( macarray3<Real> &u,				// Face-located
@@ -51,6 +53,7 @@ protected:
 		//
 		shared_macarray3<Real> u0(u);
 		advect_u(u0(),velocity,u,fluid,dt,m_param.use_maccormack,m_param.weno_interpolation,name);
+		write_cache_hit_rate();
 	}
 	//
 	virtual void configure( configuration &config ) override {
@@ -67,17 +70,20 @@ protected:
 	}
 	//
 	using Real2 = struct { Real v[2] = { 0.0, 0.0 }; bool within_narrowband{false}; };
+	void write_cache_hit_rate() const {
+		console::write(get_argument_name()+"_full_velocity_cache_hit_rate",full_velocity_cache3::get_hit_rate());
+	}
 	void advect_semiLagrangian_u ( const macarray3<Real> &v_in, const macarray3<Real> &v, macarray3<Real> &v_out, macarray3<Real2> *minMax, const array3<Real> &fluid, double dt, bool weno_interpolation ) {
 		//
 		v_out.clear();
 		v_out.activate_as(v_in);
 		//
-		shared_macarray3<vec3r> face_full_velocity(m_shape);
-		v_in.convert_to_full(face_full_velocity());
+		// Trace along the advecting velocity, whose full velocity is shared by both MacCormack passes
+		auto face_full_velocity = full_velocity_cache3::get_face_velocity(v);
 		//
 		v_out.parallel_actives([&](int dim, int i, int j, int k, auto &it, int tn) {
 			//
-			const vec3r &u = face_full_velocity()[dim](i,j,k);
+			const vec3r &u = (*face_full_velocity)[dim](i,j,k);
 			//
 			if( ! u.empty() ) {
 				vec3d p = vec3d(i,j,k)-dt*u/m_dx;
@@ -98,7 +104,7 @@ protected:
 			minMax->activate_as(v_in);
 			minMax->parallel_actives([&](int dim, int i, int j, int k, auto &it, int tn) {
 				//
-				const vec3d &u = face_full_velocity()[dim](i,j,k);
+				const vec3d &u = (*face_full_velocity)[dim](i,j,k);
 				//
 				if( ! u.empty() ) {
 					vec3d p = vec3d(i,j,k)-dt*u/m_dx;
@@ -179,14 +185,13 @@ protected:
 	//
 	void advect_semiLagrangian_cell ( const array3<Real> &q_in, const macarray3<Real> &v, array3<Real> &q_out, array3<Real2> *minMax, const array3<Real> &fluid, double dt, bool weno_interpolation ) {
 		//
-		shared_array3<vec3r> full_velocity(m_shape);
-		v.convert_to_full(full_velocity());
+		auto full_velocity = full_velocity_cache3::get_cell_velocity(v);
 		//
 		q_out.clear();
 		q_out.activate_as(q_in);
 		q_out.parallel_actives([&](int i, int j, int k, auto &it, int tn) {
 			//
-			const vec3d &u = full_velocity()(i,j,k);
+			const vec3d &u = (*full_velocity)(i,j,k);
 			//
 			if( ! u.empty() ) {
 				vec3d p = vec3d(i,j,k)-dt*u/m_dx;
@@ -207,7 +212,7 @@ protected:
 			minMax->activate_as(q_in);
 			minMax->parallel_actives([&](int i, int j, int k, auto &it, int tn) {
 				//
-				const vec3d &u = full_velocity()(i,j,k);
+				const vec3d &u = (*full_velocity)(i,j,k);
 				//
 				if( ! u.empty() ) {
 					vec3d p = vec3d(i,j,k)-dt*u/m_dx;
@@ -0,0 +1,633 @@
+/*
+**	mactiledarray3.cpp
+**
+**	This is part of Shiokaze, a research-oriented fluid solver for computer graphics.
+**	Created by Ryoichi Ando <rand@nii.ac.jp> on Oct 18, 2026.
+**
+**	Permission is hereby granted, free of charge, to any person obtaining a copy of
+**	this software and associated documentation files (the "Software"), to deal in
+**	the Software without restriction, including without limitation the rights to use,
+**	copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+**	Software, and to permit persons to whom the Software is furnished to do so,
+**	subject to the following conditions:
+**
+**	The above copyright notice and this permission notice shall be included in all copies
+**	or substantial portions of the Software.
+**
+**	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+**	INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+**	PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+**	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+**	CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+**	OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+//
+#ifndef SHKZ_MACTILEDARRAY3_H
+#define SHKZ_MACTILEDARRAY3_H
+//
+#include <vector>
+#include <stack>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <cassert>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <shiokaze/array/array_core3.h>
+#include "bitcount/bitcount.h"
+#include "dilate3.h"
+//
+SHKZ_BEGIN_NAMESPACE
+//
+// Tiled array core whose tiles are shared by the three face arrays of a macarray3.
+// When macarray3 binds its cores together, the u, v and w faces of a tile live in
+// a single allocation with their activity masks packed in front, and the values
+// of the three faces at the same local index are stored next to each other.
+// Without binding, the core behaves as an ordinary tiled array.
+//
+class mactiledarray3 : public array_core3 {
+public:
+	//
+	LONG_NAME("MAC Tiled Array 3D")
+	ARGUMENT_NAME("MACTiledArray")
+	//
+	mactiledarray3 () : m_storage(std::make_shared<storage3>()) {}
+	virtual ~mactiledarray3() {
+		clear_face();
+	}
+	//
+protected:
+	//
+	virtual void configure( configuration &config ) override {
+		config.get_unsigned("TileSize",m_storage->Z,"Tile size per dimension (power of two)");
+		assert( m_storage->Z && ! (m_storage->Z & (m_storage->Z-1)));
+		assert( m_storage->Z*m_storage->Z*m_storage->Z <= std::numeric_limits<unsigned short>::max());
+		m_storage->log2Z = 0;
+		while( (1U << m_storage->log2Z) < m_storage->Z ) m_storage->log2Z ++;
+	}
+	//
+	virtual bool send_message( std::string message, void *ptr ) override {
+		//
+		if( message == "bind_mac_faces" ) {
+			//
+			array_core3 **cores = static_cast<array_core3 **>(ptr);
+			mactiledarray3 *faces[DIM3];
+			for( int dim : DIMS3 ) {
+				faces[dim] = dynamic_cast<mactiledarray3 *>(cores[dim]);
+				if( ! faces[dim] ) return false;
+			}
+			auto storage = std::make_shared<storage3>();
+			storage->Z = m_storage->Z;
+			storage->log2Z = m_storage->log2Z;
+			storage->num_faces = DIM3;
+			for( int dim : DIMS3 ) {
+				faces[dim]->m_storage = storage;
+				faces[dim]->m_dim = dim;
+			}
+			return true;
+		} else if( message == "compact" ) {
+			m_storage->compact();
+			return true;
+		}
+		return false;
+	}
+	//
+	virtual void initialize( unsigned nx, unsigned ny, unsigned nz, unsigned element_bytes ) override {
+		//
+		assert( element_bytes <= std::numeric_limits<unsigned char>::max() );
+		shape3 cell_shape(nx,ny,nz);
+		if( m_storage->num_faces > 1 ) cell_shape[m_dim] = cell_shape[m_dim] ? cell_shape[m_dim]-1 : 0;
+		//
+		if( cell_shape != m_storage->cell_shape || element_bytes != m_storage->element_bytes || m_storage->tiles.empty()) {
+			m_storage->reset(cell_shape,element_bytes);
+		} else {
+			clear_face();
+		}
+		m_storage->face_shape[m_dim] = shape3(nx,ny,nz);
+		m_storage->fill_mask[m_dim].clear();
+	}
+	//
+	virtual void get( unsigned &nx, unsigned &ny, unsigned &nz, unsigned &element_bytes ) const override {
+		const shape3 &s = face_shape();
+		nx = s.w;
+		ny = s.h;
+		nz = s.d;
+		element_bytes = m_storage->element_bytes;
+	}
+	//
+	virtual size_t count( const parallel_driver &parallel ) const override {
+		std::vector<size_t> total_slots(parallel.get_thread_num());
+		parallel.for_each(m_storage->tiles.size(),[&]( size_t n, int thread_index ) {
+			const tile3 *tile = m_storage->tiles[n];
+			if( tile ) total_slots[thread_index] += tile->num_active[m_dim];
+		});
+		size_t total (0);
+		for( const auto &e : total_slots ) total += e;
+		return total;
+	}
+	//
+	virtual void copy( const array_core3 &array, std::function<void(void *target, const void *src)> copy_func, const parallel_driver &parallel ) override {
+		//
+		unsigned nx, ny, nz, element_bytes;
+		array.get(nx,ny,nz,element_bytes);
+		//
+		auto mate_array = dynamic_cast<const mactiledarray3 *>(&array);
+		if( mate_array && mate_array->m_storage->Z == m_storage->Z && mate_array->m_storage->num_faces == m_storage->num_faces ) {
+			//
+			initialize(nx,ny,nz,element_bytes);
+			const storage3 &mate = *mate_array->m_storage;
+			const int mate_dim = mate_array->m_dim;
+			parallel.for_each(mate.tiles.size(),[&]( size_t n ) {
+				const tile3 *src = mate.tiles[n];
+				if( src && src->num_active[mate_dim] ) {
+					tile3 *dst = m_storage->acquire_tile(n);
+					std::memcpy(dst->mask[m_dim],src->mask[mate_dim],m_storage->mask_bytes);
+					dst->num_active[m_dim] = src->num_active[mate_dim];
+					if( element_bytes ) {
+						const size_t size = m_storage->tile_count();
+						for( size_t m=0; m<size; ++m ) {
+							if( (src->mask[mate_dim][m>>3] >> (m&7)) & 1U ) {
+								copy_func(dst->value(m,m_dim,*m_storage),src->value(m,mate_dim,mate));
+							}
+						}
+					}
+				}
+			});
+			m_storage->fill_mask[m_dim] = mate.fill_mask[mate_dim];
+			//
+		} else {
+			//
+			initialize(nx,ny,nz,element_bytes);
+			array.const_serial_actives([&](int i, int j, int k, const void *src_ptr, const bool& filled) {
+				set(i,j,k,[&](void *dst_ptr, bool &active) {
+					copy_func(dst_ptr,src_ptr);
+					active = true;
+				});
+				return false;
+			});
+			if( element_bytes ) {
+				array.const_serial_inside([&](int i, int j, int k, const void *src_ptr, const bool &active) {
+					std::vector<bool> &fill_mask = m_storage->fill_mask[m_dim];
+					if( fill_mask.empty()) fill_mask.resize(face_shape().count(),false);
+					fill_mask[encode_face(i,j,k)] = true;
+					return false;
+				});
+			}
+		}
+	}
+	//
+	bool check_bound( int i, int j, int k ) const {
+		const shape3 &s = face_shape();
+		if( i >= 0 && j >= 0 && k >= 0 && i < s.w && j < s.h && k < s.d ) {
+			return true;
+		} else {
+			printf( "Out of bounds (i=%d,j=%d,k=%d), (w=%d,h=%d,d=%d)\n", i, j, k, s.w, s.h, s.d );
+			return false;
+		}
+	}
+	//
+	virtual void set( int i, int j, int k, std::function<void(void *value_ptr, bool &active)> func ) override {
+		//
+#if SHKZ_DEBUG
+		assert(check_bound(i,j,k));
+#endif
+		const size_t n = m_storage->tile_index(i,j,k);
+		const size_t m = m_storage->local_index(i,j,k);
+		tile3 *tile = m_storage->tiles[n];
+		//
+		if( ! tile ) {
+			const unsigned &element_bytes = m_storage->element_bytes;
+			bool active (false);
+			unsigned char buffer[element_bytes ? element_bytes : 1];
+			func(element_bytes ? buffer : nullptr,active);
+			if( active ) {
+				tile = m_storage->acquire_tile(n);
+				if( element_bytes ) std::memcpy(tile->value(m,m_dim,*m_storage),buffer,element_bytes);
+				tile->activate(m,m_dim);
+			}
+		} else {
+			bool active = tile->active(m,m_dim);
+			bool new_active (active);
+			func(m_storage->element_bytes ? tile->value(m,m_dim,*m_storage) : nullptr,new_active);
+			if( new_active != active ) {
+				if( new_active ) tile->activate(m,m_dim);
+				else tile->deactivate(m,m_dim);
+			}
+			release_if_empty(n);
+		}
+	}
+	//
+	virtual const void * operator()( int i, int j, int k, bool &filled ) const override {
+		//
+#if SHKZ_DEBUG
+		assert(check_bound(i,j,k));
+#endif
+		filled = face_filled(i,j,k);
+		const tile3 *tile = m_storage->tiles[m_storage->tile_index(i,j,k)];
+		if( tile ) {
+			const size_t m = m_storage->local_index(i,j,k);
+			if( tile->active(m,m_dim)) {
+				static char tmp;
+				return m_storage->element_bytes ? tile->value(m,m_dim,*m_storage) : (void *)&tmp;
+			}
+		}
+		return nullptr;
+	}
+	//
+	virtual void dilate( std::function<void(int i, int j, int k, void *value_ptr, bool &active, const bool &filled, int thread_index)> func, const parallel_driver &parallel ) override {
+		dilate3::dilate<size_t>(this,func,parallel);
+	}
+	//
+	virtual void flood_fill( std::function<bool(void *value_ptr)> inside_func, const parallel_driver &parallel ) override {
+		//
+		if( ! m_storage->element_bytes ) return;
+		//
+		const shape3 &s = face_shape();
+		std::vector<bool> &fill_mask = m_storage->fill_mask[m_dim];
+		fill_mask.clear();
+		fill_mask.resize(s.count(),false);
+		//
+		std::stack<vec3i> queue;
+		auto markable = [&]( const vec3i &pi, bool default_result ) {
+			if( ! s.out_of_bounds(pi)) {
+				if( fill_mask[encode_face(pi[0],pi[1],pi[2])] ) return false;
+				bool filled;
+				const void *ptr = (*this)(pi[0],pi[1],pi[2],filled);
+				return ptr ? inside_func(const_cast<void *>(ptr)) : default_result;
+			}
+			return false;
+		};
+		//
+		const_serial_actives([&]( int i, int j, int k, const void *value_ptr, const bool &filled ) {
+			vec3i pi(i,j,k);
+			if( markable(pi,false)) {
+				queue.push(pi);
+				while( ! queue.empty()) {
+					vec3i qi = queue.top();
+					queue.pop();
+					fill_mask[encode_face(qi[0],qi[1],qi[2])] = true;
+					for( int dim : DIMS3 ) for( int dir=-1; dir<=1; dir+=2 ) {
+						vec3i ni = qi+dir*vec3i(dim==0,dim==1,dim==2);
+						if( markable(ni,true)) queue.push(ni);
+					}
+				}
+			}
+			return false;
+		});
+	}
+	//
+	virtual void const_parallel_inside ( std::function<void(int i, int j, int k, const void *value_ptr, const bool &active, int thread_index )> func, const parallel_driver &parallel ) const override {
+		//
+		const std::vector<bool> &fill_mask = m_storage->fill_mask[m_dim];
+		if( ! fill_mask.empty()) {
+			parallel.for_each(face_shape(),[&]( int i, int j, int k, int thread_index ) {
+				if( fill_mask[encode_face(i,j,k)] ) {
+					bool filled;
+					const void *ptr = (*this)(i,j,k,filled);
+					func(i,j,k,ptr,ptr!=nullptr,thread_index);
+				}
+			});
+		}
+	}
+	virtual void const_serial_inside ( std::function<bool(int i, int j, int k, const void *value_ptr, const bool &active )> func ) const override {
+		//
+		const std::vector<bool> &fill_mask = m_storage->fill_mask[m_dim];
+		if( ! fill_mask.empty()) {
+			const shape3 &s = face_shape();
+			for( int k=0; k<s.d; ++k ) for( int j=0; j<s.h; ++j ) for( int i=0; i<s.w; ++i ) {
+				if( fill_mask[encode_face(i,j,k)] ) {
+					bool filled;
+					const void *ptr = (*this)(i,j,k,filled);
+					if( func(i,j,k,ptr,ptr!=nullptr)) return;
+				}
+			}
+		}
+	}
+	//
+	bool loop_actives_body ( size_t n, std::function<bool(int i, int j, int k, void *value_ptr, bool &active, const bool &filled )> func ) {
+		//
+		tile3 *tile = m_storage->tiles[n];
+		if( tile && tile->num_active[m_dim] ) {
+			bool result = loop_tile(n,[&]( int i, int j, int k, size_t m ) {
+				if( tile->active(m,m_dim)) {
+					bool active (true);
+					bool stop = func(i,j,k,m_storage->element_bytes ? tile->value(m,m_dim,*m_storage) : nullptr,active,face_filled(i,j,k));
+					if( ! active ) tile->deactivate(m,m_dim);
+					return stop;
+				}
+				return false;
+			});
+			release_if_empty(n);
+			return result;
+		}
+		return false;
+	}
+	//
+	bool const_loop_actives_body ( size_t n, std::function<bool(int i, int j, int k, const void *value_ptr, const bool &filled )> func ) const {
+		//
+		const tile3 *tile = m_storage->tiles[n];
+		if( tile && tile->num_active[m_dim] ) {
+			return loop_tile(n,[&]( int i, int j, int k, size_t m ) {
+				if( tile->active(m,m_dim)) {
+					return func(i,j,k,m_storage->element_bytes ? tile->value(m,m_dim,*m_storage) : nullptr,face_filled(i,j,k));
+				}
+				return false;
+			});
+		}
+		return false;
+	}
+	//
+	bool loop_all_body ( size_t n, std::function<bool(int i, int j, int k, void *value_ptr, bool &active, const bool &filled )> func ) {
+		//
+		const unsigned &element_bytes = m_storage->element_bytes;
+		unsigned char buffer[element_bytes ? element_bytes : 1];
+		bool result = loop_tile(n,[&]( int i, int j, int k, size_t m ) {
+			tile3 *tile = m_storage->tiles[n];
+			if( tile ) {
+				bool active = tile->active(m,m_dim);
+				bool new_active (active);
+				bool stop = func(i,j,k,element_bytes ? tile->value(m,m_dim,*m_storage) : nullptr,new_active,face_filled(i,j,k));
+				if( new_active != active ) {
+					if( new_active ) tile->activate(m,m_dim);
+					else tile->deactivate(m,m_dim);
+				}
+				return stop;
+			} else {
+				bool active (false);
+				bool stop = func(i,j,k,element_bytes ? buffer : nullptr,active,face_filled(i,j,k));
+				if( active ) {
+					tile = m_storage->acquire_tile(n);
+					if( element_bytes ) std::memcpy(tile->value(m,m_dim,*m_storage),buffer,element_bytes);
+					tile->activate(m,m_dim);
+				}
+				return stop;
+			}
+		});
+		release_if_empty(n);
+		return result;
+	}
+	//
+	bool const_loop_all_body ( size_t n, std::function<bool(int i, int j, int k, const void *value_ptr, const bool &active, const bool &filled )> func ) const {
+		//
+		const tile3 *tile = m_storage->tiles[n];
+		return loop_tile(n,[&]( int i, int j, int k, size_t m ) {
+			bool active = tile && tile->active(m,m_dim);
+			return func(i,j,k,active && m_storage->element_bytes ? tile->value(m,m_dim,*m_storage) : nullptr,active,face_filled(i,j,k));
+		});
+	}
+	//
+	virtual void parallel_actives ( std::function<void(int i, int j, int k, void *value_ptr, bool &active, const bool &filled, int thread_index )> func, const parallel_driver &parallel ) override {
+		parallel.for_each(m_storage->tiles.size(),[&]( size_t n, int thread_index ) {
+			loop_actives_body(n,[&](int i, int j, int k, void *value_ptr, bool &active, const bool &filled) {
+				func(i,j,k,value_ptr,active,filled,thread_index);
+				return false;
+			});
+		});
+	}
+	virtual void serial_actives ( std::function<bool(int i, int j, int k, void *value_ptr, bool &active, const bool &filled )> func ) override {
+		for( size_t n=0; n<m_storage->tiles.size(); ++n ) if(loop_actives_body(n,func)) break;
+	}
+	//
+	virtual void const_parallel_actives ( std::function<void(int i, int j, int k, const void *value_ptr, const bool &filled, int thread_index )> func, const parallel_driver &parallel ) const override {
+		parallel.for_each(m_storage->tiles.size(),[&]( size_t n, int thread_index ) {
+			const_loop_actives_body(n,[&](int i, int j, int k, const void *value_ptr, const bool &filled) {
+				func(i,j,k,value_ptr,filled,thread_index);
+				return false;
+			});
+		});
+	}
+	virtual void const_serial_actives ( std::function<bool(int i, int j, int k, const void *value_ptr, const bool &filled )> func ) const override {
+		for( size_t n=0; n<m_storage->tiles.size(); ++n ) if(const_loop_actives_body(n,func)) break;
+	}
+	//
+	virtual void parallel_all ( std::function<void(int i, int j, int k, void *value_ptr, bool &active, const bool &filled, int thread_index )> func, const parallel_driver &parallel ) override {
+		parallel.for_each(m_storage->tiles.size(),[&]( size_t n, int thread_index ) {
+			loop_all_body(n,[&](int i, int j, int k, void *value_ptr, bool &active, const bool &filled) {
+				func(i,j,k,value_ptr,active,filled,thread_index);
+				return false;
+			});
+		});
+	}
+	virtual void serial_all ( std::function<bool(int i, int j, int k, void *value_ptr, bool &active, const bool &filled )> func ) override {
+		for( size_t n=0; n<m_storage->tiles.size(); ++n ) if(loop_all_body(n,func)) break;
+	}
+	//
+	virtual void const_parallel_all ( std::function<void(int i, int j, int k, const void *value_ptr, const bool &active, const bool &filled, int thread_index )> func, const parallel_driver &parallel ) const override {
+		parallel.for_each(m_storage->tiles.size(),[&]( size_t n, int thread_index ) {
+			const_loop_all_body(n,[&](int i, int j, int k, const void *value_ptr, const bool &active, const bool &filled) {
+				func(i,j,k,value_ptr,active,filled,thread_index);
+				return false;
+			});
+		});
+	}
+	virtual void const_serial_all ( std::function<bool(int i, int j, int k, const void *value_ptr, const bool &active, const bool &filled )> func ) const override {
+		for( size_t n=0; n<m_storage->tiles.size(); ++n ) if(const_loop_all_body(n,func)) break;
+	}
+	//
+private:
+	//
+	struct storage3;
+	//
+	// A tile holds the activity masks of all the faces followed by the interleaved values
+	// in one 64 byte aligned block: [mask_0][mask_1][mask_2][pad][u0 v0 w0 u1 v1 w1 ...]
+	struct tile3 {
+		//
+		tile3( const storage3 &storage ) {
+			const size_t mask_total = storage.num_faces*storage.mask_bytes;
+			const size_t value_offset = 64*((mask_total+63)/64);
+			const size_t size = value_offset+storage.num_faces*storage.tile_count()*storage.element_bytes;
+			m_block = new unsigned char [size+63];
+			unsigned char *aligned = reinterpret_cast<unsigned char *>((reinterpret_cast<uintptr_t>(m_block)+63) & ~uintptr_t(63));
+			std::memset(aligned,0,mask_total);
+			for( int dim=0; dim<storage.num_faces; ++dim ) mask[dim] = aligned+dim*storage.mask_bytes;
+			buffer = aligned+value_offset;
+		}
+		~tile3() {
+			delete [] m_block;
+		}
+		bool active( size_t m, int dim ) const {
+			return (mask[dim][m>>3] >> (m&7)) & 1U;
+		}
+		void activate( size_t m, int dim ) {
+			mask[dim][m>>3] |= 1U << (m&7);
+			num_active[dim] ++;
+		}
+		void deactivate( size_t m, int dim ) {
+			assert(num_active[dim]);
+			mask[dim][m>>3] &= ~(1U << (m&7));
+			num_active[dim] --;
+		}
+		void *value( size_t m, int dim, const storage3 &storage ) const {
+			return buffer+m*storage.value_stride+dim*storage.element_bytes;
+		}
+		bool empty() const {
+			return ! num_active[0] && ! num_active[1] && ! num_active[2];
+		}
+		//
+		unsigned short num_active[DIM3] {0,0,0};
+		unsigned char *mask[DIM3] {nullptr,nullptr,nullptr};
+		unsigned char *buffer {nullptr};
+		unsigned char *m_block {nullptr};
+	};
+	//
+	// Tile table shared among the faces bound together
+	struct storage3 {
+		//
+		~storage3() {
+			dealloc();
+		}
+		void reset( const shape3 &_cell_shape, unsigned _element_bytes ) {
+			dealloc();
+			cell_shape = _cell_shape;
+			element_bytes = _element_bytes;
+			value_stride = num_faces*element_bytes;
+			mask_bytes = std::ceil(tile_count()/8.0);
+			for( int dim : DIMS3 ) {
+				face_shape[dim] = num_faces > 1 ? cell_shape.face(dim) : cell_shape;
+				fill_mask[dim].clear();
+			}
+			shape3 extent = num_faces > 1 ? cell_shape+shape3(1,1,1) : cell_shape;
+			bx = std::ceil(extent.w/(double)Z);
+			by = std::ceil(extent.h/(double)Z);
+			bz = std::ceil(extent.d/(double)Z);
+			bxby = bx*by;
+			std::vector<std::atomic<tile3 *> > table(bx*by*bz);
+			for( auto &e : table ) e = nullptr;
+			tiles.swap(table);
+		}
+		void dealloc() {
+			for( auto &tile : tiles ) {
+				if( tile ) {
+					delete tile;
+					tile = nullptr;
+				}
+			}
+		}
+		tile3* acquire_tile( size_t n ) {
+			tile3 *tile = tiles[n];
+			if( ! tile ) {
+				std::lock_guard<std::mutex> guard(mutex);
+				tile = tiles[n];
+				if( ! tile ) {
+					tile = new tile3(*this);
+					tiles[n] = tile;
+				}
+			}
+			return tile;
+		}
+		void compact() {
+			for( auto &entry : tiles ) {
+				tile3 *tile = entry;
+				if( tile && tile->empty()) {
+					delete tile;
+					entry = nullptr;
+				}
+			}
+		}
+		size_t tile_count() const {
+			return Z*Z*Z;
+		}
+		size_t encode( int bi, int bj, int bk ) const {
+			return bi + bj * bx + bk * bxby;
+		}
+		void decode( size_t n, int &bi, int &bj, int &bk ) const {
+			const size_t plane = bx*by;
+			bi = (n % plane) % bx;
+			bj = (n % plane) / bx;
+			bk = n / plane;
+		}
+		size_t encode_local( int ii, int jj, int kk ) const {
+			return ii | (jj << log2Z) | (kk << (2*log2Z));
+		}
+		size_t tile_index( int i, int j, int k ) const {
+			return encode(i >> log2Z,j >> log2Z,k >> log2Z);
+		}
+		size_t local_index( int i, int j, int k ) const {
+			const int mask = Z-1;
+			return encode_local(i & mask,j & mask,k & mask);
+		}
+		//
+		unsigned Z {16};
+		unsigned log2Z {4};
+		int num_faces {1};
+		shape3 cell_shape;
+		shape3 face_shape[DIM3];
+		unsigned element_bytes {0};
+		unsigned value_stride {0};
+		unsigned mask_bytes {0};
+		unsigned bx {0}, by {0}, bz {0}, bxby {0};
+		std::vector<std::atomic<tile3 *> > tiles;
+		std::vector<bool> fill_mask[DIM3];
+		std::mutex mutex;
+	};
+	//
+	const shape3& face_shape() const {
+		return m_storage->face_shape[m_dim];
+	}
+	size_t encode_face( int i, int j, int k ) const {
+		const shape3 &s = face_shape();
+		return i + s.w * (j + s.h * k);
+	}
+	bool face_filled( int i, int j, int k ) const {
+		const std::vector<bool> &fill_mask = m_storage->fill_mask[m_dim];
+		return fill_mask.empty() ? false : fill_mask[encode_face(i,j,k)];
+	}
+	bool loop_tile( size_t n, std::function<bool(int i, int j, int k, size_t m)> func ) const {
+		//
+		const unsigned &Z = m_storage->Z;
+		const shape3 &s = face_shape();
+		int bi, bj, bk;
+		m_storage->decode(n,bi,bj,bk);
+		int oi (bi*Z), oj (bj*Z), ok (bk*Z);
+		int Zx = std::min((int)Z,(int)s.w-oi);
+		int Zy = std::min((int)Z,(int)s.h-oj);
+		int Zz = std::min((int)Z,(int)s.d-ok);
+		for( int kk=0; kk<Zz; ++kk ) for( int jj=0; jj<Zy; ++jj ) for( int ii=0; ii<Zx; ++ii ) {
+			if( func(oi+ii,oj+jj,ok+kk,m_storage->encode_local(ii,jj,kk))) return true;
+		}
+		return false;
+	}
+	void release_if_empty( size_t n ) {
+		//
+		// Bound faces may touch the same tile concurrently, so only a standalone
+		// core deletes empty tiles right away. Bound tiles are released on "compact".
+		if( m_storage->num_faces == 1 ) {
+			tile3 *tile = m_storage->tiles[n];
+			if( tile && tile->empty()) {
+				delete tile;
+				m_storage->tiles[n] = nullptr;
+			}
+		}
+	}
+	void clear_face() {
+		for( auto &e : m_storage->tiles ) {
+			tile3 *tile = e;
+			if( tile ) {
+				std::memset(tile->mask[m_dim],0,m_storage->mask_bytes);
+				tile->num_active[m_dim] = 0;
+			}
+		}
+		//
+		// Like release_if_empty, bound faces leave empty tiles to the "compact" message sent
+		// by macarray3 after all the faces are cleared
+		if( m_storage->num_faces == 1 ) m_storage->compact();
+	}
+	//
+	std::shared_ptr<storage3> m_storage;
+	int m_dim {0};
+};
+//
+extern "C" module * create_instance() {
+	return new mactiledarray3();
+}
+//
+extern "C" const char *license() {
+	return "MIT";
+}
+//
+SHKZ_END_NAMESPACE
+//
+#endif
+//
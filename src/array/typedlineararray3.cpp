@@ -0,0 +1,319 @@
+/*
+**	typedlineararray3.cpp
+**
+**	This is part of Shiokaze, a research-oriented fluid solver for computer graphics.
+**	Created by Ryoichi Ando <rand@nii.ac.jp> on Oct 18, 2026.
+**
+**	Permission is hereby granted, free of charge, to any person obtaining a copy of
+**	this software and associated documentation files (the "Software"), to deal in
+**	the Software without restriction, including without limitation the rights to use,
+**	copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+**	Software, and to permit persons to whom the Software is furnished to do so,
+**	subject to the following conditions:
+**
+**	The above copyright notice and this permission notice shall be included in all copies
+**	or substantial portions of the Software.
+**
+**	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+**	INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+**	PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+**	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+**	CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+**	OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+//
+#include "lineararray3.h"
+#include <shiokaze/array/linear_kernel3.h>
+#include <cstdlib>
+#include <new>
+#include <array>
+#include <limits>
+#include <algorithm>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+//
+#ifndef ELEMENT_TYPE
+#define ELEMENT_TYPE	float
+#endif
+//
+#ifndef ELEMENT_WIDTH
+#define ELEMENT_WIDTH	1
+#endif
+//
+SHKZ_BEGIN_NAMESPACE
+//
+template <class T, unsigned W> class typedlineararray3 : public lineararray3 {
+public:
+	typedlineararray3 () = default;
+protected:
+	//
+	LONG_NAME("Typed Linear Array 3D")
+	ARGUMENT_NAME("TypedLinArray")
+	//
+	virtual ~typedlineararray3() {
+		//
+		// The base destructor no longer dispatches to our deallocator, so release the buffer here
+		dealloc();
+	}
+	//
+	virtual void configure( configuration &config ) override {
+		config.get_bool("HugePage",m_huge_page,"Advise transparent huge pages for large buffers");
+	}
+	//
+	virtual unsigned char * allocate_buffer( size_t size ) override {
+		//
+		const bool huge = m_huge_page && size >= huge_page_size;
+		void *ptr (nullptr);
+		if( posix_memalign(&ptr,huge ? size_t(huge_page_size) : size_t(alignment),size)) throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+		if( huge ) madvise(ptr,size,MADV_HUGEPAGE);
+#endif
+		return static_cast<unsigned char *>(ptr);
+	}
+	//
+	virtual void deallocate_buffer( unsigned char *buffer ) override {
+		std::free(buffer);
+	}
+	//
+	virtual void copy( const array_core3 &array, std::function<void(void *target, const void *src)> copy_func, const parallel_driver &parallel ) override {
+		//
+		auto mate_array = dynamic_cast<const typedlineararray3 *>(&array);
+		if( mate_array && mate_array->is_typed()) {
+			//
+			// Keep the buffer when the shape does not change, saving the page faults of a fresh allocation
+			unsigned char *buffer (nullptr);
+			if( m_buffer && m_nx == mate_array->m_nx && m_ny == mate_array->m_ny && m_nz == mate_array->m_nz && m_element_bytes == mate_array->m_element_bytes ) {
+				std::swap(buffer,m_buffer);
+			}
+			dealloc();
+			m_nx = mate_array->m_nx;
+			m_ny = mate_array->m_ny;
+			m_nz = mate_array->m_nz;
+			m_element_bytes = mate_array->m_element_bytes;
+			m_bit_mask_size = mate_array->m_bit_mask_size;
+			//
+			m_bit_mask = new unsigned char [m_bit_mask_size];
+			std::memcpy(m_bit_mask,mate_array->m_bit_mask,m_bit_mask_size);
+			if( mate_array->m_fill_mask ) {
+				m_fill_mask = new unsigned char [m_bit_mask_size];
+				std::memcpy(m_fill_mask,mate_array->m_fill_mask,m_bit_mask_size);
+			}
+			//
+			// Values of inactive cells are never read, so whole runs are copied without consulting the mask
+			const size_t count = cell_count();
+			m_buffer = buffer ? buffer : allocate_buffer(count*m_element_bytes);
+			T *dst = values();
+			const T *src = mate_array->values();
+			for_each_chunk(parallel,[&]( size_t b0, size_t b1, int thread_index ) {
+				const size_t n0 = 8*b0, n1 = std::min(8*b1,count);
+				std::memcpy(dst+W*n0,src+W*n0,W*(n1-n0)*sizeof(T));
+			});
+		} else {
+			lineararray3::copy(array,copy_func,parallel);
+		}
+	}
+	//
+	virtual bool send_message( std::string message, void *ptr ) override {
+		if( message == "fill" ) {
+			return fill(*static_cast<const linear_kernel3::fill_payload *>(ptr));
+		} else if( message == "axpy" ) {
+			return axpy(*static_cast<const linear_kernel3::axpy_payload *>(ptr));
+		}
+		return false;
+	}
+	//
+	virtual bool const_send_message( std::string message, void *ptr ) const override {
+		if( message == "min_max" ) {
+			return min_max(*static_cast<linear_kernel3::min_max_payload *>(ptr));
+		}
+		return false;
+	}
+	//
+	bool fill( const linear_kernel3::fill_payload &payload ) {
+		//
+		if( ! is_typed()) return false;
+		//
+		T value[W];
+		std::memcpy(value,payload.value,sizeof(value));
+		T *__restrict buffer = values();
+		const size_t count = cell_count();
+		//
+		for_each_chunk(*payload.parallel,[&]( size_t b0, size_t b1, int thread_index ) {
+			if( payload.only_actives ) {
+				for_each_run(b0,b1,count,
+					[&]( size_t n8 ) { return m_bit_mask[n8] == 0xFF; },
+					[&]( size_t n0, size_t n1 ) {
+						for( size_t n=n0; n<n1; ++n ) for( unsigned w=0; w<W; ++w ) buffer[W*n+w] = value[w];
+					},
+					[&]( size_t n8, unsigned char valid ) {
+						const unsigned char mask = m_bit_mask[n8] & valid;
+						for( unsigned n0=0; n0<8; ++n0 ) if((mask >> n0) & 1U) {
+							for( unsigned w=0; w<W; ++w ) buffer[W*(8*n8+n0)+w] = value[w];
+						}
+					});
+			} else {
+				const size_t n0 = 8*b0, n1 = std::min(8*b1,count);
+				for( size_t n=n0; n<n1; ++n ) for( unsigned w=0; w<W; ++w ) buffer[W*n+w] = value[w];
+				for( size_t n8=b0; n8<b1; ++n8 ) m_bit_mask[n8] = valid_bits(n8,count);
+			}
+		});
+		return true;
+	}
+	//
+	bool axpy( const linear_kernel3::axpy_payload &payload ) {
+		//
+		auto x_array = dynamic_cast<const typedlineararray3 *>(payload.x);
+		if( ! is_typed() || ! x_array || x_array == this || ! x_array->is_typed()) return false;
+		if( x_array->m_nx != m_nx || x_array->m_ny != m_ny || x_array->m_nz != m_nz ) return false;
+		if( m_fill_mask || x_array->m_fill_mask ) return false;
+		//
+		T y_background[W], x_background[W];
+		std::memcpy(y_background,payload.y_background,sizeof(y_background));
+		std::memcpy(x_background,payload.x_background,sizeof(x_background));
+		const T alpha = payload.alpha;
+		T *__restrict y = values();
+		const T *__restrict x = x_array->values();
+		const unsigned char *x_mask = x_array->m_bit_mask;
+		const size_t count = cell_count();
+		//
+		for_each_chunk(*payload.parallel,[&]( size_t b0, size_t b1, int thread_index ) {
+			for_each_run(b0,b1,count,
+				[&]( size_t n8 ) { return (m_bit_mask[n8] & x_mask[n8]) == 0xFF; },
+				[&]( size_t n0, size_t n1 ) {
+					for( size_t m=W*n0; m<W*n1; ++m ) y[m] += alpha * x[m];
+				},
+				[&]( size_t n8, unsigned char valid ) {
+					const unsigned char y_mask = m_bit_mask[n8], xm = x_mask[n8];
+					for( unsigned n0=0; n0<8; ++n0 ) if((valid >> n0) & 1U) {
+						const size_t n = 8*n8+n0;
+						const bool y_active = (y_mask >> n0) & 1U;
+						const bool x_active = (xm >> n0) & 1U;
+						for( unsigned w=0; w<W; ++w ) {
+							const T a = y_active ? y[W*n+w] : y_background[w];
+							const T b = x_active ? x[W*n+w] : x_background[w];
+							y[W*n+w] = a + alpha * b;
+						}
+					}
+					m_bit_mask[n8] = valid;
+				});
+		});
+		return true;
+	}
+	//
+	bool min_max( linear_kernel3::min_max_payload &payload ) const {
+		//
+		if( ! is_typed()) return false;
+		//
+		using values_w = std::array<T,W>;
+		const int num_threads = std::max(1,payload.parallel->get_thread_num());
+		values_w init_min, init_max;
+		init_min.fill(std::numeric_limits<T>::max());
+		init_max.fill(std::numeric_limits<T>::lowest());
+		std::vector<values_w> min_values(num_threads,init_min), max_values(num_threads,init_max);
+		std::vector<char> found(num_threads,0);
+		const T *__restrict buffer = values();
+		const size_t count = cell_count();
+		//
+		for_each_chunk(*payload.parallel,[&]( size_t b0, size_t b1, int thread_index ) {
+			values_w local_min (min_values[thread_index]), local_max (max_values[thread_index]);
+			bool local_found (false);
+			for_each_run(b0,b1,count,
+				[&]( size_t n8 ) { return m_bit_mask[n8] == 0xFF; },
+				[&]( size_t n0, size_t n1 ) {
+					for( size_t n=n0; n<n1; ++n ) for( unsigned w=0; w<W; ++w ) {
+						const T v = buffer[W*n+w];
+						local_min[w] = v < local_min[w] ? v : local_min[w];
+						local_max[w] = v > local_max[w] ? v : local_max[w];
+					}
+					local_found = local_found || n1 > n0;
+				},
+				[&]( size_t n8, unsigned char valid ) {
+					const unsigned char mask = m_bit_mask[n8] & valid;
+					for( unsigned n0=0; n0<8; ++n0 ) if((mask >> n0) & 1U) {
+						for( unsigned w=0; w<W; ++w ) {
+							const T v = buffer[W*(8*n8+n0)+w];
+							local_min[w] = std::min(v,local_min[w]);
+							local_max[w] = std::max(v,local_max[w]);
+						}
+						local_found = true;
+					}
+				});
+			min_values[thread_index] = local_min;
+			max_values[thread_index] = local_max;
+			if( local_found ) found[thread_index] = 1;
+		});
+		//
+		values_w result_min (init_min), result_max (init_max);
+		payload.found = false;
+		for( int q=0; q<num_threads; ++q ) if( found[q] ) {
+			for( unsigned w=0; w<W; ++w ) {
+				result_min[w] = std::min(result_min[w],min_values[q][w]);
+				result_max[w] = std::max(result_max[w],max_values[q][w]);
+			}
+			payload.found = true;
+		}
+		if( payload.found ) {
+			std::memcpy(payload.min_value,result_min.data(),sizeof(T)*W);
+			std::memcpy(payload.max_value,result_max.data(),sizeof(T)*W);
+		}
+		return true;
+	}
+	//
+	bool is_typed() const {
+		return m_buffer && m_element_bytes == sizeof(T)*W;
+	}
+	size_t cell_count() const {
+		return static_cast<size_t>(m_nx)*m_ny*m_nz;
+	}
+	T * values() {
+		return static_cast<T *>(__builtin_assume_aligned(m_buffer,alignment));
+	}
+	const T * values() const {
+		return static_cast<const T *>(__builtin_assume_aligned(m_buffer,alignment));
+	}
+	static unsigned char valid_bits( size_t n8, size_t count ) {
+		const size_t rest = count-8*n8;
+		return rest >= 8 ? 0xFF : (1U << rest)-1;
+	}
+	//
+	// Split the mask bytes into chunks of chunk_bytes and process them in parallel
+	template <class F> void for_each_chunk( const parallel_driver &parallel, F func ) const {
+		const size_t num_chunks = (m_bit_mask_size+chunk_bytes-1) / chunk_bytes;
+		parallel.for_each(num_chunks,[&]( size_t c, int thread_index ) {
+			func(c*chunk_bytes,std::min((c+1)*chunk_bytes,(size_t)m_bit_mask_size),thread_index);
+		});
+	}
+	//
+	// Walk the mask bytes [b0,b1), gathering consecutive fully occupied bytes into runs of cells
+	// that are passed to run_func, and handing every other byte to byte_func with its valid bits
+	template <class FullFunc, class RunFunc, class ByteFunc>
+	static void for_each_run( size_t b0, size_t b1, size_t count, FullFunc full_func, RunFunc run_func, ByteFunc byte_func ) {
+		size_t run_start (b0);
+		for( size_t n8=b0; n8<b1; ++n8 ) {
+			const unsigned char valid = valid_bits(n8,count);
+			if( valid != 0xFF || ! full_func(n8)) {
+				if( n8 > run_start ) run_func(8*run_start,8*n8);
+				byte_func(n8,valid);
+				run_start = n8+1;
+			}
+		}
+		if( b1 > run_start ) run_func(8*run_start,8*b1);
+	}
+	//
+	static constexpr size_t alignment = 64;
+	static constexpr size_t huge_page_size = 2*1024*1024;
+	static constexpr size_t chunk_bytes = 512;
+	bool m_huge_page {false};
+};
+//
+extern "C" module * create_instance() {
+	return new typedlineararray3<ELEMENT_TYPE,ELEMENT_WIDTH>();
+}
+//
+extern "C" const char *license() {
+	return "MIT";
+}
+//
+SHKZ_END_NAMESPACE
+//
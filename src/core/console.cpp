@@ -256,26 +256,44 @@ namespace console {
 	void set_time ( double time ) {
 		g_time = time;
 	}
+	double get_time() {
+		return g_time;
+	}
+	static FILE* open_record( std::string name ) {
+		static bool firstTime = true;
+		std::string record_path = g_root_path+"/record";
+		if( firstTime ) {
+			if( ! filesystem::is_exist(record_path)) filesystem::create_directory(record_path);
+			system("cp scripts/plot.sh %s/plot.sh",record_path.c_str());
+			firstTime = false;
+		}
+		return fopen(format_str("%s/%s.out",record_path.c_str(),name.c_str()).c_str(),"a");
+	}
+	//
 	void write( std::string name, double number ) {
 		if( ! g_root_path.empty()) {
 			std::lock_guard<std::mutex> guard(g_console_mutex);
-			static bool firstTime = true;
-			std::string record_path = g_root_path+"/record";
-			if( firstTime ) {
-				if( ! filesystem::is_exist(record_path)) filesystem::create_directory(record_path);
-				system("cp scripts/plot.sh %s/plot.sh",record_path.c_str());
-				firstTime = false;
-			}
-			if( ! g_root_path.empty() ) {
-				FILE *console = fopen(format_str("%s/%s.out",record_path.c_str(),name.c_str()).c_str(),"a");
-				if( console ) {
-					if( number == (int)number ) {
-						fprintf( console, "%lf %d\n", g_time, (int)number );
-					} else {
-						fprintf( console, "%lf %e\n", g_time, number );
-					}
-					fclose(console);
+			FILE *console = open_record(name);
+			if( console ) {
+				if( number == (int)number ) {
+					fprintf( console, "%lf %d\n", g_time, (int)number );
+				} else {
+					fprintf( console, "%lf %e\n", g_time, number );
 				}
+				fclose(console);
+			}
+		}
+	}
+	//
+	void write( std::string name, const std::vector<double> &numbers ) {
+		if( ! g_root_path.empty()) {
+			std::lock_guard<std::mutex> guard(g_console_mutex);
+			FILE *console = open_record(name);
+			if( console ) {
+				fprintf( console, "%lf", g_time );
+				for( const double &number : numbers ) fprintf( console, " %e", number );
+				fprintf( console, "\n" );
+				fclose(console);
 			}
 		}
 	}
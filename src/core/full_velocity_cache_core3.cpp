@@ -0,0 +1,81 @@
+/*
+**	full_velocity_cache_core3.cpp
+**
+**	This is part of Shiokaze, a research-oriented fluid solver for computer graphics.
+**	Created by Ryoichi Ando <rand@nii.ac.jp> on Oct 18, 2026.
+**
+**	Permission is hereby granted, free of charge, to any person obtaining a copy of
+**	this software and associated documentation files (the "Software"), to deal in
+**	the Software without restriction, including without limitation the rights to use,
+**	copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+**	Software, and to permit persons to whom the Software is furnished to do so,
+**	subject to the following conditions:
+**
+**	The above copyright notice and this permission notice shall be included in all copies
+**	or substantial portions of the Software.
+**
+**	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+**	INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+**	PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+**	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+**	CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+**	OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+//
+#include <shiokaze/array/full_velocity_cache_core3.h>
+#include <map>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+//
+SHKZ_USING_NAMESPACE
+//
+struct full_velocity_entry3 {
+	std::array<uint64_t,DIM3> version {};
+	std::shared_ptr<void> data;
+};
+//
+static std::thread::id g_main_thread_id = std::this_thread::get_id();
+static std::map<size_t,full_velocity_entry3> g_entry_map;
+static size_t g_hit_count {0}, g_fetch_count {0};
+//
+static void thread_check () {
+	if( g_main_thread_id != std::this_thread::get_id() ) {
+		printf( "full_velocity_cache_core3: Calling from a multithread is not allowed.\n");
+		exit(0);
+	}
+}
+//
+std::shared_ptr<void> full_velocity_cache_core3::fetch( size_t key, const std::array<uint64_t,DIM3> &version, std::function<void *()> alloc_func, std::function<void( void *ptr )> dealloc_func, std::function<void( void *ptr )> update_func ) {
+	//
+	thread_check();
+	//
+	g_fetch_count ++;
+	full_velocity_entry3 &entry = g_entry_map[key];
+	if( entry.data && entry.version == version ) {
+		g_hit_count ++;
+		return entry.data;
+	}
+	//
+	// Recycle the storage unless someone still holds the previous result
+	if( ! entry.data || entry.data.use_count() > 1 ) {
+		entry.data = std::shared_ptr<void>(alloc_func(),dealloc_func);
+	}
+	update_func(entry.data.get());
+	entry.version = version;
+	return entry.data;
+}
+//
+double full_velocity_cache_core3::get_hit_rate() {
+	return g_fetch_count ? g_hit_count / (double)g_fetch_count : 0.0;
+}
+//
+size_t full_velocity_cache_core3::clear() {
+	//
+	thread_check();
+	//
+	size_t count = g_entry_map.size();
+	g_entry_map.clear();
+	return count;
+}
+//
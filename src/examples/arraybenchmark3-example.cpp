@@ -24,10 +24,16 @@
 //
 #include <shiokaze/core/runnable.h>
 #include <shiokaze/array/array3.h>
+#include <shiokaze/array/shared_array3.h>
 #include <shiokaze/core/timer.h>
 #include <shiokaze/core/console.h>
-#include <cmath>
+#include <shiokaze/core/filesystem.h>
+#include <algorithm>
+#include <sstream>
+#include <cstdio>
+#include <random>
 #include <thread>
+#include <cmath>
 //
 SHKZ_USING_NAMESPACE
 //
@@ -37,6 +43,11 @@ private:
 	LONG_NAME("Array Benchmark 3D")
 	ARGUMENT_NAME("ArrayBenchmarkExample")
 	//
+	virtual void load( configuration &config ) override {
+		const unsigned num_threads = std::max(1U,std::thread::hardware_concurrency());
+		m_thread_counts = num_threads > 1 ? "1,"+std::to_string(num_threads) : "1";
+	}
+	//
 	virtual void configure( configuration &config ) override {
 		//
 		config.get_unsigned("ResolutionX",m_shape[0],"Resolution towards X axis");
@@ -46,89 +57,225 @@ private:
 		double resolution_scale (1.0);
 		config.get_double("ResolutionScale",resolution_scale,"Resolution doubling scale");
 		//
+		config.get_string("Cores",m_cores,"Comma separated list of array cores to benchmark");
+		config.get_string("TileSizes",m_tile_sizes,"Comma separated list of tile sizes for tiled cores");
+		config.get_string("ThreadCounts",m_thread_counts,"Comma separated list of thread counts");
+		config.get_string("Sparsities",m_sparsities,"Comma separated list of active cell ratios");
+		config.get_unsigned("Repetitions",m_repetitions,"Number of repetitions for each operation");
+		config.get_string("OutputName",m_output_name,"Base name of the JSON and CSV result files");
+		//
 		m_shape *= resolution_scale;
 		m_dx = m_shape.dx();
 	}
 	//
-	virtual void run_onetime() override {
+	template <class T> static std::vector<T> parse_list( std::string list ) {
+		std::vector<T> result;
+		std::stringstream stream(list);
+		std::string item;
+		while( std::getline(stream,item,',')) {
+			if( ! item.empty()) {
+				T value;
+				std::stringstream(item) >> value;
+				result.push_back(value);
+			}
+		}
+		return result;
+	}
+	//
+	struct benchmark_case {
+		std::string core_name;
+		unsigned tile_size;
+		int threads;
+		double sparsity;
+	};
+	//
+	struct benchmark_record {
+		benchmark_case bcase;
+		std::string operation;
+		size_t active_count;
+		double min_msec;
+		double mean_msec;
+	};
+	//
+	void measure( const benchmark_case &bcase, std::string operation, size_t active_count, std::function<void()> prepare, std::function<void()> func ) {
 		//
-		scoped_timer timer(this);
+		benchmark_record record = { bcase, operation, active_count, 0.0, 0.0 };
+		double sum (0.0);
+		for( unsigned n=0; n<m_repetitions; ++n ) {
+			if( prepare ) prepare();
+			scoped_timer timer;
+			timer.tick();
+			func();
+			const double msec = timer.tock();
+			record.min_msec = n ? std::min(record.min_msec,msec) : msec;
+			sum += msec;
+		}
+		record.mean_msec = sum / std::max(1U,m_repetitions);
+		console::dump( "   %-16s min = %10.3f msec, mean = %10.3f msec\n", operation.c_str(), record.min_msec, record.mean_msec );
+		m_records.push_back(record);
+	}
+	//
+	void benchmark( const benchmark_case &bcase ) {
 		//
-		timer.tick(); console::dump( "Performing initialization..." );
-		m_array.initialize(m_shape);
-		m_array.set_as_levelset(2.0*m_dx);
-		console::dump( "Done. Took %s\n", timer.stock("initialization").c_str());
+		console::dump( ">>> core = %s, tile = %u, threads = %d, sparsity = %.3f\n",
+			bcase.core_name.c_str(), bcase.tile_size, bcase.threads, bcase.sparsity );
 		//
-		auto levelset_func = [&]( const vec3d &p ) {
-			double r (0.225);
-			double w (0.25);
-			vec3r center(0.5,0.5,0.5);
-			return (p-center).len()-r;
-		};
+		// Every grid of this case is configured with its own tile size and thread count
+		configuration config;
+		configuration::auto_group group(config,*this);
+		if( bcase.tile_size ) config.set_unsigned("TileSize",bcase.tile_size);
+		config.set_integer("Threads",bcase.threads);
 		//
-		timer.tick(); console::dump( "Performing parallel_all..." );
-		m_array.parallel_all([&](int i, int j, int k, auto &it) {
-			double d = levelset_func(m_dx*vec3i(i,j,k).cell());
-			if( std::abs(d) < 2.0*m_dx) it.set(d);
-			else it.set_off();
-		});
-		console::dump( "Done. Took %s\n", timer.stock("parallel_all").c_str());
+		recursive_configurable holder;
+		array3<Real> array(&holder,bcase.core_name);
+		array3<Real> output(&holder,bcase.core_name);
+		array3<Real> target(&holder,bcase.core_name);
+		array3<Real> levelset(&holder,bcase.core_name);
+		holder.setup_now(config);
 		//
-		timer.tick(); console::dump( "Performing dilation..." );
-		m_array.dilate(5);
-		console::dump( "Done. Took %s\n", timer.stock("dilation").c_str());
+		array.initialize(m_shape);
+		output.initialize(m_shape);
+		target.initialize(m_shape);
+		const parallel_driver &parallel = array.get_parallel_driver();
 		//
-		timer.tick(); console::dump( "Performing serial_all..." );
-		m_array.serial_all([&](int i, int j, int k, auto &it) {
-			it();
-		});
-		console::dump( "Done. Took %s\n", timer.stock("serial_all").c_str());
+		// The active cells form a spherical shell whose thickness realizes the requested sparsity
+		const double radius (0.3);
+		const double volume = m_shape.count() * m_dx * m_dx * m_dx;
+		const double half_width = bcase.sparsity * volume / (8.0 * M_PI * radius * radius);
+		const bool all_active = bcase.sparsity >= 1.0;
+		auto levelset_func = [&]( const vec3d &p, double shift ) {
+			return (p-vec3d(0.5+shift,0.5,0.5)).len()-radius;
+		};
+		auto activate = [&]( double shift ) {
+			array.parallel_all([&]( int i, int j, int k, auto &it ) {
+				const double phi = levelset_func(m_dx*vec3i(i,j,k).cell(),shift);
+				if( all_active || std::abs(phi) < half_width ) it.set(phi);
+				else if( it.active()) it.set_off();
+			});
+		};
 		//
-		timer.tick(); console::dump( "Performing flood fill..." );
-		m_array.flood_fill();
-		console::dump( "Done. Took %s\n", timer.stock("flood_fill").c_str());
+		measure(bcase,"activate",0,[&]() { array.clear(); },[&]() { activate(0.0); });
+		const size_t active_count = array.count();
+		m_records.back().active_count = active_count;
 		//
-		timer.tick(); console::dump( "Performing paralle_actives..." );
-		m_array.parallel_actives([&](int i, int j, int k, auto &it) {
-			it.set(2.0 * it());
-		});
-		console::dump( "Done. Took %s\n", timer.stock("parallel_actives").c_str());
+		unsigned churn_step (0);
+		measure(bcase,"churn",active_count,nullptr,[&]() { activate(2.0*m_dx*(++churn_step)); });
+		activate(0.0);
 		//
-		timer.tick(); console::dump( "Performing const_parallel_inside..." );
-		m_array.const_parallel_inside([&](int i, int j, int k, const auto &it) {
-			it();
-		});
-		console::dump( "Done. Took %s\n", timer.stock("const_parallel_inside").c_str());
+		measure(bcase,"count",active_count,nullptr,[&]() { array.count(); });
 		//
-		timer.tick(); console::dump( "Performing serial_actives..." );
-		m_array.serial_actives([&](int i, int j, int k, auto &it) {
-			it.set(2.0 * it());
+		std::vector<double> sums(std::max(1,parallel.get_thread_num()));
+		measure(bcase,"stream_read",active_count,nullptr,[&]() {
+			array.const_parallel_actives([&]( int i, int j, int k, const auto &it, int tn ) {
+				sums[tn] += it();
+			});
 		});
-		console::dump( "Done. Took %s\n", timer.stock("serial_actives").c_str());
 		//
-		timer.tick(); console::dump( "Performing parallel read..." );
-		m_parallel.for_each(m_array.shape(),[&]( int i, int j, int k, int tid ) {
-			m_array(i,j,k);
+		measure(bcase,"stencil_read",active_count,[&]() { output.clear(); output.activate_as(array); },[&]() {
+			output.parallel_actives([&]( int i, int j, int k, auto &it ) {
+				Real sum (-6.0*array(i,j,k));
+				for( int dim : DIMS3 ) for( int dir=-1; dir<=1; dir+=2 ) {
+					const vec3i qi = vec3i(i,j,k)+dir*vec3i(dim==0,dim==1,dim==2);
+					if( ! m_shape.out_of_bounds(qi)) sum += array(qi);
+				}
+				it.set(sum/(m_dx*m_dx));
+			});
 		});
-		console::dump( "Done. Took %s\n", timer.stock("parallel_read").c_str());
 		//
-		timer.tick(); console::dump( "Performing sequential read..." );
-		m_array.shape().for_each([&]( int i, int j, int k ) {
-			m_array(i,j,k);
+		std::mt19937 generator(0);
+		std::uniform_int_distribution<int> distribution[] = {
+			std::uniform_int_distribution<int>(0,m_shape[0]-1),
+			std::uniform_int_distribution<int>(0,m_shape[1]-1),
+			std::uniform_int_distribution<int>(0,m_shape[2]-1) };
+		std::vector<vec3i> positions(std::min(m_shape.count(),(size_t)1<<20));
+		for( auto &pi : positions ) for( int dim : DIMS3 ) pi[dim] = distribution[dim](generator);
+		measure(bcase,"random_read",active_count,nullptr,[&]() {
+			parallel.for_each(positions.size(),[&]( size_t n, int tn ) {
+				sums[tn] += array(positions[n]);
+			});
 		});
-		console::dump( "Done. Took %s\n", timer.stock("sequential_read").c_str());
 		//
-		timer.tick(); console::dump( "Performing sequntial write..." );
-		m_shape.for_each([&]( int i, int j, int k ) {
-			m_array.set(i,j,k,i+j+k);
+		measure(bcase,"copy",active_count,nullptr,[&]() { target.copy(array); });
+		measure(bcase,"dilate",active_count,[&]() { target.copy(array); },[&]() { target.dilate(2); });
+		//
+		levelset.copy(array);
+		levelset.set_as_levelset(std::max(half_width,m_dx));
+		measure(bcase,"flood_fill",active_count,[&]() { target.copy(levelset); },[&]() { target.flood_fill(); });
+		//
+		measure(bcase,"shared_borrow",active_count,nullptr,[&]() {
+			for( unsigned n=0; n<16; ++n ) {
+				shared_array3<Real> borrowed(m_shape,0.0,bcase.core_name);
+				borrowed->set(0,0,0,1.0);
+			}
 		});
-		console::dump( "Done. Took %s\n", timer.stock("sequntial_write").c_str());
+		//
+		console::dump( "<<< Done (active = %zu)\n", active_count );
+	}
+	//
+	void write_results() const {
+		//
+		std::string base_path = m_output_name;
+		if( console::get_root_path().size()) {
+			base_path = console::get_root_path() + "/" + m_output_name;
+		}
+		//
+		FILE *json = std::fopen((base_path+".json").c_str(),"w");
+		FILE *csv = std::fopen((base_path+".csv").c_str(),"w");
+		if( ! json || ! csv ) {
+			console::dump( "Failed to open \"%s\" for writing results.\n", base_path.c_str());
+			if( json ) std::fclose(json);
+			if( csv ) std::fclose(csv);
+			return;
+		}
+		//
+		std::fprintf(json,"{\n");
+		std::fprintf(json,"  \"resolution\": [%d, %d, %d],\n", m_shape[0], m_shape[1], m_shape[2] );
+		std::fprintf(json,"  \"repetitions\": %u,\n", m_repetitions );
+		std::fprintf(json,"  \"results\": [\n");
+		std::fprintf(csv,"core,tile_size,threads,sparsity,operation,active_count,min_msec,mean_msec\n");
+		for( size_t n=0; n<m_records.size(); ++n ) {
+			const benchmark_record &r = m_records[n];
+			std::fprintf(json,"    {\"core\": \"%s\", \"tile_size\": %u, \"threads\": %d, \"sparsity\": %g, \"operation\": \"%s\", \"active_count\": %zu, \"min_msec\": %.6f, \"mean_msec\": %.6f}%s\n",
+				r.bcase.core_name.c_str(), r.bcase.tile_size, r.bcase.threads, r.bcase.sparsity, r.operation.c_str(), r.active_count, r.min_msec, r.mean_msec,
+				n+1 < m_records.size() ? "," : "" );
+			std::fprintf(csv,"%s,%u,%d,%g,%s,%zu,%.6f,%.6f\n",
+				r.bcase.core_name.c_str(), r.bcase.tile_size, r.bcase.threads, r.bcase.sparsity, r.operation.c_str(), r.active_count, r.min_msec, r.mean_msec );
+		}
+		std::fprintf(json,"  ]\n}\n");
+		std::fclose(json);
+		std::fclose(csv);
+		console::dump( "Results written to \"%s.json\" and \"%s.csv\"\n", base_path.c_str(), base_path.c_str());
+	}
+	//
+	virtual void run_onetime() override {
+		//
+		const auto cores = parse_list<std::string>(m_cores);
+		const auto tile_sizes = parse_list<unsigned>(m_tile_sizes);
+		const auto thread_counts = parse_list<int>(m_thread_counts);
+		const auto sparsities = parse_list<double>(m_sparsities);
+		//
+		m_records.clear();
+		for( const auto &core_name : cores ) {
+			//
+			// Linear cores have no tiles, so they are measured once with tile size zero
+			std::vector<unsigned> core_tile_sizes (tile_sizes);
+			if( core_name.find("lineararray") != std::string::npos || core_tile_sizes.empty()) core_tile_sizes = { 0 };
+			for( unsigned tile_size : core_tile_sizes ) for( int threads : thread_counts ) for( double sparsity : sparsities ) {
+				benchmark({core_name,tile_size,threads,sparsity});
+			}
+		}
+		write_results();
 	}
 	//
-	array3<Real> m_array {this,"treearray3"};
-	parallel_driver m_parallel{this};
-	shape3 m_shape {256,256,256};
+	shape3 m_shape {128,128,128};
 	double m_dx;
+	std::string m_cores {"lineararray3,tiledarray3,mactiledarray3,treearray3"};
+	std::string m_tile_sizes {"8,16"};
+	std::string m_thread_counts {"1"};
+	std::string m_sparsities {"0.05,0.25,1.0"};
+	std::string m_output_name {"arraybenchmark3"};
+	unsigned m_repetitions {3};
+	std::vector<benchmark_record> m_records;
 };
 //
 extern "C" module * create_instance() {
@@ -137,4 +284,4 @@ extern "C" module * create_instance() {
 //
 extern "C" const char *license() {
 	return "MIT";
-}
\ No newline at end of file
+}
@@ -0,0 +1,328 @@
+/*
+**	linsolverbenchmark3-example.cpp
+**
+**	This is part of Shiokaze, a research-oriented fluid solver for computer graphics.
+**	Created by Ryoichi Ando <rand@nii.ac.jp> on Oct 18, 2026.
+**
+**	Permission is hereby granted, free of charge, to any person obtaining a copy of
+**	this software and associated documentation files (the "Software"), to deal in
+**	the Software without restriction, including without limitation the rights to use,
+**	copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+**	Software, and to permit persons to whom the Software is furnished to do so,
+**	subject to the following conditions:
+**
+**	The above copyright notice and this permission notice shall be included in all copies
+**	or substantial portions of the Software.
+**
+**	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+**	INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+**	PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+**	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+**	CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+**	OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+//
+#include <shiokaze/core/runnable.h>
+#include <shiokaze/array/array3.h>
+#include <shiokaze/array/shared_array3.h>
+#include <shiokaze/math/RCMatrix_interface.h>
+#include <shiokaze/math/RCMatrix_utility.h>
+#include <shiokaze/linsolver/RCMatrix_solver.h>
+#include <shiokaze/utility/macutility3_interface.h>
+#include <shiokaze/core/scoped_timer.h>
+#include <shiokaze/core/console.h>
+#include <algorithm>
+#include <sstream>
+#include <cstring>
+#include <cstdio>
+#include <random>
+#include <cmath>
+//
+SHKZ_USING_NAMESPACE
+//
+class linsolverbenchmark3 : public runnable {
+private:
+	//
+	LONG_NAME("Linear Solver Benchmark 3D")
+	ARGUMENT_NAME("LinSolverBenchmarkExample")
+	//
+	using solver_type = RCMatrix_solver_interface<size_t,double>;
+	//
+	template <class T> static std::vector<T> parse_list( std::string list ) {
+		std::vector<T> result;
+		std::stringstream stream(list);
+		std::string item;
+		while( std::getline(stream,item,',')) {
+			if( ! item.empty()) {
+				T value;
+				std::stringstream(item) >> value;
+				result.push_back(value);
+			}
+		}
+		return result;
+	}
+	//
+	virtual void load( configuration &config ) override {
+		//
+		config.get_string("Solvers",m_solver_names,"Comma separated list of linear solvers to benchmark");
+		for( const auto &name : parse_list<std::string>(m_solver_names)) {
+			//
+			// Each solver is selected by its own key so that the shared LinSolver key does not override it
+			m_solvers.push_back(solver_type::quick_load_module(config,"LinSolver_"+name+":"+name));
+		}
+	}
+	//
+	virtual void configure( configuration &config ) override {
+		//
+		config.get_unsigned("ResolutionX",m_shape[0],"Resolution towards X axis");
+		config.get_unsigned("ResolutionY",m_shape[1],"Resolution towards Y axis");
+		config.get_unsigned("ResolutionZ",m_shape[2],"Resolution towards Z axis");
+		//
+		double resolution_scale (1.0);
+		config.get_double("ResolutionScale",resolution_scale,"Resolution doubling scale");
+		//
+		config.get_string("Problems",m_problems,"Comma separated list of synthetic problems (poisson or ghostfluid)");
+		config.get_string("FillRatios",m_fill_ratios,"Comma separated list of liquid heights relative to the domain height");
+		config.get_double("SolidRadius",m_solid_radius,"Radius of the spherical obstacle relative to the domain height (0 for none)");
+		config.get_string("Replay",m_replay,"Comma separated list of systems written by DumpMatrix to replay");
+		config.get_unsigned("Repetitions",m_repetitions,"Number of repetitions for each solve");
+		config.get_string("OutputName",m_output_name,"Base name of the JSON and CSV result files");
+		//
+		m_shape *= resolution_scale;
+		m_dx = m_shape.dx();
+		//
+		set_environment("shape",&m_shape);
+		set_environment("dx",&m_dx);
+		//
+		for( auto &solver : m_solvers ) solver->recursive_configure(config);
+	}
+	//
+	struct linear_system {
+		std::string name;
+		RCMatrix_ptr<size_t,double> Lhs;
+		RCMatrix_vector_ptr<size_t,double> rhs;
+	};
+	//
+	struct benchmark_record {
+		std::string system;
+		std::string solver;
+		size_t rows;
+		size_t non_zeros;
+		double conversion_msec;
+		double setup_msec;
+		double solve_msec;
+		unsigned iterations;
+		double msec_per_iteration;
+		double reresid;
+		size_t memory;
+	};
+	//
+	// Resident memory read from /proc. The peak can be reset on Linux, and both read zero elsewhere.
+	static void reset_peak_memory() {
+		FILE *fp = std::fopen("/proc/self/clear_refs","w");
+		if( fp ) {
+			std::fputs("5",fp);
+			std::fclose(fp);
+		}
+	}
+	static size_t get_memory( const char *key ) {
+		size_t kilobytes (0);
+		FILE *fp = std::fopen("/proc/self/status","r");
+		if( fp ) {
+			char line[256];
+			const size_t length = std::strlen(key);
+			while( std::fgets(line,sizeof(line),fp)) {
+				if( ! std::strncmp(line,key,length)) kilobytes = std::strtoull(line+length,nullptr,10);
+			}
+			std::fclose(fp);
+		}
+		return 1024 * kilobytes;
+	}
+	//
+	// Pressure system of a liquid pool with a wavy surface around a spherical obstacle, assembled in the same way
+	// as macpressuresolver3. The poisson problem rounds the fractions to one, which leaves the constant coefficient
+	// Laplacian on the same cells, while ghostfluid keeps the variable coefficients of the free surface and the solid.
+	linear_system generate( std::string problem, double fill_ratio ) {
+		//
+		const double width (m_shape[0]*m_dx), height (m_shape[1]*m_dx), depth (m_shape[2]*m_dx);
+		const vec3d center (0.5*width,0.35*height,0.5*depth);
+		array3<Real> fluid(m_shape.cell(),1.0);
+		array3<Real> solid(m_shape.nodal(),1.0);
+		fluid.parallel_all([&]( int i, int j, int k, auto &it ) {
+			const vec3d p = m_dx*vec3i(i,j,k).cell();
+			it.set(p[1]-fill_ratio*height-0.05*height*std::sin(6.0*M_PI*p[0]/width)*std::sin(6.0*M_PI*p[2]/depth));
+		});
+		if( m_solid_radius ) {
+			solid.parallel_all([&]( int i, int j, int k, auto &it ) {
+				it.set((m_dx*vec3d(i,j,k)-center).len()-m_solid_radius*height);
+			});
+		}
+		//
+		shared_macarray3<Real> areas(m_shape);
+		shared_macarray3<Real> rhos(m_shape);
+		m_macutility->compute_area_fraction(solid,areas());
+		m_macutility->compute_fluid_fraction(fluid,rhos());
+		if( problem == "poisson" ) {
+			areas->parallel_actives([&]( auto &it ) { if( it() ) it.set(1.0); });
+			rhos->parallel_actives([&]( auto &it ) { if( it() ) it.set(1.0); });
+		} else if( problem != "ghostfluid" ) {
+			console::dump( "Unknown problem %s. Generating ghostfluid instead...\n", problem.c_str());
+		}
+		//
+		const vec3i direction_offset[] = {vec3i(1,0,0),vec3i(-1,0,0),vec3i(0,1,0),vec3i(0,-1,0),vec3i(0,0,1),vec3i(0,0,-1)};
+		const auto face_of = [&]( const vec3i &pi, int nq ) {
+			return nq % 2 ? pi : pi+direction_offset[nq];
+		};
+		const auto open = [&]( const vec3i &pi, int nq ) {
+			const vec3i qi = pi+direction_offset[nq];
+			return ! m_shape.out_of_bounds(qi) && areas()[nq/2](face_of(pi,nq)) && rhos()[nq/2](face_of(pi,nq));
+		};
+		//
+		size_t index (0);
+		array3<size_t> index_map(m_shape);
+		fluid.const_serial_all([&]( int i, int j, int k, const auto &it ) {
+			if( it() < 0.0 ) {
+				for( int nq=0; nq<6; ++nq ) {
+					if( open(vec3i(i,j,k),nq) && fluid(vec3i(i,j,k)+direction_offset[nq]) < 0.0 ) {
+						index_map.set(i,j,k,index++);
+						break;
+					}
+				}
+			}
+		});
+		//
+		linear_system system;
+		system.name = console::format_str("%s_%dx%dx%d_fill%.2f",problem.c_str(),m_shape[0],m_shape[1],m_shape[2],fill_ratio);
+		system.Lhs = m_factory->allocate_matrix(index,index);
+		system.rhs = m_factory->allocate_vector(index);
+		std::mt19937 generator(1);
+		std::uniform_real_distribution<double> uniform(-1.0,1.0);
+		std::vector<double> divergence(index);
+		for( auto &value : divergence ) value = uniform(generator);
+		index_map.const_parallel_actives([&]( int i, int j, int k, const auto &it ) {
+			const size_t n_index = it();
+			double diagonal (0.0);
+			for( int nq=0; nq<6; ++nq ) {
+				if( open(vec3i(i,j,k),nq)) {
+					const vec3i qi = vec3i(i,j,k)+direction_offset[nq];
+					const vec3i fi = face_of(vec3i(i,j,k),nq);
+					const double value = areas()[nq/2](fi)/(m_dx*m_dx*rhos()[nq/2](fi));
+					if( fluid(qi) < 0.0 ) system.Lhs->add_to_element(n_index,index_map(qi),-value);
+					diagonal += value;
+				}
+			}
+			system.Lhs->add_to_element(n_index,n_index,diagonal);
+			system.rhs->set(n_index,divergence[n_index]);
+		});
+		return system;
+	}
+	//
+	void benchmark( const linear_system &system ) {
+		//
+		size_t non_zeros (0);
+		for( size_t row=0; row<system.Lhs->rows(); ++row ) non_zeros += system.Lhs->non_zeros(row);
+		console::dump( ">>> system = %s, rows = %zu, non-zeros = %zu\n", system.name.c_str(), system.Lhs->rows(), non_zeros );
+		//
+		// The conversion, setup and iteration times are taken from the telemetry of the solvers, and the fastest repetition is kept
+		for( size_t n=0; n<m_solvers.size(); ++n ) {
+			benchmark_record record = { system.name, m_solvers[n]->get_argument_name(), system.Lhs->rows(), non_zeros, 0.0, 0.0, 0.0, 0, 0.0, 0.0, 0 };
+			for( unsigned repetition=0; repetition<m_repetitions; ++repetition ) {
+				reset_peak_memory();
+				const size_t base_memory = get_memory("VmRSS:");
+				auto x = m_factory->allocate_vector(system.rhs->size());
+				scoped_timer timer;
+				timer.tick();
+				const auto result = m_solvers[n]->solve(system.Lhs.get(),system.rhs.get(),x.get());
+				const double solve_msec = timer.tock();
+				const size_t peak_memory = get_memory("VmHWM:");
+				if( ! repetition || solve_msec < record.solve_msec ) {
+					record.conversion_msec = result.conversion_time;
+					record.setup_msec = result.setup_time;
+					record.solve_msec = solve_msec;
+					record.iterations = result.count;
+					record.msec_per_iteration = result.count ? result.iteration_time / result.count : 0.0;
+					record.reresid = result.reresid;
+				}
+				record.memory = std::max(record.memory,peak_memory > base_memory ? peak_memory-base_memory : 0);
+			}
+			console::dump( "   %-8s conversion = %8.3f msec, setup = %9.3f msec, solve = %10.3f msec, %5u iterations (%.4f msec each), reresid = %.2e, memory = %s\n",
+				record.solver.c_str(), record.conversion_msec, record.setup_msec, record.solve_msec, record.iterations, record.msec_per_iteration, record.reresid, console::size_str(record.memory).c_str());
+			m_records.push_back(record);
+		}
+		console::dump( "<<< Done\n" );
+	}
+	//
+	void write_results() const {
+		//
+		std::string base_path = m_output_name;
+		if( console::get_root_path().size()) {
+			base_path = console::get_root_path() + "/" + m_output_name;
+		}
+		//
+		FILE *json = std::fopen((base_path+".json").c_str(),"w");
+		FILE *csv = std::fopen((base_path+".csv").c_str(),"w");
+		if( ! json || ! csv ) {
+			console::dump( "Failed to open \"%s\" for writing results.\n", base_path.c_str());
+			if( json ) std::fclose(json);
+			if( csv ) std::fclose(csv);
+			return;
+		}
+		//
+		std::fprintf(json,"{\n");
+		std::fprintf(json,"  \"repetitions\": %u,\n", m_repetitions );
+		std::fprintf(json,"  \"results\": [\n");
+		std::fprintf(csv,"system,solver,rows,non_zeros,conversion_msec,setup_msec,solve_msec,iterations,msec_per_iteration,reresid,memory_bytes\n");
+		for( size_t n=0; n<m_records.size(); ++n ) {
+			const benchmark_record &r = m_records[n];
+			std::fprintf(json,"    {\"system\": \"%s\", \"solver\": \"%s\", \"rows\": %zu, \"non_zeros\": %zu, \"conversion_msec\": %.6f, \"setup_msec\": %.6f, \"solve_msec\": %.6f, \"iterations\": %u, \"msec_per_iteration\": %.6f, \"reresid\": %e, \"memory_bytes\": %zu}%s\n",
+				r.system.c_str(), r.solver.c_str(), r.rows, r.non_zeros, r.conversion_msec, r.setup_msec, r.solve_msec, r.iterations, r.msec_per_iteration, r.reresid, r.memory,
+				n+1 < m_records.size() ? "," : "" );
+			std::fprintf(csv,"%s,%s,%zu,%zu,%.6f,%.6f,%.6f,%u,%.6f,%e,%zu\n",
+				r.system.c_str(), r.solver.c_str(), r.rows, r.non_zeros, r.conversion_msec, r.setup_msec, r.solve_msec, r.iterations, r.msec_per_iteration, r.reresid, r.memory );
+		}
+		std::fprintf(json,"  ]\n}\n");
+		std::fclose(json);
+		std::fclose(csv);
+		console::dump( "Results written to \"%s.json\" and \"%s.csv\"\n", base_path.c_str(), base_path.c_str());
+	}
+	//
+	// Run after the children are initialized, since generating the systems needs macutility3
+	virtual void post_initialize() override {
+		//
+		m_records.clear();
+		for( const auto &problem : parse_list<std::string>(m_problems)) {
+			for( double fill_ratio : parse_list<double>(m_fill_ratios)) {
+				benchmark(generate(problem,fill_ratio));
+			}
+		}
+		for( const auto &path : parse_list<std::string>(m_replay)) {
+			linear_system system = { path, m_factory->allocate_matrix(), m_factory->allocate_vector() };
+			if( RCMatrix_utility<size_t,double>::read_system(path,system.Lhs.get(),system.rhs.get())) benchmark(system);
+			else console::dump( "Failed to read the system \"%s\"\n", path.c_str());
+		}
+		write_results();
+	}
+	//
+	shape3 m_shape {64,64,64};
+	double m_dx;
+	std::string m_solver_names {"cg,pcg,amg"};
+	std::string m_problems {"poisson,ghostfluid"};
+	std::string m_fill_ratios {"0.5"};
+	double m_solid_radius {0.15};
+	std::string m_replay;
+	std::string m_output_name {"linsolverbenchmark3"};
+	unsigned m_repetitions {3};
+	std::vector<std::unique_ptr<solver_type> > m_solvers;
+	std::vector<benchmark_record> m_records;
+	//
+	macutility3_driver m_macutility{this,"macutility3"};
+	RCMatrix_factory_driver<size_t,double> m_factory{this,"RCMatrix"};
+};
+//
+extern "C" module * create_instance() {
+	return new linsolverbenchmark3;
+}
+//
+extern "C" const char *license() {
+	return "MIT";
+}
@@ -0,0 +1,249 @@
+/*
+**	macarraybenchmark3-example.cpp
+**
+**	This is part of Shiokaze, a research-oriented fluid solver for computer graphics.
+**	Created by Ryoichi Ando <rand@nii.ac.jp> on July 13, 2019.
+**
+**	Permission is hereby granted, free of charge, to any person obtaining a copy of
+**	this software and associated documentation files (the "Software"), to deal in
+**	the Software without restriction, including without limitation the rights to use,
+**	copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+**	Software, and to permit persons to whom the Software is furnished to do so,
+**	subject to the following conditions:
+**
+**	The above copyright notice and this permission notice shall be included in all copies
+**	or substantial portions of the Software.
+**
+**	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+**	INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+**	PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+**	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+**	CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+**	OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+//
+#include <shiokaze/core/runnable.h>
+#include <shiokaze/array/array3.h>
+#include <shiokaze/array/macarray3.h>
+#include <shiokaze/math/RCMatrix_interface.h>
+#include <shiokaze/utility/macutility3_interface.h>
+#include <shiokaze/core/timer.h>
+#include <shiokaze/core/console.h>
+#include "../projection/pressure_projection3.h"
+#include <utility>
+#include <vector>
+#include <cmath>
+//
+SHKZ_USING_NAMESPACE
+//
+class macarraybenchmark3 : public runnable {
+private:
+	//
+	LONG_NAME("MAC Array Benchmark 3D")
+	ARGUMENT_NAME("MACArrayBenchmarkExample")
+	//
+	virtual void configure( configuration &config ) override {
+		//
+		config.get_unsigned("ResolutionX",m_shape[0],"Resolution towards X axis");
+		config.get_unsigned("ResolutionY",m_shape[1],"Resolution towards Y axis");
+		config.get_unsigned("ResolutionZ",m_shape[2],"Resolution towards Z axis");
+		config.get_unsigned("Iterations",m_iterations,"Number of repetitions for each kernel");
+		//
+		double resolution_scale (1.0);
+		config.get_double("ResolutionScale",resolution_scale,"Resolution doubling scale");
+		//
+		m_shape *= resolution_scale;
+		m_dx = m_shape.dx();
+		//
+		set_environment("shape",&m_shape);
+		set_environment("dx",&m_dx);
+	}
+	//
+	// Values and activity of every cell, in lexicographic order so that cores with different layouts compare directly
+	template <class T> using flat_array = std::vector<std::pair<bool,T> >;
+	template <class T> static flat_array<T> flatten( const array3<T> &array ) {
+		flat_array<T> result;
+		array.shape().for_each([&]( int i, int j, int k ) {
+			result.push_back({array.active(i,j,k),array(i,j,k)});
+		});
+		return result;
+	}
+	template <class T> static flat_array<T> flatten( const macarray3<T> &array ) {
+		flat_array<T> result;
+		for( int dim : DIMS3 ) {
+			const flat_array<T> face = flatten(array[dim]);
+			result.insert(result.end(),face.begin(),face.end());
+		}
+		return result;
+	}
+	//
+	// Outputs of the kernels that must not depend on the core
+	struct snapshot {
+		flat_array<Real> areas;
+		flat_array<Real> rhos;
+		std::vector<double> divergence;
+		flat_array<vec3r> full_velocity;
+		double max_u;
+		flat_array<Real> velocity;
+	};
+	//
+	template <class T> static size_t count_mismatches( const T &a, const T &b ) {
+		if( a.size() != b.size()) return std::max(a.size(),b.size());
+		size_t count (0);
+		for( size_t n=0; n<a.size(); ++n ) if( ! (a[n] == b[n])) ++ count;
+		return count;
+	}
+	//
+	// Time the kernels that read the three face components around a cell: the area and fluid fractions of macutility3,
+	// the divergence of the pressure projection, convert_to_full used by the full velocity cache, compute_max_u, and
+	// the velocity update of the pressure projection. Only the face arrays use the core under test.
+	snapshot benchmark( std::string core_name ) {
+		//
+		scoped_timer timer(this,core_name);
+		console::dump( ">>> Benchmarking core \"%s\"\n", core_name.c_str());
+		//
+		macarray3<Real> velocity(core_name);
+		macarray3<Real> areas(core_name);
+		macarray3<Real> rhos(core_name);
+		array3<Real> fluid;
+		array3<Real> solid;
+		array3<Real> pressure;
+		array3<vec3r> full_velocity;
+		array3<size_t> index_map;
+		//
+		timer.tick(); console::dump( "Performing initialization..." );
+		velocity.initialize(m_shape);
+		areas.initialize(m_shape);
+		rhos.initialize(m_shape);
+		fluid.initialize(m_shape.cell(),3.0*m_dx);
+		solid.initialize(m_shape.nodal(),3.0*m_dx);
+		pressure.initialize(m_shape);
+		full_velocity.initialize(m_shape);
+		index_map.initialize(m_shape);
+		//
+		// A liquid pool with a wavy surface around a spherical obstacle, and a velocity within a band of the liquid
+		const vec3d center (0.5,0.3,0.5);
+		const auto fluid_func = [&]( const vec3d &p ) {
+			return p[1]-0.5-0.05*std::sin(6.0*M_PI*p[0])*std::sin(6.0*M_PI*p[2]);
+		};
+		fluid.parallel_all([&]( int i, int j, int k, auto &it ) {
+			const double value = fluid_func(m_dx*vec3i(i,j,k).cell());
+			if( std::abs(value) < 3.0*m_dx ) it.set(value);
+		});
+		fluid.set_as_levelset(3.0*m_dx);
+		fluid.flood_fill();
+		solid.parallel_all([&]( int i, int j, int k, auto &it ) {
+			const double value = (m_dx*vec3d(i,j,k)-center).len()-0.15;
+			if( std::abs(value) < 3.0*m_dx ) it.set(value);
+		});
+		solid.set_as_levelset(3.0*m_dx);
+		solid.flood_fill();
+		velocity.parallel_all([&]( int dim, int i, int j, int k, auto &it ) {
+			const vec3d p = m_dx*vec3i(i,j,k).face(dim);
+			if( fluid_func(p) < 3.0*m_dx ) it.set(std::sin(10.0*p[(dim+1)%DIM3]));
+		});
+		console::dump( "Done. Took %s\n", timer.stock("initialization").c_str());
+		//
+		snapshot result;
+		timer.tick(); console::dump( "Performing compute_area_fraction..." );
+		for( unsigned n=0; n<m_iterations; ++n ) {
+			//
+			// Touch the solid so that the area fraction cache of macutility3 does not skip the computation.
+			// The timing includes storing the result into that cache, which is of the default core.
+			solid.set(0,0,0,solid(0,0,0));
+			m_macutility->compute_area_fraction(solid,areas);
+		}
+		console::dump( "Done. Took %s\n", timer.stock("compute_area_fraction").c_str());
+		result.areas = flatten(areas);
+		//
+		timer.tick(); console::dump( "Performing compute_fluid_fraction..." );
+		for( unsigned n=0; n<m_iterations; ++n ) {
+			m_macutility->compute_fluid_fraction(fluid,rhos);
+		}
+		console::dump( "Done. Took %s\n", timer.stock("compute_fluid_fraction").c_str());
+		result.rhos = flatten(rhos);
+		//
+		const size_t index = pressure_projection3::mark_cells(fluid,areas,rhos,index_map);
+		auto rhs = m_factory->allocate_vector(index);
+		timer.tick(); console::dump( "Performing divergence..." );
+		for( unsigned n=0; n<m_iterations; ++n ) {
+			pressure_projection3::assemble(m_timestep,m_dx,fluid,areas,rhos,velocity,index_map,rhs.get(),
+				[&]( size_t n, int i, int j, int k ) {},
+				[&]( size_t n, int nq, size_t m, double value ) {},
+				[&]( size_t n, double value ) {});
+		}
+		console::dump( "Done. Took %s\n", timer.stock("divergence").c_str());
+		rhs->convert_to(result.divergence);
+		//
+		timer.tick(); console::dump( "Performing convert_to_full..." );
+		for( unsigned n=0; n<m_iterations; ++n ) {
+			velocity.convert_to_full(full_velocity);
+		}
+		console::dump( "Done. Took %s\n", timer.stock("convert_to_full").c_str());
+		result.full_velocity = flatten(full_velocity);
+		//
+		timer.tick(); console::dump( "Performing compute_max_u..." );
+		for( unsigned n=0; n<m_iterations; ++n ) {
+			result.max_u = m_macutility->compute_max_u(velocity);
+		}
+		console::dump( "Done. Took %s\n", timer.stock("compute_max_u").c_str());
+		//
+		index_map.const_serial_actives([&]( int i, int j, int k, const auto &it ) {
+			pressure.set(i,j,k,std::cos(10.0*m_dx*i));
+		});
+		timer.tick(); console::dump( "Performing update_velocity..." );
+		for( unsigned n=0; n<m_iterations; ++n ) {
+			pressure_projection3::update_velocity(m_timestep,m_dx,pressure,fluid,areas,rhos,velocity);
+		}
+		console::dump( "Done. Took %s\n", timer.stock("update_velocity").c_str());
+		result.velocity = flatten(velocity);
+		//
+		timer.tick(); console::dump( "Performing face dilation..." );
+		velocity.dilate(2);
+		console::dump( "Done. Took %s\n", timer.stock("dilation").c_str());
+		//
+		timer.tick(); console::dump( "Performing face clear..." );
+		velocity.clear();
+		console::dump( "Done. Took %s\n", timer.stock("clear").c_str());
+		//
+		console::dump( "<<< Done\n" );
+		return result;
+	}
+	//
+	virtual void post_initialize() override {
+		//
+		const snapshot reference = benchmark("tiledarray3");
+		const snapshot result = benchmark("mactiledarray3");
+		//
+		// Both cores run the same arithmetic in the same order, so the outputs must be bitwise identical
+		const std::pair<const char *,size_t> mismatches[] = {
+			{"compute_area_fraction",count_mismatches(reference.areas,result.areas)},
+			{"compute_fluid_fraction",count_mismatches(reference.rhos,result.rhos)},
+			{"divergence",count_mismatches(reference.divergence,result.divergence)},
+			{"convert_to_full",count_mismatches(reference.full_velocity,result.full_velocity)},
+			{"compute_max_u",(size_t)(reference.max_u != result.max_u)},
+			{"update_velocity",count_mismatches(reference.velocity,result.velocity)}};
+		bool identical (true);
+		for( const auto &e : mismatches ) {
+			console::dump( "%s: %s\n", e.first, e.second ? console::format_str("%zu mismatches",e.second).c_str() : "identical" );
+			identical = identical && ! e.second;
+		}
+		console::dump( "mactiledarray3 %s tiledarray3\n", identical ? "matches" : "DOES NOT match" );
+	}
+	//
+	shape3 m_shape {128,128,128};
+	unsigned m_iterations {4};
+	double m_dx;
+	const double m_timestep {1e-2};
+	//
+	macutility3_driver m_macutility{this,"macutility3"};
+	RCMatrix_factory_driver<size_t,double> m_factory{this,"RCMatrix"};
+};
+//
+extern "C" module * create_instance() {
+	return new macarraybenchmark3;
+}
+//
+extern "C" const char *license() {
+	return "MIT";
+}
@@ -36,6 +36,11 @@
 #include <amgcl/solver/lgmres.hpp>
 #include <amgcl/solver/fgmres.hpp>
 #include <shiokaze/linsolver/RCMatrix_solver.h>
+#include <shiokaze/parallel/parallel_driver.h>
+#include <shiokaze/core/scoped_timer.h>
+#include <shiokaze/core/console.h>
+#include <memory>
+#include "preconditioner_cache.h"
 //
 SHKZ_USING_NAMESPACE
 //
@@ -58,11 +63,50 @@ protected:
 		config.get_unsigned("MaxIterations",m_param.max_iterations,"Maximal iteration count");
 		config.get_string("Solver",m_param.method,"Solver name");
 		config.get_bool("ForceGlobalResidual",m_param.force_global_residual,"Force using the global residual");
+		config.get_bool("ReuseHierarchy",m_param.reuse_hierarchy,"Keep the hierarchy across solves while the sparsity pattern is unchanged");
+		config.get_double("RebuildIterationRatio",m_param.rebuild_iteration_ratio,"Rebuild the hierarchy when the iteration count exceeds this ratio of the count right after the last rebuild");
+		config.get_double("MaxRowChangeRatio",m_param.max_change_ratio,"Rebuild the hierarchy when the ratio of added and removed rows exceeds this value");
 	}
 	virtual void register_vector_norm_kind( const std::vector<unsigned char> &kind ) override {
 		m_kind = &kind;
 	}
+	virtual void register_row_keys( const std::vector<N> &keys ) override {
+		m_keys.register_keys(keys);
+	}
+	//
+	// Applies a hierarchy built for an earlier set of unknowns. Residuals are gathered into the rows of
+	// the hierarchy, and rows that did not exist back then are preconditioned by their inverse diagonal.
+	// The correction of the hierarchy is scaled by the ratio of the old to the current diagonals, so that
+	// both parts stay balanced when the whole system is rescaled (e.g. by the time step).
+	struct remapped_preconditioner {
+		const AMG &amg;
+		const std::vector<N> &built_row;
+		std::vector<T> inv_diagonal;
+		T scale;
+		mutable std::vector<T> built_rhs, built_x;
+		//
+		template <class Vec1, class Vec2> void apply( const Vec1 &rhs, Vec2 &&x ) const {
+			const size_t rows = built_row.size();
+			std::fill(built_rhs.begin(),built_rhs.end(),0.0);
+			for( size_t i=0; i<rows; ++i ) {
+				if( built_row[i] != preconditioner_cache<N>::none ) built_rhs[built_row[i]] = rhs[i];
+			}
+			amg.apply(built_rhs,built_x);
+			for( size_t i=0; i<rows; ++i ) {
+				x[i] = built_row[i] != preconditioner_cache<N>::none ? scale * built_x[built_row[i]] : inv_diagonal[i] * rhs[i];
+			}
+		}
+	};
 	virtual typename RCMatrix_solver_interface<N,T>::Result solve( const RCMatrix_interface<N,T> *A, const RCMatrix_vector_interface<N,T> *b, RCMatrix_vector_interface<N,T> *x ) const override {
+		return solve_many(A,{b},{x}).front();
+	}
+	//
+	// The matrix is converted and the hierarchy set up once for all the right hand sides. The bundled amgcl
+	// Krylov solvers take a single vector, so each right hand side is then solved in turn.
+	virtual std::vector<typename RCMatrix_solver_interface<N,T>::Result> solve_many( const RCMatrix_interface<N,T> *A, const std::vector<const RCMatrix_vector_interface<N,T> *> &b, const std::vector<RCMatrix_vector_interface<N,T> *> &x ) const override {
+		//
+		scoped_timer timer(this);
+		timer.tick();
 		//
 		std::vector<N> rowstart;
 		std::vector<N> index;
@@ -71,27 +115,91 @@ protected:
 		size_t rows = A->rows();
 		rowstart.resize(rows+1);
 		rowstart[0] = 0;
+		m_parallel.for_each(rows,[&]( size_t i ) {
+			rowstart[i+1] = A->non_zeros(i);
+		});
 		for(N i=0; i<rows; i++ ) {
-			rowstart[i+1]=rowstart[i]+A->non_zeros(i);
+			rowstart[i+1] += rowstart[i];
 		}
 		value.resize(rowstart[rows]);
 		index.resize(rowstart[rows]);
-		N j (0);
-		for( N i=0; i<rows; i++) {
+		m_parallel.for_each(rows,[&]( size_t i ) {
+			N j (rowstart[i]);
 			A->const_for_each(i,[&]( N column, T v ) {
 				index[j] = column;
 				value[j] = v;
 				++ j;
 			});
+		});
+		const double conversion_time = timer.tock("conversion");
+		timer.tick();
+		//
+		// The bundled amgcl has no value-only rebuild, so while the sparsity pattern stays the same the previous
+		// hierarchy keeps serving as the preconditioner and the Krylov solver runs on the current matrix.
+		// When the caller registered row keys, the hierarchy is instead kept while the set of unknowns
+		// changes little, and applied through the map from the current rows to the rows it was built for.
+		const typename preconditioner_cache<N>::Parameters reuse = {m_param.reuse_hierarchy,m_param.rebuild_iteration_ratio,m_param.max_change_ratio};
+		typename preconditioner_cache<N>::Remap remap;
+		const bool keyed = m_keys.has_keys(rows);
+		bool rebuild;
+		if( keyed ) {
+			rebuild = ! m_cache.amg || ! m_keys.remap(rows,reuse,remap);
+		} else {
+			rebuild = ! m_param.reuse_hierarchy || ! m_cache.amg || m_cache.degraded ||
+					  m_cache.rowstart != rowstart || m_cache.index != index;
 		}
+		std::unique_ptr<typename AMG::matrix> current_matrix;
+		std::unique_ptr<remapped_preconditioner> remapped;
+		if( rebuild ) {
+			m_cache.amg = std::make_unique<AMG>(std::tie(rows,rowstart,index,value));
+			if( keyed ) {
+				m_keys.built(rows);
+				m_cache.rowstart.clear();
+				m_cache.index.clear();
+				m_cache.diagonal.assign(rows,0.0);
+				m_parallel.for_each(rows,[&]( size_t i ) {
+					for( N p=rowstart[i]; p<rowstart[i+1]; ++p ) if( index[p] == i ) m_cache.diagonal[i] = value[p];
+				});
+			} else if( m_param.reuse_hierarchy ) {
+				m_cache.rowstart.swap(rowstart);
+				m_cache.index.swap(index);
+			}
+			m_cache.rows = rows;
+			m_cache.degraded = false;
+		} else {
+			current_matrix = std::make_unique<typename AMG::matrix>(std::tie(rows,rowstart,index,value));
+			bool identity = keyed && rows == m_cache.rows;
+			for( size_t i=0; identity && i<rows; ++i ) identity = remap.built_row[i] == i;
+			if( keyed && ! identity ) {
+				std::vector<T> diagonal(rows,0.0), inv_diagonal(rows,0.0);
+				m_parallel.for_each(rows,[&]( size_t i ) {
+					for( N p=rowstart[i]; p<rowstart[i+1]; ++p ) if( index[p] == i ) diagonal[i] = value[p];
+					if( diagonal[i] ) inv_diagonal[i] = 1.0 / diagonal[i];
+				});
+				double built_sum (0.0), current_sum (0.0);
+				for( size_t i=0; i<rows; ++i ) {
+					if( remap.built_row[i] != preconditioner_cache<N>::none ) {
+						built_sum += m_cache.diagonal[remap.built_row[i]];
+						current_sum += diagonal[i];
+					}
+				}
+				const T scale = current_sum ? built_sum / current_sum : 1.0;
+				remapped = std::make_unique<remapped_preconditioner>(remapped_preconditioner{*m_cache.amg,remap.built_row,std::move(inv_diagonal),scale,std::vector<T>(m_cache.rows),std::vector<T>(m_cache.rows)});
+				console::write(this->get_argument_name()+"_reuse_added_rows",remap.added);
+				console::write(this->get_argument_name()+"_reuse_removed_rows",remap.removed);
+			}
+		}
+		const AMG &amg = *m_cache.amg;
+		const typename AMG::matrix &system = current_matrix ? *current_matrix : amg.system_matrix();
+		console::write(this->get_argument_name()+"_rebuild",rebuild);
+		const double setup_time = timer.tock("setup");
 		//
-		AMG amg(std::tie(rows,rowstart,index,value));
+		timer.tick();
 		std::vector<T> rhs;
-		std::vector<T> result(rows);
-		b->convert_to(rhs);
+		std::vector<T> result;
 		unsigned iteration_count (0);
 		double reresid;
-		std::vector<T> vector_reresid, vector_absresid;
+		std::vector<T> vector_reresid, vector_absresid, residual_history;
 		//
 		auto set_param = [&]( auto &param ) {
 			param.maxiter = m_param.max_iterations;
@@ -99,49 +207,79 @@ protected:
 			param.abstol = m_param.abs_residual;
 		};
 		//
-		if( m_param.method == "CG") {
-			typedef amgcl::solver::cg<amgcl::backend::builtin<T> > Solver;
-			typename Solver::params param; set_param(param);
-			Solver solve(rows,param);
-			std::tie(iteration_count,reresid) = solve(amg,rhs,result);
-		} else if( m_param.method == "BICGSTAB") {
-			typedef amgcl::solver::bicgstab<amgcl::backend::builtin<T> > Solver;
-			typename Solver::params param; set_param(param);
-			Solver solve(rows,param);
-			std::tie(iteration_count,reresid) = solve(amg,rhs,result);
-		} else if( m_param.method == "BICGSTABL") {
-			typedef amgcl::solver::bicgstabl<amgcl::backend::builtin<T> > Solver;
-			typename Solver::params param; set_param(param);
-			param.force_global_residual = m_param.force_global_residual;
-			Solver solve(rows,param);
-			if( m_kind ) solve.kind = m_kind;
-			std::tie(iteration_count,reresid) = solve(amg,rhs,result);
-			if( m_kind ) {
-				vector_reresid = solve.vector_reresid;
-				vector_absresid = solve.vector_absresid;
+		auto run = [&]( const auto &P ) {
+			if( m_param.method == "CG") {
+				typedef amgcl::solver::cg<amgcl::backend::builtin<T> > Solver;
+				typename Solver::params param; set_param(param);
+				Solver solve(rows,param);
+				std::tie(iteration_count,reresid) = solve(system,P,rhs,result);
+				residual_history.assign(solve.residual_history.begin(),solve.residual_history.end());
+			} else if( m_param.method == "BICGSTAB") {
+				typedef amgcl::solver::bicgstab<amgcl::backend::builtin<T> > Solver;
+				typename Solver::params param; set_param(param);
+				Solver solve(rows,param);
+				std::tie(iteration_count,reresid) = solve(system,P,rhs,result);
+			} else if( m_param.method == "BICGSTABL") {
+				typedef amgcl::solver::bicgstabl<amgcl::backend::builtin<T> > Solver;
+				typename Solver::params param; set_param(param);
+				param.force_global_residual = m_param.force_global_residual;
+				Solver solve(rows,param);
+				if( m_kind ) solve.kind = m_kind;
+				std::tie(iteration_count,reresid) = solve(system,P,rhs,result);
+				if( m_kind ) {
+					vector_reresid = solve.vector_reresid;
+					vector_absresid = solve.vector_absresid;
+				}
+			} else if( m_param.method == "GMRES") {
+				typedef amgcl::solver::gmres<amgcl::backend::builtin<T> > Solver;
+				typename Solver::params param; set_param(param);
+				Solver solve(rows,param);
+				std::tie(iteration_count,reresid) = solve(system,P,rhs,result);
+			} else if( m_param.method == "FGMRES") {
+				typedef amgcl::solver::fgmres<amgcl::backend::builtin<T> > Solver;
+				typename Solver::params param; set_param(param);
+				Solver solve(rows,param);
+				std::tie(iteration_count,reresid) = solve(system,P,rhs,result);
+			} else if( m_param.method == "LGMRES") {
+				typedef amgcl::solver::lgmres<amgcl::backend::builtin<T> > Solver;
+				typename Solver::params param; set_param(param);
+				Solver solve(rows,param);
+				std::tie(iteration_count,reresid) = solve(system,P,rhs,result);
+			} else {
+				printf( "Unknown solver %s\n", m_param.method.c_str());
+				exit(0);
 			}
-		} else if( m_param.method == "GMRES") {
-			typedef amgcl::solver::gmres<amgcl::backend::builtin<T> > Solver;
-			typename Solver::params param; set_param(param);
-			Solver solve(rows,param);
-			std::tie(iteration_count,reresid) = solve(amg,rhs,result);
-		} else if( m_param.method == "FGMRES") {
-			typedef amgcl::solver::fgmres<amgcl::backend::builtin<T> > Solver;
-			typename Solver::params param; set_param(param);
-			Solver solve(rows,param);
-			std::tie(iteration_count,reresid) = solve(amg,rhs,result);
-		} else if( m_param.method == "LGMRES") {
-			typedef amgcl::solver::lgmres<amgcl::backend::builtin<T> > Solver;
-			typename Solver::params param; set_param(param);
-			Solver solve(rows,param);
-			std::tie(iteration_count,reresid) = solve(amg,rhs,result);
-		} else {
-			printf( "Unknown solver %s\n", m_param.method.c_str());
-			exit(0);
+			//
+		};
+		std::vector<typename RCMatrix_solver_interface<N,T>::Result> results;
+		unsigned max_iteration_count (0);
+		for( size_t n=0; n<b.size(); ++n ) {
+			timer.tick();
+			b[n]->convert_to(rhs);
+			result.assign(rows,0.0);
+			residual_history.clear();
+			if( remapped ) run(*remapped);
+			else run(amg);
+			x[n]->convert_from(result);
+			results.push_back({(N)iteration_count,(T)reresid,vector_reresid,vector_absresid,residual_history});
+			results.back().conversion_time = conversion_time;
+			results.back().setup_time = setup_time;
+			results.back().iteration_time = timer.tock();
+			max_iteration_count = std::max(max_iteration_count,iteration_count);
 		}
+		timer.tock("solve");
 		//
-		x->convert_from(result);
-		return {(N)iteration_count,(T)reresid,vector_reresid,vector_absresid};
+		iteration_count = max_iteration_count;
+		if( keyed ) {
+			m_keys.finished(iteration_count,rebuild,reuse);
+			if( ! m_param.reuse_hierarchy ) m_cache.amg.reset();
+		} else if( m_param.reuse_hierarchy ) {
+			if( rebuild ) m_cache.baseline_iterations = iteration_count;
+			else if( iteration_count > m_param.rebuild_iteration_ratio*std::max(1U,m_cache.baseline_iterations)) m_cache.degraded = true;
+		} else {
+			m_cache.amg.reset();
+		}
+		return results;
 	}
 	//
 	struct Parameters {
@@ -150,8 +288,24 @@ protected:
 		unsigned max_iterations {300};
 		std::string method {"CG"};
 		bool force_global_residual;
+		bool reuse_hierarchy {false};
+		double rebuild_iteration_ratio {1.5};
+		double max_change_ratio {0.1};
 	};
 	Parameters m_param;
+	//
+	struct hierarchy_cache {
+		std::unique_ptr<AMG> amg;
+		std::vector<N> rowstart;
+		std::vector<N> index;
+		size_t rows {0};
+		std::vector<T> diagonal;
+		unsigned baseline_iterations {0};
+		bool degraded {false};
+	};
+	mutable hierarchy_cache m_cache;
+	mutable preconditioner_cache<N> m_keys;
+	parallel_driver m_parallel{this};
 	const std::vector<unsigned char> *m_kind {nullptr};
 };
 //
@@ -0,0 +1,89 @@
+/*
+**	block_loop.h
+**
+**	This is part of Shiokaze, a research-oriented fluid solver for computer graphics.
+**	Created by Ryoichi Ando <rand@nii.ac.jp> on Oct 18, 2026.
+**
+**	Permission is hereby granted, free of charge, to any person obtaining a copy of
+**	this software and associated documentation files (the "Software"), to deal in
+**	the Software without restriction, including without limitation the rights to use,
+**	copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+**	Software, and to permit persons to whom the Software is furnished to do so,
+**	subject to the following conditions:
+**
+**	The above copyright notice and this permission notice shall be included in all copies
+**	or substantial portions of the Software.
+**
+**	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+**	INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+**	PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+**	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+**	CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+**	OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+//
+#ifndef SHKZ_BLOCK_LOOP_H
+#define SHKZ_BLOCK_LOOP_H
+//
+#include <shiokaze/parallel/parallel_driver.h>
+#include <algorithm>
+#include <array>
+#include <vector>
+//
+SHKZ_BEGIN_NAMESPACE
+//
+// Parallel loops over contiguous blocks of vector entries. The per-element work is inlined
+// so that the dispatch of parallel_driver only happens once per block.
+class block_loop {
+public:
+	//
+	block_loop( const parallel_driver &parallel, size_t block_size=1024 ) : m_parallel(parallel), m_block_size(block_size) {}
+	//
+	template <class F> void for_each( size_t size, F func ) const {
+		m_parallel.for_each(num_blocks(size),[&]( size_t block ) {
+			const size_t end = std::min(size,(block+1)*m_block_size);
+			for( size_t i=block*m_block_size; i<end; ++i ) func(i);
+		});
+	}
+	//
+	// Reduce K values at once. func(i,acc) accumulates into acc. Entries whose bit is set in
+	// max_mask are combined by taking the maximum, others are summed.
+	template <unsigned K, class F> std::array<double,K> reduce( size_t size, F func, unsigned max_mask=0 ) const {
+		std::vector<std::array<double,K> > partial(num_blocks(size));
+		m_parallel.for_each(partial.size(),[&]( size_t block ) {
+			std::array<double,K> acc;
+			acc.fill(0.0);
+			const size_t end = std::min(size,(block+1)*m_block_size);
+			for( size_t i=block*m_block_size; i<end; ++i ) func(i,acc);
+			partial[block] = acc;
+		});
+		std::array<double,K> result;
+		result.fill(0.0);
+		for( const auto &acc : partial ) {
+			for( unsigned k=0; k<K; ++k ) {
+				result[k] = (max_mask >> k) & 1 ? std::max(result[k],acc[k]) : result[k]+acc[k];
+			}
+		}
+		return result;
+	}
+	//
+	template <class F> double sum( size_t size, F func ) const {
+		return reduce<1>(size,[&]( size_t i, std::array<double,1> &acc ) { acc[0] += func(i); })[0];
+	}
+	template <class F> double max( size_t size, F func ) const {
+		return reduce<1>(size,[&]( size_t i, std::array<double,1> &acc ) { acc[0] = std::max(acc[0],(double)func(i)); },1)[0];
+	}
+	//
+private:
+	//
+	size_t num_blocks( size_t size ) const {
+		return (size+m_block_size-1)/m_block_size;
+	}
+	const parallel_driver &m_parallel;
+	const size_t m_block_size;
+};
+//
+SHKZ_END_NAMESPACE
+//
+#endif
+//
@@ -23,6 +23,11 @@
 */
 //
 #include <shiokaze/linsolver/RCMatrix_solver.h>
+#include <shiokaze/parallel/parallel_driver.h>
+#include "mixed_cg.h"
+#include "block_loop.h"
+#include <shiokaze/core/scoped_timer.h>
+#include <array>
 #include <cmath>
 //
 SHKZ_USING_NAMESPACE
@@ -36,46 +41,286 @@ protected:
 	virtual void configure( configuration &config ) override {
 		config.get_double("Residual",m_param.residual,"Tolerable residual");
 		config.get_unsigned("MaxIterations",m_param.max_iterations,"Maximal iteration count");
+		config.get_bool("MixedPrecision",m_param.mixed_precision,"Use single precision matrix and vectors with double precision accumulation");
+		config.get_unsigned("MaxRefinements",m_param.max_refinements,"Maximal number of iterative refinements in the mixed precision mode");
+		config.get_double("InnerResidual",m_param.inner_residual,"Residual reduction of each inner solve between refinements");
+		config.get_string("Method",m_param.method,"CG variant (standard, fused or pipelined)");
 	}
 	virtual typename RCMatrix_solver_interface<N,T>::Result solve( const RCMatrix_interface<N,T> *A, const RCMatrix_vector_interface<N,T> *b, RCMatrix_vector_interface<N,T> *x ) const override {
+		//
+		if( m_param.mixed_precision ) {
+			return mixed_cg<N,T>(m_parallel).solve(A,b,x,{m_param.residual,m_param.max_iterations,m_param.max_refinements,m_param.inner_residual});
+		}
+		scoped_timer timer;
+		timer.tick();
+		const auto A_fixed = A->make_fixed();
+		const double conversion_time = timer.tock();
+		auto result = solve_operator(A_fixed.get(),nullptr,b,x);
+		result.conversion_time = conversion_time;
+		return result;
+	}
+	virtual std::vector<typename RCMatrix_solver_interface<N,T>::Result> solve_many( const RCMatrix_interface<N,T> *A, const std::vector<const RCMatrix_vector_interface<N,T> *> &b, const std::vector<RCMatrix_vector_interface<N,T> *> &x ) const override {
+		//
+		if( m_param.mixed_precision ) return RCMatrix_solver_interface<N,T>::solve_many(A,b,x);
+		scoped_timer timer;
+		timer.tick();
+		const auto A_fixed = A->make_fixed();
+		const double conversion_time = timer.tock();
+		timer.tick();
+		auto results = solve_lockstep(A_fixed.get(),b,x);
+		const double iteration_time = timer.tock();
+		for( auto &result : results ) {
+			result.conversion_time = conversion_time;
+			result.iteration_time = iteration_time;
+		}
+		return results;
+	}
+	virtual bool supports_operator() const override {
+		return true;
+	}
+	virtual typename RCMatrix_solver_interface<N,T>::Result solve_operator( const RCFixedMatrix_interface<N,T> *A, const RCFixedMatrix_interface<N,T> *M, const RCMatrix_vector_interface<N,T> *b, RCMatrix_vector_interface<N,T> *x ) const override {
+		//
+		scoped_timer timer;
+		timer.tick();
+		x->resize(b->size());
+		typename RCMatrix_solver_interface<N,T>::Result result;
+		if( b->data() && x->data() && m_param.method == "fused" ) result = solve_fused(A,M,b,x);
+		else if( b->data() && x->data() && m_param.method == "pipelined" ) result = solve_pipelined(A,M,b,x);
+		else result = solve_standard(A,M,b,x);
+		result.iteration_time = timer.tock();
+		return result;
+	}
+	//
+	typename RCMatrix_solver_interface<N,T>::Result solve_standard( const RCFixedMatrix_interface<N,T> *A, const RCFixedMatrix_interface<N,T> *M, const RCMatrix_vector_interface<N,T> *b, RCMatrix_vector_interface<N,T> *x ) const {
 		//
 		size_t n (b->size()), iterations_out(0);
 		T residual_0, residual_1, delta;
 		auto r = b->allocate_vector(n), z = b->allocate_vector(n), p = b->allocate_vector(n);
-		const auto A_fixed = A->make_fixed();
+		const auto precondition = [&]() { // z = M^-1 * r
+			if( M ) M->multiply(r.get(),z.get());
+			else z->copy(r.get());
+		};
 		//
 		r->copy(b);
 		residual_0 = r->abs_max();
-		z->copy(r.get()); p->copy(z.get()); delta = r->dot(z.get());
+		precondition(); p->copy(z.get()); delta = r->dot(z.get());
 		if(delta < std::numeric_limits<T>::epsilon()) return {N(),0.0};
 		//
 		N iteration (0);
 		T relative_residual_out;
+		std::vector<T> history;
 		for( ; iteration<m_param.max_iterations; ++iteration ) {
 			//
-			A_fixed->multiply(p.get(),z.get()); // z = A * p
+			A->multiply(p.get(),z.get()); // z = A * p
 			T alpha = delta / p->dot(z.get());
 			x->add_scaled(alpha,p.get()); // x += alpha * p;
 			r->add_scaled(-alpha,z.get()); // r -= alpha * z;
 			residual_1 = r->abs_max();
 			relative_residual_out = residual_1 / residual_0;
+			history.push_back(relative_residual_out);
 			if( relative_residual_out <= m_param.residual ) {
 				iterations_out = iteration+1;
 				break;
 			}
-			z->copy(r.get());
+			precondition(); // z = M^-1 * r
 			T beta = r->dot(z.get());
 			z->add_scaled(beta/delta,p.get()); p.swap(z); // p = z + ( beta / delta ) * p;
 			delta = beta;
 		}
-		return {(N)iteration,(T)relative_residual_out};
+		return {(N)iteration,(T)relative_residual_out,{},{},history};
+	}
+	//
+	// Standard CG on several right hand sides in lockstep. Each system keeps its own recurrence and
+	// drops out once converged, while the matrix is read once per iteration for all the remaining ones.
+	std::vector<typename RCMatrix_solver_interface<N,T>::Result> solve_lockstep( const RCFixedMatrix_interface<N,T> *A, const std::vector<const RCMatrix_vector_interface<N,T> *> &b, const std::vector<RCMatrix_vector_interface<N,T> *> &x ) const {
+		//
+		const size_t count (b.size());
+		std::vector<typename RCMatrix_solver_interface<N,T>::Result> results(count,{N(),T()});
+		std::vector<RCMatrix_vector_ptr<N,T> > r(count), z(count), p(count);
+		std::vector<T> residual_0(count), delta(count);
+		std::vector<size_t> active;
+		for( size_t n=0; n<count; ++n ) {
+			const size_t size (b[n]->size());
+			x[n]->resize(size);
+			r[n] = b[n]->allocate_vector(size); z[n] = b[n]->allocate_vector(size); p[n] = b[n]->allocate_vector(size);
+			r[n]->copy(b[n]);
+			residual_0[n] = r[n]->abs_max();
+			p[n]->copy(r[n].get());
+			delta[n] = r[n]->dot(r[n].get());
+			if( delta[n] >= std::numeric_limits<T>::epsilon()) {
+				results[n].count = m_param.max_iterations;
+				active.push_back(n);
+			}
+		}
+		//
+		std::vector<const RCMatrix_vector_interface<N,T> *> ps;
+		std::vector<RCMatrix_vector_interface<N,T> *> zs;
+		for( N iteration=0; iteration<m_param.max_iterations && ! active.empty(); ++iteration ) {
+			//
+			ps.clear(); zs.clear();
+			for( const size_t &n : active ) {
+				ps.push_back(p[n].get());
+				zs.push_back(z[n].get());
+			}
+			A->multiply_many(ps,zs); // z = A * p
+			//
+			std::vector<size_t> remaining;
+			for( const size_t &n : active ) {
+				T alpha = delta[n] / p[n]->dot(z[n].get());
+				x[n]->add_scaled(alpha,p[n].get()); // x += alpha * p;
+				r[n]->add_scaled(-alpha,z[n].get()); // r -= alpha * z;
+				results[n].reresid = r[n]->abs_max() / residual_0[n];
+				results[n].residual_history.push_back(results[n].reresid);
+				if( results[n].reresid <= m_param.residual ) {
+					results[n].count = iteration;
+					continue;
+				}
+				T beta = r[n]->dot(r[n].get());
+				z[n]->copy(r[n].get()); z[n]->add_scaled(beta/delta[n],p[n].get()); p[n].swap(z[n]); // p = r + ( beta / delta ) * p;
+				delta[n] = beta;
+				remaining.push_back(n);
+			}
+			active.swap(remaining);
+		}
+		return results;
+	}
+	//
+	// CG with the vector updates and reductions merged into as few passes as possible.
+	// Without a preconditioner an iteration takes four passes: SpMV, p.q, the fused
+	// update of x and r with |r| and r.r, and the update of p.
+	typename RCMatrix_solver_interface<N,T>::Result solve_fused( const RCFixedMatrix_interface<N,T> *A, const RCFixedMatrix_interface<N,T> *M, const RCMatrix_vector_interface<N,T> *b, RCMatrix_vector_interface<N,T> *x ) const {
+		//
+		const size_t n (b->size());
+		auto r = b->allocate_vector(n), p = b->allocate_vector(n), q = b->allocate_vector(n);
+		auto z = M ? b->allocate_vector(n) : r;
+		T *x_ptr (x->data()), *r_ptr (r->data()), *p_ptr (p->data()), *q_ptr (q->data()), *z_ptr (z->data());
+		const T *b_ptr (b->data());
+		//
+		std::array<double,2> norms = m_loop.template reduce<2>(n,[&]( size_t i, std::array<double,2> &acc ) {
+			r_ptr[i] = b_ptr[i];
+			acc[0] = std::max(acc[0],(double)std::abs(r_ptr[i]));
+			acc[1] += r_ptr[i] * r_ptr[i];
+		},1);
+		const T residual_0 = norms[0];
+		T delta = norms[1];
+		if( M ) {
+			M->multiply(r.get(),z.get());
+			delta = m_loop.sum(n,[&]( size_t i ) { return r_ptr[i] * z_ptr[i]; });
+		}
+		m_loop.for_each(n,[&]( size_t i ) { p_ptr[i] = z_ptr[i]; });
+		if(delta < std::numeric_limits<T>::epsilon()) return {N(),0.0};
+		//
+		N iteration (0);
+		T relative_residual_out (1.0);
+		std::vector<T> history;
+		for( ; iteration<m_param.max_iterations; ++iteration ) {
+			//
+			A->multiply(p.get(),q.get()); // q = A * p
+			const T alpha = delta / m_loop.sum(n,[&]( size_t i ) { return p_ptr[i] * q_ptr[i]; });
+			norms = m_loop.template reduce<2>(n,[&]( size_t i, std::array<double,2> &acc ) {
+				x_ptr[i] += alpha * p_ptr[i];
+				r_ptr[i] -= alpha * q_ptr[i];
+				acc[0] = std::max(acc[0],(double)std::abs(r_ptr[i]));
+				acc[1] += r_ptr[i] * r_ptr[i];
+			},1);
+			relative_residual_out = norms[0] / residual_0;
+			history.push_back(relative_residual_out);
+			if( relative_residual_out <= m_param.residual ) break;
+			T beta = norms[1];
+			if( M ) {
+				M->multiply(r.get(),z.get()); // z = M^-1 * r
+				beta = m_loop.sum(n,[&]( size_t i ) { return r_ptr[i] * z_ptr[i]; });
+			}
+			const T ratio = beta / delta;
+			m_loop.for_each(n,[&]( size_t i ) { p_ptr[i] = z_ptr[i] + ratio * p_ptr[i]; });
+			delta = beta;
+		}
+		return {(N)iteration,(T)relative_residual_out,{},{},history};
+	}
+	//
+	// Pipelined CG of Ghysels and Vanroose. The two inner products of an iteration are
+	// independent of its SpMV, so all the vector recurrences and the reductions for the
+	// next iteration are done in a single pass after the SpMV.
+	typename RCMatrix_solver_interface<N,T>::Result solve_pipelined( const RCFixedMatrix_interface<N,T> *A, const RCFixedMatrix_interface<N,T> *M, const RCMatrix_vector_interface<N,T> *b, RCMatrix_vector_interface<N,T> *x ) const {
+		//
+		const size_t n (b->size());
+		auto r = b->allocate_vector(n), w = b->allocate_vector(n), nv = b->allocate_vector(n);
+		auto z = b->allocate_vector(n), s = b->allocate_vector(n), p = b->allocate_vector(n);
+		auto u = M ? b->allocate_vector(n) : r; // u = M^-1 * r
+		auto m = M ? b->allocate_vector(n) : w; // m = M^-1 * w
+		auto q = M ? b->allocate_vector(n) : s; // q = M^-1 * s
+		T *x_ptr (x->data()), *r_ptr (r->data()), *w_ptr (w->data()), *n_ptr (nv->data()), *z_ptr (z->data());
+		T *s_ptr (s->data()), *p_ptr (p->data()), *u_ptr (u->data()), *m_ptr (m->data()), *q_ptr (q->data());
+		const T *b_ptr (b->data());
+		//
+		m_loop.for_each(n,[&]( size_t i ) {
+			r_ptr[i] = b_ptr[i];
+			z_ptr[i] = s_ptr[i] = p_ptr[i] = 0.0;
+			if( M ) q_ptr[i] = 0.0;
+		});
+		if( M ) M->multiply(r.get(),u.get());
+		A->multiply(u.get(),w.get());
+		std::array<double,3> reductions = m_loop.template reduce<3>(n,[&]( size_t i, std::array<double,3> &acc ) {
+			acc[0] += r_ptr[i] * u_ptr[i];
+			acc[1] += w_ptr[i] * u_ptr[i];
+			acc[2] = std::max(acc[2],(double)std::abs(r_ptr[i]));
+		},4);
+		T gamma (reductions[0]), delta (reductions[1]);
+		const T residual_0 = reductions[2];
+		if(gamma < std::numeric_limits<T>::epsilon()) return {N(),0.0};
+		//
+		N iteration (0);
+		T relative_residual_out (1.0), gamma_prev (0.0), alpha_prev (0.0);
+		std::vector<T> history;
+		for( ; iteration<m_param.max_iterations; ++iteration ) {
+			//
+			if( M ) M->multiply(w.get(),m.get());
+			A->multiply(m.get(),nv.get()); // n = A * m
+			T alpha, beta;
+			if( iteration ) {
+				beta = gamma / gamma_prev;
+				alpha = gamma / (delta - beta * gamma / alpha_prev);
+			} else {
+				beta = 0.0;
+				alpha = gamma / delta;
+			}
+			reductions = m_loop.template reduce<3>(n,[&]( size_t i, std::array<double,3> &acc ) {
+				z_ptr[i] = n_ptr[i] + beta * z_ptr[i];
+				s_ptr[i] = w_ptr[i] + beta * s_ptr[i];
+				p_ptr[i] = u_ptr[i] + beta * p_ptr[i];
+				x_ptr[i] += alpha * p_ptr[i];
+				r_ptr[i] -= alpha * s_ptr[i];
+				w_ptr[i] -= alpha * z_ptr[i];
+				if( M ) {
+					q_ptr[i] = m_ptr[i] + beta * q_ptr[i];
+					u_ptr[i] -= alpha * q_ptr[i];
+				}
+				acc[0] += r_ptr[i] * u_ptr[i];
+				acc[1] += w_ptr[i] * u_ptr[i];
+				acc[2] = std::max(acc[2],(double)std::abs(r_ptr[i]));
+			},4);
+			relative_residual_out = reductions[2] / residual_0;
+			history.push_back(relative_residual_out);
+			if( relative_residual_out <= m_param.residual ) break;
+			gamma_prev = gamma;
+			alpha_prev = alpha;
+			gamma = reductions[0];
+			delta = reductions[1];
+		}
+		return {(N)iteration,(T)relative_residual_out,{},{},history};
 	}
 	//
 	struct Parameters {
 		double residual {1e-4};
 		unsigned max_iterations {30000};
+		bool mixed_precision {false};
+		unsigned max_refinements {0};
+		double inner_residual {1e-2};
+		std::string method {"standard"};
 	};
 	Parameters m_param;
+	parallel_driver m_parallel{this};
+	const block_loop m_loop {m_parallel};
 };
 //
 extern "C" module * create_instance() {
@@ -0,0 +1,194 @@
+/*
+**	mixed_cg.h
+**
+**	This is part of Shiokaze, a research-oriented fluid solver for computer graphics.
+**	Created by Ryoichi Ando <rand@nii.ac.jp> on Oct 18, 2026.
+**
+**	Permission is hereby granted, free of charge, to any person obtaining a copy of
+**	this software and associated documentation files (the "Software"), to deal in
+**	the Software without restriction, including without limitation the rights to use,
+**	copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+**	Software, and to permit persons to whom the Software is furnished to do so,
+**	subject to the following conditions:
+**
+**	The above copyright notice and this permission notice shall be included in all copies
+**	or substantial portions of the Software.
+**
+**	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+**	INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+**	PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+**	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+**	CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+**	OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+//
+#ifndef SHKZ_MIXED_CG_H
+#define SHKZ_MIXED_CG_H
+//
+#include <shiokaze/linsolver/RCMatrix_solver.h>
+#include <shiokaze/parallel/parallel_driver.h>
+#include <shiokaze/core/scoped_timer.h>
+#include "block_loop.h"
+#include <functional>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+//
+SHKZ_BEGIN_NAMESPACE
+//
+// Mixed-precision conjugate gradient. The matrix values and the Krylov vectors are stored in
+// single precision to halve the memory traffic of SpMV and preconditioning, while dot products,
+// residual norms and the solution itself are accumulated in double. With refinements enabled, an
+// outer loop recomputes the residual with the double precision matrix and solves for the
+// correction again, which recovers the full accuracy of the double precision solve.
+template <class N, class T> class mixed_cg {
+public:
+	//
+	using Result = typename RCMatrix_solver_interface<N,T>::Result;
+	using preconditioner = std::function<void( const std::vector<float> &r, std::vector<float> &z )>;
+	//
+	struct Parameters {
+		double residual {1e-4};
+		unsigned max_iterations {30000};
+		unsigned max_refinements {0};
+		double inner_residual {1e-2};
+	};
+	//
+	mixed_cg( const parallel_driver &parallel ) : m_parallel(parallel) {}
+	//
+	Result solve( const RCMatrix_interface<N,T> *A, const RCMatrix_vector_interface<N,T> *b, RCMatrix_vector_interface<N,T> *x, const Parameters &param, preconditioner M=nullptr ) const {
+		//
+		// Conversion to the single precision matrix, and to the double precision one for refinements
+		const N n = b->size();
+		scoped_timer timer;
+		timer.tick();
+		build_matrix(A);
+		RCFixedMatrix_ptr<N,T> A_fixed;
+		if( param.max_refinements ) A_fixed = A->make_fixed();
+		const double conversion_time = timer.tock();
+		//
+		std::vector<double> b_d, x_d(n,0.0), r_d;
+		b->convert_to(b_d);
+		r_d = b_d;
+		const double residual_0 = abs_max(r_d);
+		x->resize(n);
+		x->clear();
+		if( ! residual_0 ) {
+			Result result = {N(),0.0};
+			result.conversion_time = conversion_time;
+			return result;
+		}
+		//
+		timer.tick();
+		std::vector<float> r(n), z(n), p(n), q(n);
+		RCMatrix_vector_ptr<N,T> x_vec, Ax_vec;
+		if( param.max_refinements ) {
+			x_vec = b->allocate_vector(n);
+			Ax_vec = b->allocate_vector(n);
+		}
+		//
+		N total_iterations (0);
+		double relative_residual (1.0);
+		std::vector<T> history;
+		for( unsigned refinement=0; ; ++refinement ) {
+			//
+			// Inner solve for the correction in single precision
+			const double target = param.max_refinements ? param.inner_residual * abs_max(r_d) : param.residual * residual_0;
+			m_loop.for_each(n,[&]( size_t i ) { r[i] = r_d[i]; });
+			const auto precondition = [&]() {
+				if( M ) M(r,z);
+				else m_loop.for_each(n,[&]( size_t i ) { z[i] = r[i]; });
+			};
+			precondition();
+			m_loop.for_each(n,[&]( size_t i ) { p[i] = z[i]; });
+			double delta = dot(r,z);
+			double residual = abs_max(r_d);
+			while( delta && total_iterations < param.max_iterations ) {
+				multiply(p,q);
+				const double alpha = delta / dot(p,q);
+				residual = update(alpha,p,q,x_d,r);
+				++ total_iterations;
+				history.push_back(residual / residual_0);
+				if( residual <= target ) break;
+				precondition();
+				const double beta = dot(r,z);
+				const float ratio = beta / delta;
+				m_loop.for_each(n,[&]( size_t i ) { p[i] = z[i] + ratio * p[i]; });
+				delta = beta;
+			}
+			relative_residual = residual / residual_0;
+			//
+			if( ! param.max_refinements ) break;
+			//
+			// Recompute the true residual in double precision
+			x_vec->convert_from(x_d);
+			A_fixed->multiply(x_vec.get(),Ax_vec.get());
+			Ax_vec->convert_to(r_d);
+			m_loop.for_each(n,[&]( size_t i ) { r_d[i] = b_d[i] - r_d[i]; });
+			relative_residual = abs_max(r_d) / residual_0;
+			if( relative_residual <= param.residual || refinement+1 >= param.max_refinements || total_iterations >= param.max_iterations ) break;
+		}
+		x->convert_from(x_d);
+		Result result = {total_iterations,(T)relative_residual,{},{},history};
+		result.conversion_time = conversion_time;
+		result.iteration_time = timer.tock();
+		return result;
+	}
+	//
+private:
+	//
+	void build_matrix( const RCMatrix_interface<N,T> *A ) const {
+		//
+		const N rows = A->rows();
+		m_rowstart.resize(rows+1);
+		m_rowstart[0] = 0;
+		m_parallel.for_each(rows,[&]( size_t row ) {
+			m_rowstart[row+1] = A->non_zeros(row);
+		});
+		for( N row=0; row<rows; ++row ) m_rowstart[row+1] += m_rowstart[row];
+		m_index.resize(m_rowstart[rows]);
+		m_value.resize(m_rowstart[rows]);
+		m_parallel.for_each(rows,[&]( size_t row ) {
+			N p = m_rowstart[row];
+			A->const_for_each(row,[&]( N column, T value ) {
+				m_index[p] = column;
+				m_value[p] = value;
+				++ p;
+			});
+		});
+	}
+	//
+	void multiply( const std::vector<float> &p, std::vector<float> &q ) const {
+		m_loop.for_each(q.size(),[&]( size_t row ) {
+			double sum (0.0);
+			for( N k=m_rowstart[row]; k<m_rowstart[row+1]; ++k ) sum += m_value[k] * p[m_index[k]];
+			q[row] = sum;
+		});
+	}
+	//
+	double dot( const std::vector<float> &a, const std::vector<float> &b ) const {
+		return m_loop.sum(a.size(),[&]( size_t i ) { return (double)a[i] * (double)b[i]; });
+	}
+	double abs_max( const std::vector<double> &a ) const {
+		return m_loop.max(a.size(),[&]( size_t i ) { return std::abs(a[i]); });
+	}
+	// x += alpha * p, r -= alpha * q, and return the uniform norm of the updated r
+	double update( double alpha, const std::vector<float> &p, const std::vector<float> &q, std::vector<double> &x, std::vector<float> &r ) const {
+		return m_loop.max(r.size(),[&]( size_t i ) {
+			x[i] += alpha * p[i];
+			r[i] -= alpha * q[i];
+			return std::abs(r[i]);
+		});
+	}
+	//
+	const parallel_driver &m_parallel;
+	const block_loop m_loop {m_parallel};
+	mutable std::vector<N> m_rowstart;
+	mutable std::vector<N> m_index;
+	mutable std::vector<float> m_value;
+};
+//
+SHKZ_END_NAMESPACE
+//
+#endif
+//
@@ -23,9 +23,15 @@
 */
 //
 #include <shiokaze/linsolver/RCMatrix_solver.h>
+#include <shiokaze/parallel/parallel_driver.h>
+#include <shiokaze/core/console.h>
+#include <shiokaze/core/scoped_timer.h>
 #include <cstdint>
 #include <cmath>
+#include <algorithm>
 #include <pcgsolver/pcg_solver.h>
+#include "mixed_cg.h"
+#include "preconditioner_cache.h"
 //
 SHKZ_USING_NAMESPACE
 //
@@ -41,14 +47,34 @@ protected:
 		config.get_double("ModifiedIC",m_param.modified_incomplete_cholesky_parameter,"Modified incomplete cholesky");
 		config.get_double("MinDiagRatio",m_param.min_diagonal_ratio,"Minimal diagonal ratio");
 		config.get_unsigned("MaxIterations",m_param.max_iterations,"Maximal iteration count");
+		config.get_string("Preconditioner",m_param.preconditioner,"Preconditioner (bridson, mic or mic_levels)");
+		config.get_unsigned("MinLevelSize",m_param.min_level_size,"Minimal number of rows in a level to run in parallel");
+		config.get_bool("MixedPrecision",m_param.mixed_precision,"Use single precision matrix, vectors and factor with double precision accumulation");
+		config.get_unsigned("MaxRefinements",m_param.max_refinements,"Maximal number of iterative refinements in the mixed precision mode");
+		config.get_double("InnerResidual",m_param.inner_residual,"Residual reduction of each inner solve between refinements");
+		config.get_bool("ReusePreconditioner",m_param.reuse.enabled,"Reuse the MIC factor across solves while the set of unknowns changes little");
+		config.get_double("RefreshIterationRatio",m_param.reuse.refresh_iteration_ratio,"Refactor when the iteration count exceeds this ratio of the count right after the last fresh factorization");
+		config.get_double("MaxRowChangeRatio",m_param.reuse.max_change_ratio,"Refactor when the ratio of added and removed rows exceeds this value");
+	}
+	virtual void register_row_keys( const std::vector<N> &keys ) override {
+		m_cache.register_keys(keys);
 	}
 	virtual typename RCMatrix_solver_interface<N,T>::Result solve( const RCMatrix_interface<N,T> *A, const RCMatrix_vector_interface<N,T> *b, RCMatrix_vector_interface<N,T> *x ) const override {
 		//
+		scoped_timer timer;
+		timer.tick();
 		SparseMatrix<T> matrix(A->rows());
-		for( N row=0; row<matrix.n; ++row ) {
+		m_parallel.for_each(matrix.n,[&]( size_t row ) {
 			A->const_for_each(row,[&]( N column, T value ) {
 				matrix.add_to_element(row,column,value);
 			});
+		});
+		const double conversion_time = timer.tock();
+		//
+		if( m_param.mixed_precision || m_param.preconditioner != "bridson" ) {
+			auto result = m_param.mixed_precision ? solve_mixed(A,matrix,b,x) : solve_mic(A,matrix,b,x);
+			result.conversion_time += conversion_time;
+			return result;
 		}
 		//
 		std::vector<T> rhs;
@@ -66,10 +92,273 @@ protected:
 			m_param.min_diagonal_ratio
 		);
 		//
+		timer.tick();
 		solver.solve(matrix,rhs,result,residual_out,iterations_out);
+		const double solve_time = timer.tock();
 		x->convert_from(result);
 		//
-		return {(N)iterations_out,(T)residual_out};
+		typename RCMatrix_solver_interface<N,T>::Result status = {(N)iterations_out,(T)residual_out,{},{},solver.residual_history};
+		status.conversion_time = conversion_time;
+		status.setup_time = solver.setup_time;
+		status.iteration_time = solve_time-solver.setup_time;
+		return status;
+	}
+	//
+	// Rows of a triangular solve grouped into levels whose rows only depend on earlier levels
+	struct level_schedule {
+		std::vector<unsigned> start;
+		std::vector<unsigned> rows;
+	};
+	//
+	// Strictly lower part of the factor stored row by row for the gathering forward solve
+	template <class F> struct lower_rows {
+		std::vector<unsigned> rowstart;
+		std::vector<unsigned> column;
+		std::vector<F> value;
+	};
+	//
+	// MIC(0) factor in the working precision F with its optional level schedule
+	template <class F> struct mic_preconditioner {
+		SparseColumnLowerFactor<F> factor;
+		bool use_levels {false};
+		level_schedule forward, backward;
+		lower_rows<F> lower;
+	};
+	//
+	static void group_levels( const std::vector<unsigned> &level, level_schedule &schedule ) {
+		//
+		unsigned num_levels (0);
+		for( const auto &l : level ) num_levels = std::max(num_levels,l+1);
+		schedule.start.assign(num_levels+1,0);
+		for( const auto &l : level ) schedule.start[l+1] ++;
+		for( unsigned l=0; l<num_levels; ++l ) schedule.start[l+1] += schedule.start[l];
+		schedule.rows.resize(level.size());
+		std::vector<unsigned> head(schedule.start.begin(),schedule.start.end()-1);
+		for( unsigned i=0; i<level.size(); ++i ) schedule.rows[head[level[i]]++] = i;
+	}
+	//
+	template <class F> void build_schedule( mic_preconditioner<F> &mic ) const {
+		//
+		const auto &factor = mic.factor;
+		const unsigned n = factor.n;
+		std::vector<unsigned> level(n,0);
+		for( unsigned i=0; i<n; ++i ) {
+			for( unsigned p=factor.colstart[i]; p<factor.colstart[i+1]; ++p ) {
+				unsigned &l = level[factor.rowindex[p]];
+				l = std::max(l,level[i]+1);
+			}
+		}
+		group_levels(level,mic.forward);
+		//
+		level.assign(n,0);
+		for( unsigned i=n; i-- > 0; ) {
+			for( unsigned p=factor.colstart[i]; p<factor.colstart[i+1]; ++p ) {
+				level[i] = std::max(level[i],level[factor.rowindex[p]]+1);
+			}
+		}
+		group_levels(level,mic.backward);
+		//
+		auto &lower = mic.lower;
+		lower.rowstart.assign(n+1,0);
+		for( const auto &r : factor.rowindex ) lower.rowstart[r+1] ++;
+		for( unsigned i=0; i<n; ++i ) lower.rowstart[i+1] += lower.rowstart[i];
+		lower.column.resize(factor.rowindex.size());
+		lower.value.resize(factor.rowindex.size());
+		std::vector<unsigned> head(lower.rowstart.begin(),lower.rowstart.end()-1);
+		for( unsigned i=0; i<n; ++i ) {
+			for( unsigned p=factor.colstart[i]; p<factor.colstart[i+1]; ++p ) {
+				const unsigned q = head[factor.rowindex[p]]++;
+				lower.column[q] = i;
+				lower.value[q] = factor.value[p];
+			}
+		}
+	}
+	//
+	template <class F> void build_mic( const SparseMatrix<T> &matrix, mic_preconditioner<F> &mic ) const {
+		//
+		SparseColumnLowerFactor<T> factor;
+		factor_modified_incomplete_cholesky0(matrix,factor,
+			(T)m_param.modified_incomplete_cholesky_parameter,
+			(T)m_param.min_diagonal_ratio);
+		//
+		mic.factor.resize(factor.n);
+		mic.factor.invdiag.assign(factor.invdiag.begin(),factor.invdiag.end());
+		mic.factor.value.assign(factor.value.begin(),factor.value.end());
+		mic.factor.rowindex = factor.rowindex;
+		mic.factor.colstart = factor.colstart;
+		mic.use_levels = m_param.preconditioner == "mic_levels";
+		if( mic.use_levels ) build_schedule(mic);
+	}
+	//
+	// Rebuild the factor on the current sparsity with the pivots of the cached factor. Pivots are kept
+	// relative to the diagonal of the matrix, so that a uniform scaling of the system (e.g. by the time
+	// step) carries over. Rows that did not exist when the factor was built fall back to the Gauss-Seidel pivot.
+	template <class F> void reuse_mic( const SparseMatrix<T> &matrix, const typename preconditioner_cache<N>::Remap &remap, mic_preconditioner<F> &mic ) const {
+		//
+		const unsigned n = matrix.n;
+		auto &factor = mic.factor;
+		factor.resize(n);
+		factor.rowindex.clear();
+		factor.value.clear();
+		m_parallel.for_each(n,[&]( size_t i ) {
+			const T diagonal = get_diagonal(matrix,i);
+			const N built = remap.built_row[i];
+			if( diagonal <= 0.0 ) factor.invdiag[i] = 0.0;
+			else if( built != preconditioner_cache<N>::none && m_cached_pivot[built] ) factor.invdiag[i] = m_cached_pivot[built] / std::sqrt(diagonal);
+			else factor.invdiag[i] = 1.0 / std::sqrt(diagonal);
+		});
+		for( unsigned i=0; i<n; ++i ) {
+			factor.colstart[i] = factor.rowindex.size();
+			for( unsigned j=0; j<matrix.index[i].size(); ++j ) {
+				if( matrix.index[i][j] > i ) {
+					factor.rowindex.push_back(matrix.index[i][j]);
+					factor.value.push_back(matrix.value[i][j]*factor.invdiag[i]);
+				}
+			}
+		}
+		factor.colstart[n] = factor.rowindex.size();
+		mic.use_levels = m_param.preconditioner == "mic_levels";
+		if( mic.use_levels ) build_schedule(mic);
+	}
+	//
+	// Build or reuse the factor. Returns true if the factor was built fresh.
+	template <class F> bool prepare_mic( const SparseMatrix<T> &matrix, mic_preconditioner<F> &mic ) const {
+		//
+		typename preconditioner_cache<N>::Remap remap;
+		if( m_cache.remap(matrix.n,m_param.reuse,remap)) {
+			reuse_mic(matrix,remap,mic);
+			console::write(this->get_argument_name()+"_reuse_added_rows",remap.added);
+			console::write(this->get_argument_name()+"_reuse_removed_rows",remap.removed);
+			return false;
+		}
+		build_mic(matrix,mic);
+		if( m_param.reuse.enabled && m_cache.built(matrix.n)) {
+			m_cached_pivot.resize(matrix.n);
+			m_parallel.for_each(matrix.n,[&]( size_t i ) {
+				const T diagonal = get_diagonal(matrix,i);
+				m_cached_pivot[i] = diagonal > 0.0 ? mic.factor.invdiag[i] * std::sqrt(diagonal) : 0.0;
+			});
+		}
+		return true;
+	}
+	//
+	static T get_diagonal( const SparseMatrix<T> &matrix, size_t i ) {
+		for( unsigned j=0; j<matrix.index[i].size(); ++j ) if( matrix.index[i][j] == i ) return matrix.value[i][j];
+		return 0.0;
+	}
+	//
+	void for_each_level( const level_schedule &schedule, std::function<void( unsigned row )> func ) const {
+		//
+		for( unsigned l=0; l+1<schedule.start.size(); ++l ) {
+			const unsigned start (schedule.start[l]), size (schedule.start[l+1]-start);
+			if( size >= m_param.min_level_size ) {
+				m_parallel.for_each(size,[&]( size_t n ) { func(schedule.rows[start+n]); });
+			} else {
+				for( unsigned n=0; n<size; ++n ) func(schedule.rows[start+n]);
+			}
+		}
+	}
+	//
+	template <class F> void apply_mic( const mic_preconditioner<F> &mic, const std::vector<F> &r, std::vector<F> &z ) const { // z = (L L^T)^-1 * r
+		//
+		const auto &factor = mic.factor;
+		const auto &lower = mic.lower;
+		if( mic.use_levels ) {
+			z.resize(r.size());
+			for_each_level(mic.forward,[&]( unsigned i ) {
+				F value = r[i];
+				for( unsigned p=lower.rowstart[i]; p<lower.rowstart[i+1]; ++p ) value -= lower.value[p] * z[lower.column[p]];
+				z[i] = value * factor.invdiag[i];
+			});
+			for_each_level(mic.backward,[&]( unsigned i ) {
+				F value = z[i];
+				for( unsigned p=factor.colstart[i]; p<factor.colstart[i+1]; ++p ) value -= factor.value[p] * z[factor.rowindex[p]];
+				z[i] = value * factor.invdiag[i];
+			});
+		} else {
+			solve_lower(factor,r,z);
+			solve_lower_transpose_in_place(factor,z);
+		}
+	}
+	//
+	typename RCMatrix_solver_interface<N,T>::Result solve_mic( const RCMatrix_interface<N,T> *A, const SparseMatrix<T> &matrix, const RCMatrix_vector_interface<N,T> *b, RCMatrix_vector_interface<N,T> *x ) const {
+		//
+		scoped_timer timer;
+		timer.tick();
+		mic_preconditioner<T> mic;
+		const bool fresh = prepare_mic(matrix,mic);
+		console::write(this->get_argument_name()+"_refactor",fresh);
+		const double setup_time = timer.tock();
+		//
+		const unsigned n = matrix.n;
+		std::vector<T> r_buffer(n), z_buffer(n);
+		const auto precondition = [&]( const RCMatrix_vector_interface<N,T> *r, RCMatrix_vector_interface<N,T> *z ) { // z = (L L^T)^-1 * r
+			if( const T *r_ptr = r->data()) std::copy(r_ptr,r_ptr+n,r_buffer.begin());
+			else r->convert_to(r_buffer);
+			apply_mic(mic,r_buffer,z_buffer);
+			z->resize(n);
+			if( T *z_ptr = z->data()) std::copy(z_buffer.begin(),z_buffer.end(),z_ptr);
+			else z->convert_from(z_buffer);
+		};
+		//
+		timer.tick();
+		const auto A_fixed = A->make_fixed();
+		const double conversion_time = timer.tock();
+		//
+		timer.tick();
+		auto r = b->allocate_vector(n), z = b->allocate_vector(n), p = b->allocate_vector(n);
+		x->resize(n);
+		x->clear();
+		r->copy(b);
+		T residual_0 = r->abs_max();
+		if( ! residual_0 ) {
+			timer.tock();
+			return {N(),0.0};
+		}
+		precondition(r.get(),z.get()); p->copy(z.get());
+		T delta = r->dot(z.get());
+		//
+		N iteration (0);
+		T relative_residual_out (1.0);
+		std::vector<T> history;
+		for( ; iteration<m_param.max_iterations; ++iteration ) {
+			//
+			A_fixed->multiply(p.get(),z.get()); // z = A * p
+			T alpha = delta / p->dot(z.get());
+			x->add_scaled(alpha,p.get()); // x += alpha * p;
+			r->add_scaled(-alpha,z.get()); // r -= alpha * z;
+			relative_residual_out = r->abs_max() / residual_0;
+			history.push_back(relative_residual_out);
+			if( relative_residual_out <= m_param.residual ) {
+				++iteration;
+				break;
+			}
+			precondition(r.get(),z.get()); // z = M^-1 * r
+			T beta = r->dot(z.get());
+			z->add_scaled(beta/delta,p.get()); p.swap(z); // p = z + ( beta / delta ) * p;
+			delta = beta;
+		}
+		m_cache.finished(iteration,fresh,m_param.reuse);
+		typename RCMatrix_solver_interface<N,T>::Result result = {iteration,relative_residual_out,{},{},history};
+		result.conversion_time = conversion_time;
+		result.setup_time = setup_time;
+		result.iteration_time = timer.tock();
+		return result;
+	}
+	//
+	typename RCMatrix_solver_interface<N,T>::Result solve_mixed( const RCMatrix_interface<N,T> *A, const SparseMatrix<T> &matrix, const RCMatrix_vector_interface<N,T> *b, RCMatrix_vector_interface<N,T> *x ) const {
+		//
+		scoped_timer timer;
+		timer.tick();
+		// The bridson preconditioner is the same MIC(0) factor, so every choice runs preconditioned
+		mic_preconditioner<float> mic;
+		const bool fresh = prepare_mic(matrix,mic);
+		const typename mixed_cg<N,T>::preconditioner M = [&]( const std::vector<float> &r, std::vector<float> &z ) { apply_mic(mic,r,z); };
+		const double setup_time = timer.tock();
+		auto result = mixed_cg<N,T>(m_parallel).solve(A,b,x,{m_param.residual,m_param.max_iterations,m_param.max_refinements,m_param.inner_residual},M);
+		result.setup_time = setup_time;
+		m_cache.finished(result.count,fresh,m_param.reuse);
+		return result;
 	}
 	//
 	struct Parameters {
@@ -77,8 +366,18 @@ protected:
 		unsigned max_iterations {30000};
 		double modified_incomplete_cholesky_parameter {0.97};
 		double min_diagonal_ratio {0.25};
+		std::string preconditioner {"bridson"};
+		unsigned min_level_size {256};
+		bool mixed_precision {false};
+		unsigned max_refinements {0};
+		double inner_residual {1e-2};
+		typename preconditioner_cache<N>::Parameters reuse;
 	};
 	Parameters m_param;
+	parallel_driver m_parallel{this};
+	//
+	mutable preconditioner_cache<N> m_cache;
+	mutable std::vector<T> m_cached_pivot;
 };
 //
 extern "C" module * create_instance() {
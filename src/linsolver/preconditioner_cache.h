@@ -0,0 +1,129 @@
+/*
+**	preconditioner_cache.h
+**
+**	This is part of Shiokaze, a research-oriented fluid solver for computer graphics.
+**	Created by Ryoichi Ando <rand@nii.ac.jp> on Oct 18, 2026.
+**
+**	Permission is hereby granted, free of charge, to any person obtaining a copy of
+**	this software and associated documentation files (the "Software"), to deal in
+**	the Software without restriction, including without limitation the rights to use,
+**	copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+**	Software, and to permit persons to whom the Software is furnished to do so,
+**	subject to the following conditions:
+**
+**	The above copyright notice and this permission notice shall be included in all copies
+**	or substantial portions of the Software.
+**
+**	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+**	INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+**	PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+**	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+**	CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+**	OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+//
+//
+#ifndef SHKZ_PRECONDITIONER_CACHE_H
+#define SHKZ_PRECONDITIONER_CACHE_H
+//
+#include <algorithm>
+#include <limits>
+#include <vector>
+//
+SHKZ_BEGIN_NAMESPACE
+//
+// Bookkeeping to reuse a preconditioner across solves. Rows are identified by keys registered by
+// the caller before each solve (e.g. linear cell indices). A reuse maps every current row to the
+// row of the same key in the solve where the preconditioner was built, and is refused when too
+// many rows were added or removed, or once an iteration count drifts beyond a ratio of the count
+// right after the last fresh build.
+template <class N> class preconditioner_cache {
+public:
+	//
+	static constexpr N none = std::numeric_limits<N>::max();
+	//
+	struct Parameters {
+		bool enabled {false};
+		double refresh_iteration_ratio {1.5};
+		double max_change_ratio {0.1};
+	};
+	//
+	struct Remap {
+		std::vector<N> built_row;
+		N added {0};
+		N removed {0};
+	};
+	//
+	void register_keys( const std::vector<N> &keys ) {
+		m_next_keys = keys;
+	}
+	//
+	bool has_keys( N rows ) const {
+		return m_next_keys.size() == rows;
+	}
+	//
+	// Try to map the rows of the upcoming solve onto the rows of the cached preconditioner
+	bool remap( N rows, const Parameters &param, Remap &remap ) const {
+		//
+		if( ! param.enabled || ! m_valid || m_degraded || m_next_keys.size() != rows ) return false;
+		remap.built_row.resize(rows);
+		remap.added = 0;
+		N kept (0);
+		for( N row=0; row<rows; ++row ) {
+			const N key = m_next_keys[row];
+			const N built = key < m_lookup.size() ? m_lookup[key] : none;
+			remap.built_row[row] = built;
+			if( built == none ) ++ remap.added;
+			else ++ kept;
+		}
+		remap.removed = m_built_rows-kept;
+		return remap.added+remap.removed <= param.max_change_ratio * std::max(rows,m_built_rows);
+	}
+	//
+	// Record that the preconditioner was built fresh for the upcoming solve. Returns false
+	// when no keys were registered, in which case the preconditioner cannot be reused later.
+	bool built( N rows ) {
+		//
+		m_valid = m_next_keys.size() == rows;
+		m_degraded = false;
+		m_built_rows = rows;
+		m_lookup.clear();
+		if( m_valid ) {
+			N max_key (0);
+			for( const N &key : m_next_keys ) max_key = std::max(max_key,key);
+			m_lookup.assign(max_key+1,none);
+			for( N row=0; row<rows; ++row ) m_lookup[m_next_keys[row]] = row;
+		}
+		return m_valid;
+	}
+	//
+	// Report the iteration count of a finished solve
+	void finished( unsigned iterations, bool fresh, const Parameters &param ) {
+		//
+		if( fresh ) m_baseline_iterations = iterations;
+		else if( iterations > param.refresh_iteration_ratio * std::max(1U,m_baseline_iterations)) m_degraded = true;
+		m_next_keys.clear();
+	}
+	//
+	void clear() {
+		m_valid = false;
+		m_lookup.clear();
+		m_next_keys.clear();
+	}
+	//
+private:
+	//
+	std::vector<N> m_next_keys;
+	std::vector<N> m_lookup;
+	N m_built_rows {0};
+	unsigned m_baseline_iterations {0};
+	bool m_valid {false};
+	bool m_degraded {false};
+};
+//
+template <class N> constexpr N preconditioner_cache<N>::none;
+//
+SHKZ_END_NAMESPACE
+//
+#endif
+//
@@ -25,10 +25,57 @@
 #include <shiokaze/math/RCMatrix_interface.h>
 #include <shiokaze/parallel/parallel_driver.h>
 #include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <atomic>
 #include "blas_wrapper.h"
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define SHKZ_RCMATRIX_AVX2	1
+#endif
 //
 SHKZ_USING_NAMESPACE
 //
+// Dot product of a compressed row against a dense vector
+template <class N, class T> T RCRow_dot( const N *index, const T *value, const T *x, N size ) {
+	T sum (0.0);
+	for( N j=0; j<size; ++j ) sum += x[index[j]] * value[j];
+	return sum;
+}
+//
+// SIMD version of RCRow_dot. Only 64 bit indices with double values have a gather kernel
+template <class N, class T> struct RCRow_simd {
+	static bool supported() { return false; }
+	static T dot( const N *index, const T *value, const T *x, N size ) {
+		return RCRow_dot(index,value,x,size);
+	}
+};
+//
+#if SHKZ_RCMATRIX_AVX2
+template <> struct RCRow_simd<size_t,double> {
+	static bool supported() {
+		static const bool supported = __builtin_cpu_supports("avx2");
+		return supported;
+	}
+	__attribute__((target("avx2")))
+	static double dot( const size_t *index, const double *value, const double *x, size_t size ) {
+		__m256d sum = _mm256_setzero_pd();
+		size_t j (0);
+		for( ; j+4<=size; j+=4 ) {
+			const __m256i column = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(index+j));
+			sum = _mm256_add_pd(sum,_mm256_mul_pd(_mm256_i64gather_pd(x,column,8),_mm256_loadu_pd(value+j)));
+		}
+		double lanes[4];
+		_mm256_storeu_pd(lanes,sum);
+		double result = (lanes[0]+lanes[1])+(lanes[2]+lanes[3]);
+		for( ; j<size; ++j ) result += x[index[j]] * value[j];
+		return result;
+	}
+};
+#endif
+//
 template <class N, class T> class RCMatrix_allocator : public RCMatrix_allocator_interface<N,T> {
 public:
 	RCMatrix_allocator( const RCMatrix_factory_interface<N,T> &factory ) : m_factory(factory) {}
@@ -123,6 +170,12 @@ public:
 			for( N k=0; k<m_array.size(); ++k ) m_array[k] += alpha * x->at(k);
 		}
 	}
+	virtual T * data() override {
+		return m_array.data();
+	}
+	virtual const T * data() const override {
+		return m_array.data();
+	}
 	virtual RCMatrix_vector_ptr<N,T> allocate_vector( N size ) const override {
 		return m_allocator.allocate_vector(size);
 	}
@@ -137,30 +190,98 @@ public:
 template <class N, class T> struct RowEntry {
 	std::vector<N> index;
 	std::vector<T> value;
+	//
+	void add( N column, T increment_value ) {
+		for( N k=0; k<index.size(); ++k ){
+			if( index[k] == column ){
+				value[k] += increment_value;
+				if( ! value[k] ) {
+					index.erase(index.begin()+k);
+					value.erase(value.begin()+k);
+				}
+				return;
+			} else if( index[k] > column ){
+				index.insert(index.begin()+k,column);
+				value.insert(value.begin()+k,increment_value);
+				return;
+			}
+		}
+		index.push_back(column);
+		value.push_back(increment_value);
+	}
+	void remove( N column ) {
+		for( N k=0; k<index.size(); ++k ){
+			if( index[k] == column ){
+				index.erase(index.begin()+k);
+				value.erase(value.begin()+k);
+				return;
+			}
+		}
+	}
+	void interruptible_for_each( std::function<bool( N column, T& value )> func ) {
+		for( N k=0; k<index.size(); ) {
+			bool do_break (false);
+			if( func(index[k],value[k]) ) do_break = true;
+			if( value[k] ) ++ k;
+			else {
+				index.erase(index.begin()+k);
+				value.erase(value.begin()+k);
+			}
+			if( do_break ) break;
+		}
+	}
+};
+//
+// Row storage with a fixed number of slots per row. Unused slots point to the row itself
+// with a zero value, so that the storage can be read as CSR with a uniform row stride.
+template <class N, class T> struct RCStencilStorage {
+	N stride {0};
+	std::vector<N> index;
+	std::vector<T> value;
+	std::vector<N> size;
 };
 //
 template <class N, class T> class RCFixedMatrix : public RCFixedMatrix_interface<N,T> {
 public:
-	RCFixedMatrix( const std::vector<RowEntry<N,T> > &matrix, const RCMatrix_factory_interface<N,T> &factory ) : m_allocator(factory) {
+	RCFixedMatrix( const std::vector<RowEntry<N,T> > &matrix, const parallel_driver &parallel, const RCMatrix_factory_interface<N,T> &factory ) : m_parallel(parallel), m_allocator(factory) {
 		//
 		m_rows = matrix.size();
 		m_rowstart.resize(m_rows+1);
 		m_rowstart[0] = 0;
+		m_parallel.for_each(m_rows,[&]( size_t i ) {
+			m_rowstart[i+1] = matrix[i].index.size();
+		});
 		for(N i=0; i<m_rows; i++ ) {
-			m_rowstart[i+1]=m_rowstart[i]+matrix[i].index.size();
+			m_rowstart[i+1] += m_rowstart[i];
 		}
 		m_value.resize(m_rowstart[m_rows]);
 		m_index.resize(m_rowstart[m_rows]);
-		N j (0);
-		for( N i=0; i<m_rows; i++) {
+		m_parallel.for_each(m_rows,[&]( size_t i ) {
 			const std::vector<N> &index = matrix[i].index;
 			const std::vector<T> &value = matrix[i].value;
-			for( N k=0; k<index.size(); ++k ) {
-				m_index[j] = index[k];
-				m_value[j] = value[k];
-				++ j;
+			if( ! index.empty()) {
+				std::memcpy(m_index.data()+m_rowstart[i],index.data(),index.size()*sizeof(N));
+				std::memcpy(m_value.data()+m_rowstart[i],value.data(),value.size()*sizeof(T));
 			}
-		}
+		});
+		m_index_ptr = m_index.data();
+		m_value_ptr = m_value.data();
+	}
+	RCFixedMatrix( std::vector<N> &&rowstart, std::vector<N> &&index, std::vector<T> &&value, const parallel_driver &parallel, const RCMatrix_factory_interface<N,T> &factory ) :
+		m_parallel(parallel), m_allocator(factory), m_rowstart(std::move(rowstart)), m_index(std::move(index)), m_value(std::move(value)) {
+		//
+		m_rows = m_rowstart.size()-1;
+		m_index_ptr = m_index.data();
+		m_value_ptr = m_value.data();
+	}
+	RCFixedMatrix( const std::shared_ptr<const RCStencilStorage<N,T> > &storage, const parallel_driver &parallel, const RCMatrix_factory_interface<N,T> &factory ) :
+		m_parallel(parallel), m_allocator(factory), m_storage(storage) {
+		//
+		// Read the stencil storage in place as CSR with a uniform row stride
+		m_rows = m_storage->size.size();
+		m_stride = m_storage->stride;
+		m_index_ptr = m_storage->index.data();
+		m_value_ptr = m_storage->value.data();
 	}
 private:
 	//
@@ -171,41 +292,210 @@ private:
 		return m_allocator.allocate_matrix(rows,columns);
 	}
 	//
+	N row_start( N i ) const {
+		return m_stride ? i*m_stride : m_rowstart[i];
+	}
+	N row_size( N i ) const {
+		return m_stride ? m_stride : m_rowstart[i+1]-m_rowstart[i];
+	}
+	//
 	virtual void multiply( const RCMatrix_vector_interface<N,T> *rhs, RCMatrix_vector_interface<N,T> *result ) const override {
 		//
 		const auto *v = dynamic_cast<const RCMatrix_vector<N,T> *>(rhs);
-		if( v ) {
+		auto *r = dynamic_cast<RCMatrix_vector<N,T> *>(result);
+		if( v && r && v != r && r->m_array.size() >= m_rows ) {
+			//
+			// Rows are split into blocks so that each parallel task amortizes its dispatch cost
+			const N *index = m_index_ptr;
+			const T *value = m_value_ptr;
+			const T *x = v->m_array.data();
+			T *y = r->m_array.data();
+			const bool use_simd = RCRow_simd<N,T>::supported();
+			const N block_size (256);
+			m_parallel.for_each((m_rows+block_size-1)/block_size,[&]( size_t block ) {
+				const N end = std::min((N)((block+1)*block_size),m_rows);
+				for( N i=block*block_size; i<end; ++i ) {
+					const N start = row_start(i);
+					const N size = row_size(i);
+					y[i] = use_simd ? RCRow_simd<N,T>::dot(index+start,value+start,x,size) : RCRow_dot(index+start,value+start,x,size);
+				}
+			});
+		} else if( v ) {
 			for( N i=0; i<m_rows; ++i ) {
 				T value (0.0);
-				for( N j=m_rowstart[i]; j<m_rowstart[i+1]; ++j ) value += v->m_array[m_index[j]] * m_value[j];
+				for( N j=row_start(i); j<row_start(i)+row_size(i); ++j ) value += v->m_array[m_index_ptr[j]] * m_value_ptr[j];
 				result->set(i,value);
 			}
 		} else {
 			for( N i=0; i<m_rows; ++i ) {
 				T value (0.0);
-				for( N j=m_rowstart[i]; j<m_rowstart[i+1]; ++j ) value += rhs->at(m_index[j]) * m_value[j];
+				for( N j=row_start(i); j<row_start(i)+row_size(i); ++j ) value += rhs->at(m_index_ptr[j]) * m_value_ptr[j];
 				result->set(i,value);
 			}
 		}
 	}
+	virtual void multiply_many( const std::vector<const RCMatrix_vector_interface<N,T> *> &rhs, const std::vector<RCMatrix_vector_interface<N,T> *> &result ) const override {
+		//
+		std::vector<const T *> xs;
+		std::vector<T *> ys;
+		for( size_t n=0; n<rhs.size(); ++n ) {
+			const auto *v = dynamic_cast<const RCMatrix_vector<N,T> *>(rhs[n]);
+			auto *r = dynamic_cast<RCMatrix_vector<N,T> *>(result[n]);
+			if( ! v || ! r || r->m_array.size() < m_rows ) break;
+			xs.push_back(v->m_array.data());
+			ys.push_back(r->m_array.data());
+		}
+		bool aliased (xs.size() != rhs.size());
+		for( size_t n=0; ! aliased && n<ys.size(); ++n ) aliased = std::find(xs.begin(),xs.end(),ys[n]) != xs.end();
+		if( aliased ) {
+			RCFixedMatrix_interface<N,T>::multiply_many(rhs,result);
+			return;
+		}
+		//
+		// Each row is read once and applied to up to chunk_size vectors at a time
+		const N *index = m_index_ptr;
+		const T *value = m_value_ptr;
+		const size_t count (xs.size()), chunk_size (8);
+		const N block_size (256);
+		m_parallel.for_each((m_rows+block_size-1)/block_size,[&]( size_t block ) {
+			const N end = std::min((N)((block+1)*block_size),m_rows);
+			for( size_t c0=0; c0<count; c0+=chunk_size ) {
+				const size_t chunk = std::min(chunk_size,count-c0);
+				const T * const *x = xs.data()+c0;
+				T * const *y = ys.data()+c0;
+				for( N i=block*block_size; i<end; ++i ) {
+					T sum[chunk_size] = {};
+					const N start = row_start(i);
+					const N size = row_size(i);
+					for( N j=start; j<start+size; ++j ) {
+						const N column = index[j];
+						const T a = value[j];
+						for( size_t k=0; k<chunk; ++k ) sum[k] += a * x[k][column];
+					}
+					for( size_t k=0; k<chunk; ++k ) y[k][i] = sum[k];
+				}
+			}
+		});
+	}
 	//
+	const parallel_driver &m_parallel;
 	const RCMatrix_allocator<N,T> m_allocator;
 	std::vector<N> m_rowstart;
 	std::vector<N> m_index;
 	std::vector<T> m_value;
+	std::shared_ptr<const RCStencilStorage<N,T> > m_storage;
+	const N *m_index_ptr {nullptr};
+	const T *m_value_ptr {nullptr};
+	N m_stride {0};
 	N m_rows;
 };
 //
-template <class N, class T> class RCMatrix : public RCMatrix_interface<N,T> {
+// Operations shared by the matrix storages that only go through the row accessors
+template <class N, class T> class RCMatrix_common : public RCMatrix_interface<N,T> {
+public:
+	RCMatrix_common( const parallel_driver &parallel, const RCMatrix_factory_interface<N,T> &factory ) : m_parallel(parallel), m_factory(factory), m_allocator(factory) {}
+protected:
+	virtual T get( N row, N column ) const override {
+		//
+		T result (0.0);
+		this->const_interruptible_for_each(row,[&]( N _column, T value ) {
+			if( column == _column ) {
+				result = value;
+				return true;
+			}
+			return false;
+		});
+		return result;
+	}
+	virtual void multiply(T value) override {
+		//
+		m_parallel.for_each(this->rows(),[&]( size_t row ) {
+			RCMatrix_interface<N,T>::for_each(row,[&]( N column, T& _value ) {
+				_value *= value;
+			});
+		});
+	}
+	virtual void multiply( const RCMatrix_vector_interface<N,T> *rhs, RCMatrix_vector_interface<N,T> *result ) const override {
+		//
+		result->resize(this->rows());
+		const auto *v = dynamic_cast<const RCMatrix_vector<N,T> *>(rhs);
+		if( v ) {
+			m_parallel.for_each(this->rows(),[&]( size_t row ) {
+				T sum (0.0);
+				RCMatrix_interface<N,T>::const_for_each(row,[&]( N column, T value ) {
+					sum += v->m_array[column] * value;
+				});
+				result->set(row,sum);
+			});
+		} else {
+			m_parallel.for_each(this->rows(),[&]( size_t row ) {
+				T sum (0.0);
+				RCMatrix_interface<N,T>::const_for_each(row,[&]( N column, T value ) {
+					sum += rhs->at(column) * value;
+				});
+				result->set(row,sum);
+			});
+		}
+	}
+	virtual void multiply( const RCMatrix_interface<N,T> *matrix, RCMatrix_interface<N,T> *result ) const override {
+		//
+		assert( this->columns() == matrix->rows());
+		//
+		result->initialize(this->rows(),matrix->columns());
+		m_parallel.for_each(this->rows(),[&]( size_t row ) {
+			RCMatrix_interface<N,T>::const_for_each(row,[&]( N A_column, T A_value ) {
+				matrix->const_for_each(A_column,[&]( N B_column, T B_value ) {
+					result->add_to_element(row,B_column,A_value*B_value);
+				});
+			});
+		});
+	}
+	virtual void add( const RCMatrix_interface<N,T> *matrix, RCMatrix_interface<N,T> *result ) const override {
+		//
+		assert(matrix->rows() == this->rows());
+		assert(matrix->columns() == this->columns());
+		//
+		result->initialize(this->rows(),this->columns());
+		m_parallel.for_each(matrix->rows(),[&]( size_t row ) {
+			matrix->const_for_each(row,[&]( N column, T value ) {
+				result->add_to_element(row,column,value);
+			});
+			this->const_for_each(row,[&]( N column, T value ) {
+				result->add_to_element(row,column,value);
+			});
+		});
+	}
+	virtual void transpose( RCMatrix_interface<N,T> *result ) const override {
+		//
+		result->initialize(this->columns(),this->rows());
+		for( size_t row=0; row<this->rows(); ++row ) {
+			RCMatrix_interface<N,T>::const_for_each(row,[&]( N column, T value ) {
+				result->add_to_element(column,row,value);
+			});
+		}
+	}
+	virtual RCMatrix_vector_ptr<N,T> allocate_vector( N size ) const override {
+		return m_allocator.allocate_vector(size);
+	}
+	virtual RCMatrix_ptr<N,T> allocate_matrix( N rows, N columns ) const override {
+		return m_allocator.allocate_matrix(rows,columns);
+	}
+	//
+	const parallel_driver &m_parallel;
+	const RCMatrix_factory_interface<N,T> &m_factory;
+	const RCMatrix_allocator<N,T> m_allocator;
+};
+//
+template <class N, class T> class RCMatrix : public RCMatrix_common<N,T> {
 public:
-	RCMatrix( const parallel_driver &parallel, const RCMatrix_factory_interface<N,T> &factory ) : m_parallel(parallel), m_allocator(factory), m_factory(factory) {}
+	RCMatrix( const parallel_driver &parallel, const RCMatrix_factory_interface<N,T> &factory ) : RCMatrix_common<N,T>(parallel,factory) {}
 private:
 	virtual void initialize( N rows, N columns ) override {
 		//
 		m_matrix.resize(rows);
 		m_matrix.shrink_to_fit();
 		m_columns = columns;
-		m_parallel.for_each(rows,[&]( size_t row ) {
+		this->m_parallel.for_each(rows,[&]( size_t row ) {
 			clear(row);
 		});
 	}
@@ -214,11 +504,11 @@ private:
 		initialize(m->rows(),m->columns());
 		const auto *mate_matrix = dynamic_cast<const RCMatrix<N,T> *>(m);
 		if( mate_matrix ) {
-			m_parallel.for_each(rows(),[&]( size_t row ) {
+			this->m_parallel.for_each(rows(),[&]( size_t row ) {
 				m_matrix[row] = mate_matrix->m_matrix[row];
 			});
 		} else {
-			m_parallel.for_each(rows(),[&]( size_t row ) {
+			this->m_parallel.for_each(rows(),[&]( size_t row ) {
 				m->const_for_each(row,[&]( N column, T value ) {
 					add_to_element(row,column,value);
 				});
@@ -234,68 +524,19 @@ private:
 		m_matrix[row].value.shrink_to_fit();
 		//
 	}
-	virtual T get( N row, N column ) const override {
-		//
-		T result (0.0);
-		const_interruptible_for_each(row,[&]( N _column, T value ) {
-			if( column == _column ) {
-				result = value;
-				return true;
-			}
-			return false;
-		});
-		return result;
-	}
 	virtual void add_to_element( N row, N column, T increment_value ) override {
 		//
 		if( increment_value ) {
 			assert( column < m_columns );
-			std::vector<N> &index = m_matrix[row].index;
-			std::vector<T> &value = m_matrix[row].value;
-			for( N k=0; k<index.size(); ++k ){
-				if( index[k] == column ){
-					value[k] += increment_value;
-					if( ! value[k] ) {
-						index.erase(index.begin()+k);
-						value.erase(value.begin()+k);
-					}
-					return;
-				} else if( index[k] > column ){
-					index.insert(index.begin()+k,column);
-					value.insert(value.begin()+k,increment_value);
-					return;
-				}
-			}
-			index.push_back(column);
-			value.push_back(increment_value);
+			m_matrix[row].add(column,increment_value);
 		}
 	}
 	virtual void clear_element( N row, N column ) override {
 		assert( column < m_columns );
-		std::vector<N> &index = m_matrix[row].index;
-		std::vector<T> &value = m_matrix[row].value;
-		for( N k=0; k<index.size(); ++k ){
-			if( index[k] == column ){
-				index.erase(index.begin()+k);
-				value.erase(value.begin()+k);
-				return;
-			}
-		}
+		m_matrix[row].remove(column);
 	}
 	virtual void interruptible_for_each( N row, std::function<bool( N column, T& value )> func) override {
-		//
-		std::vector<N> &index = m_matrix[row].index;
-		std::vector<T> &value = m_matrix[row].value;
-		for( N k=0; k<index.size(); ) {
-			bool do_break (false);
-			if( func(index[k],value[k]) ) do_break = true;
-			if( value[k] ) ++ k;
-			else {
-				index.erase(index.begin()+k);
-				value.erase(value.begin()+k);
-			}
-			if( do_break ) break;
-		}
+		m_matrix[row].interruptible_for_each(func);
 	}
 	virtual void const_interruptible_for_each( N row, std::function<bool( N column, T value )> func) const override {
 		//
@@ -315,88 +556,235 @@ private:
 		const std::vector<N> &index = m_matrix[row].index;
 		return index.size();
 	}
-	virtual void multiply(T value) override {
+	virtual RCFixedMatrix_ptr<N,T> make_fixed() const override {
+		return RCFixedMatrix_ptr<N,T>(new RCFixedMatrix<N,T>(m_matrix,this->m_parallel,this->m_factory));
+	}
+	//
+	std::vector<RowEntry<N,T> > m_matrix;
+	N m_columns;
+};
+//
+// Matrix that reserves a fixed number of entries for each row up front. Rows are filled in
+// place without heap allocations, and different rows can be filled concurrently. A row that
+// outgrows its slots spills into an ordinary RowEntry. Without spilled rows, make_fixed()
+// shares the storage with the fixed matrix instead of copying it; the storage is then copied
+// on the next modification.
+template <class N, class T> class RCStencilMatrix : public RCMatrix_common<N,T> {
+public:
+	RCStencilMatrix( N entries_per_row, const parallel_driver &parallel, const RCMatrix_factory_interface<N,T> &factory ) :
+		RCMatrix_common<N,T>(parallel,factory), m_entries_per_row(std::max((N)1,entries_per_row)) {
+		m_storage = std::make_shared<RCStencilStorage<N,T> >();
+		m_storage->stride = m_entries_per_row;
+	}
+private:
+	virtual void initialize( N rows, N columns ) override {
 		//
-		m_parallel.for_each(rows(),[&]( size_t row ) {
-			RCMatrix_interface<N,T>::for_each(row,[&]( N column, T& _value ) {
-				_value *= value;
-			});
+		auto storage = std::make_shared<RCStencilStorage<N,T> >();
+		const N stride = storage->stride = m_entries_per_row;
+		storage->index.resize(rows*stride);
+		storage->value.resize(rows*stride);
+		storage->size.resize(rows);
+		this->m_parallel.for_each(rows,[&]( size_t row ) {
+			for( N k=0; k<stride; ++k ) {
+				storage->index[row*stride+k] = row;
+				storage->value[row*stride+k] = 0.0;
+			}
+			storage->size[row] = 0;
 		});
+		m_storage = storage;
+		m_shared = false;
+		m_overflow.clear();
+		m_overflow.resize(rows);
+		m_overflow_count = 0;
+		m_columns = columns;
 	}
-	virtual void multiply( const RCMatrix_vector_interface<N,T> *rhs, RCMatrix_vector_interface<N,T> *result ) const override {
+	virtual void copy(const RCMatrix_interface<N,T> *m ) override {
 		//
-		result->resize(rows());
-		const auto *v = dynamic_cast<const RCMatrix_vector<N,T> *>(rhs);
-		if( v ) {
-			m_parallel.for_each(rows(),[&]( size_t row ) {
-				T sum (0.0);
-				RCMatrix_interface<N,T>::const_for_each(row,[&]( N column, T value ) {
-					sum += v->m_array[column] * value;
-				});
-				result->set(row,sum);
-			});
+		const auto *mate_matrix = dynamic_cast<const RCStencilMatrix<N,T> *>(m);
+		if( mate_matrix ) {
+			m_entries_per_row = mate_matrix->m_entries_per_row;
+			m_storage = std::make_shared<RCStencilStorage<N,T> >(*mate_matrix->m_storage);
+			m_shared = false;
+			m_overflow.clear();
+			m_overflow.resize(mate_matrix->rows());
+			for( N row=0; row<mate_matrix->rows(); ++row ) {
+				if( mate_matrix->m_overflow[row] ) m_overflow[row].reset(new RowEntry<N,T>(*mate_matrix->m_overflow[row]));
+			}
+			m_overflow_count = mate_matrix->m_overflow_count.load();
+			m_columns = mate_matrix->m_columns;
 		} else {
-			m_parallel.for_each(rows(),[&]( size_t row ) {
-				T sum (0.0);
-				RCMatrix_interface<N,T>::const_for_each(row,[&]( N column, T value ) {
-					sum += rhs->at(column) * value;
+			initialize(m->rows(),m->columns());
+			this->m_parallel.for_each(rows(),[&]( size_t row ) {
+				m->const_for_each(row,[&]( N column, T value ) {
+					add_to_element(row,column,value);
 				});
-				result->set(row,sum);
 			});
 		}
 	}
-	virtual void multiply( const RCMatrix_interface<N,T> *matrix, RCMatrix_interface<N,T> *result ) const override {
+	virtual void clear( N row ) override {
 		//
-		assert( columns() == matrix->rows());
+		detach();
+		m_overflow[row].reset();
+		auto &s = *m_storage;
+		for( N k=0; k<s.stride; ++k ) {
+			s.index[row*s.stride+k] = row;
+			s.value[row*s.stride+k] = 0.0;
+		}
+		s.size[row] = 0;
+	}
+	virtual void add_to_element( N row, N column, T increment_value ) override {
 		//
-		result->initialize(rows(),matrix->columns());
-		m_parallel.for_each(rows(),[&]( size_t row ) {
-			RCMatrix_interface<N,T>::const_for_each(row,[&]( N A_column, T A_value ) {
-				matrix->const_for_each(A_column,[&]( N B_column, T B_value ) {
-					result->add_to_element(row,B_column,A_value*B_value);
-				});
-			});
-		});
+		if( increment_value ) {
+			assert( column < m_columns );
+			detach();
+			if( m_overflow[row] ) {
+				m_overflow[row]->add(column,increment_value);
+				return;
+			}
+			auto &s = *m_storage;
+			N *index = s.index.data()+row*s.stride;
+			T *value = s.value.data()+row*s.stride;
+			N &size = s.size[row];
+			N k (0);
+			for( ; k<size && index[k] < column; ++k );
+			if( k < size && index[k] == column ) {
+				value[k] += increment_value;
+				if( ! value[k] ) remove_slot(row,k);
+			} else if( size < s.stride ) {
+				for( N j=size; j>k; --j ) {
+					index[j] = index[j-1];
+					value[j] = value[j-1];
+				}
+				index[k] = column;
+				value[k] = increment_value;
+				++ size;
+			} else {
+				spill(row);
+				m_overflow[row]->add(column,increment_value);
+			}
+		}
 	}
-	virtual void add( const RCMatrix_interface<N,T> *matrix, RCMatrix_interface<N,T> *result ) const override {
+	virtual void clear_element( N row, N column ) override {
 		//
-		assert(matrix->rows() == rows());
-		assert(matrix->columns() == columns());
+		assert( column < m_columns );
+		detach();
+		if( m_overflow[row] ) {
+			m_overflow[row]->remove(column);
+			return;
+		}
+		const auto &s = *m_storage;
+		for( N k=0; k<s.size[row]; ++k ) {
+			if( s.index[row*s.stride+k] == column ) {
+				remove_slot(row,k);
+				return;
+			}
+		}
+	}
+	virtual void interruptible_for_each( N row, std::function<bool( N column, T& value )> func) override {
 		//
-		result->initialize(rows(),columns());
-		m_parallel.for_each(matrix->rows(),[&]( size_t row ) {
-			matrix->const_for_each(row,[&]( N column, T value ) {
-				result->add_to_element(row,column,value);
-			});
-			this->const_for_each(row,[&]( N column, T value ) {
-				result->add_to_element(row,column,value);
-			});
-		});
+		detach();
+		if( m_overflow[row] ) {
+			m_overflow[row]->interruptible_for_each(func);
+			return;
+		}
+		auto &s = *m_storage;
+		for( N k=0; k<s.size[row]; ) {
+			T &value = s.value[row*s.stride+k];
+			bool do_break (false);
+			if( func(s.index[row*s.stride+k],value) ) do_break = true;
+			if( value ) ++ k;
+			else remove_slot(row,k);
+			if( do_break ) break;
+		}
 	}
-	virtual void transpose( RCMatrix_interface<N,T> *result ) const override {
+	virtual void const_interruptible_for_each( N row, std::function<bool( N column, T value )> func) const override {
 		//
-		result->initialize(columns(),rows());
-		for( size_t row=0; row<rows(); ++row ) {
-			RCMatrix_interface<N,T>::const_for_each(row,[&]( N column, T value ) {
-				result->add_to_element(column,row,value);
-			});
+		if( m_overflow[row] ) {
+			const RowEntry<N,T> &entry = *m_overflow[row];
+			for( N k=0; k<entry.index.size(); ++k ) if( func(entry.index[k],entry.value[k]) ) break;
+			return;
 		}
+		const auto &s = *m_storage;
+		for( N k=0; k<s.size[row]; ++k ) if( func(s.index[row*s.stride+k],s.value[row*s.stride+k]) ) break;
 	}
-	virtual RCMatrix_vector_ptr<N,T> allocate_vector( N size ) const override {
-		return m_allocator.allocate_vector(size);
+	virtual N rows() const override {
+		return m_storage->size.size();
 	}
-	virtual RCMatrix_ptr<N,T> allocate_matrix( N rows, N columns ) const override {
-		return m_allocator.allocate_matrix(rows,columns);
+	virtual N columns() const override {
+		return m_columns;
+	}
+	virtual N non_zeros( N row ) const override {
+		return m_overflow[row] ? m_overflow[row]->index.size() : m_storage->size[row];
 	}
 	virtual RCFixedMatrix_ptr<N,T> make_fixed() const override {
-		return RCFixedMatrix_ptr<N,T>(new RCFixedMatrix<N,T>(m_matrix,m_factory));
+		//
+		if( ! m_overflow_count ) {
+			m_shared = true;
+			return RCFixedMatrix_ptr<N,T>(new RCFixedMatrix<N,T>(std::shared_ptr<const RCStencilStorage<N,T> >(m_storage),this->m_parallel,this->m_factory));
+		}
+		//
+		// Compact into an ordinary CSR when some rows have spilled
+		const N n = rows();
+		std::vector<N> rowstart(n+1);
+		rowstart[0] = 0;
+		for( N row=0; row<n; ++row ) rowstart[row+1] = rowstart[row]+non_zeros(row);
+		std::vector<N> index(rowstart[n]);
+		std::vector<T> value(rowstart[n]);
+		this->m_parallel.for_each(n,[&]( size_t row ) {
+			N p = rowstart[row];
+			const_interruptible_for_each(row,[&]( N column, T v ) {
+				index[p] = column;
+				value[p] = v;
+				++ p;
+				return false;
+			});
+		});
+		return RCFixedMatrix_ptr<N,T>(new RCFixedMatrix<N,T>(std::move(rowstart),std::move(index),std::move(value),this->m_parallel,this->m_factory));
 	}
 	//
-	std::vector<RowEntry<N,T> > m_matrix;
-	N m_columns;
-	const parallel_driver &m_parallel;
-	const RCMatrix_factory_interface<N,T> &m_factory;
-	const RCMatrix_allocator<N,T> m_allocator;
+	void detach() {
+		if( m_shared.load(std::memory_order_acquire)) {
+			std::lock_guard<std::mutex> guard(m_detach_mutex);
+			if( m_shared.load(std::memory_order_relaxed)) {
+				if( m_storage.use_count() > 1 ) m_storage = std::make_shared<RCStencilStorage<N,T> >(*m_storage);
+				m_shared.store(false,std::memory_order_release);
+			}
+		}
+	}
+	void remove_slot( N row, N k ) {
+		auto &s = *m_storage;
+		N *index = s.index.data()+row*s.stride;
+		T *value = s.value.data()+row*s.stride;
+		N &size = s.size[row];
+		for( N j=k; j+1<size; ++j ) {
+			index[j] = index[j+1];
+			value[j] = value[j+1];
+		}
+		-- size;
+		index[size] = row;
+		value[size] = 0.0;
+	}
+	void spill( N row ) {
+		auto &s = *m_storage;
+		RowEntry<N,T> *entry = new RowEntry<N,T>;
+		entry->index.assign(s.index.begin()+row*s.stride,s.index.begin()+row*s.stride+s.size[row]);
+		entry->value.assign(s.value.begin()+row*s.stride,s.value.begin()+row*s.stride+s.size[row]);
+		m_overflow[row].reset(entry);
+		for( N k=0; k<s.stride; ++k ) {
+			s.index[row*s.stride+k] = row;
+			s.value[row*s.stride+k] = 0.0;
+		}
+		s.size[row] = 0;
+		++ m_overflow_count;
+	}
+	//
+	N m_entries_per_row;
+	N m_columns {0};
+	std::shared_ptr<RCStencilStorage<N,T> > m_storage;
+	std::vector<std::unique_ptr<RowEntry<N,T> > > m_overflow;
+	std::atomic<N> m_overflow_count {0};
+	mutable std::atomic<bool> m_shared {false};
+	std::mutex m_detach_mutex;
 };
 //
 template <class N, class T> class RCMatrix_factory : public RCMatrix_factory_interface<N,T> {
@@ -412,6 +800,11 @@ protected:
 		}
 		return result;
 	}
+	virtual RCMatrix_ptr<N,T> allocate_stencil_matrix( N rows, N columns, N entries_per_row ) const override {
+		auto result = RCMatrix_ptr<N,T>(new RCStencilMatrix<N,T>(entries_per_row,m_parallel,*this));
+		result->initialize(rows,columns);
+		return result;
+	}
 	parallel_driver m_parallel{this};
 };
 //
@@ -0,0 +1,327 @@
+/*
+**	macadaptivepressuresolver3.cpp
+**
+**	This is part of Shiokaze, a research-oriented fluid solver for computer graphics.
+**	Created by Ryoichi Ando <rand@nii.ac.jp> on Oct 18, 2026.
+**
+**	Permission is hereby granted, free of charge, to any person obtaining a copy of
+**	this software and associated documentation files (the "Software"), to deal in
+**	the Software without restriction, including without limitation the rights to use,
+**	copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+**	Software, and to permit persons to whom the Software is furnished to do so,
+**	subject to the following conditions:
+**
+**	The above copyright notice and this permission notice shall be included in all copies
+**	or substantial portions of the Software.
+**
+**	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+**	INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+**	PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+**	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+**	CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+**	OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+//
+#include <shiokaze/array/array3.h>
+#include <shiokaze/array/macarray3.h>
+#include <shiokaze/array/shared_array3.h>
+#include <shiokaze/array/shared_bitarray3.h>
+#include <shiokaze/math/RCMatrix_interface.h>
+#include <shiokaze/math/RCMatrix_utility.h>
+#include <shiokaze/linsolver/RCMatrix_solver.h>
+#include <shiokaze/utility/macutility3_interface.h>
+#include <shiokaze/projection/macproject3_interface.h>
+#include <shiokaze/parallel/parallel_driver.h>
+#include <shiokaze/core/console.h>
+#include <shiokaze/core/timer.h>
+#include "poisson_operator3.h"
+#include "surface_tension3.h"
+#include "pressure_projection3.h"
+#include <algorithm>
+#include <cmath>
+//
+SHKZ_USING_NAMESPACE
+//
+// Pressure projection with tall cells. Away from the liquid surface and solid walls, runs of fluid
+// cells along a column are represented by the pressures of their two end cells, and the cells in between
+// take the linear interpolation of them. With the interpolation P from the reduced unknowns to every cell,
+// the reduced system is the Galerkin product P^T A P of the uniform system, which stays symmetric positive
+// definite. The solved pressure is interpolated back onto every cell to update the uniform MAC faces.
+class macadaptivepressuresolver3 : public macproject3_interface {
+protected:
+	//
+	LONG_NAME("MAC Adaptive Pressure Solver 3D")
+	//
+	virtual void set_target_volume( double current_volume, double target_volume ) override {
+		m_current_volume = current_volume;
+		m_target_volume = target_volume;
+	}
+	//
+	virtual void project( double dt,
+				macarray3<Real> &velocity,
+				const array3<Real> &solid,
+				const array3<Real> &fluid,
+				double surface_tension,
+				const std::vector<signed_rigidbody3_interface *> *rigidbodies ) override {
+		//
+		scoped_timer timer(this);
+		//
+		timer.tick(); console::dump( ">>> Adaptive Pressure Projection started...\n" );
+		//
+		shared_macarray3<Real> areas(velocity.shape());
+		shared_macarray3<Real> rhos(velocity.shape());
+		//
+		// Pre-compute solid cut "areas" and fluid density "rhos" for each cell face
+		timer.tick(); console::dump( "Precomputing solid and fluid fractions...");
+		m_macutility->compute_area_fraction(solid,areas());
+		m_macutility->compute_fluid_fraction(fluid,rhos());
+		//
+		// Enforce first order accuracy
+		if( ! m_param.second_order_accurate_fluid ) {
+			rhos->parallel_actives([&]( auto &it ) {
+				if( it() ) it.set(1.0);
+			});
+		}
+		//
+		if( ! m_param.second_order_accurate_solid ) {
+			areas->parallel_actives([&]( auto &it ) {
+				if( it() ) it.set(1.0);
+			});
+		}
+		//
+		console::dump( "Done. Took %s\n", timer.stock("solid_fluid_fractions").c_str());
+		//
+		// Compute curvature and substitute to the right hand side for the surface tension force
+		if( surface_tension ) {
+			//
+			timer.tick(); console::dump( "Computing surface tension force...");
+			surface_tension3::add_force(dt,surface_tension,fluid,rhos(),velocity,m_dx,m_param.curvature_stencil=="fourth_order",m_parallel);
+			console::dump( "Done. Took %s\n", timer.stock("surftension_force").c_str());
+		}
+		//
+		// The target linear system to build
+		timer.tick(); console::dump( "Building the high-res linear system [Lhs] and [rhs]..." );
+		//
+		// Label cell indices
+		shared_array3<size_t> index_map(fluid.shape());
+		const size_t index = pressure_projection3::mark_cells(fluid,areas(),rhos(),index_map());
+		//
+		// Assemble the linear system for the Poisson equations for pressure solve on the stencil of a
+		// matrix-free operator, which the Galerkin product below reads directly
+		poisson_operator3 Lhs(index,*m_factory.get(),m_parallel);
+		auto rhs = m_factory->allocate_vector(index);
+		pressure_projection3::assemble(dt,m_dx,fluid,areas(),rhos(),velocity,index_map(),rhs.get(),
+			[&]( size_t n, int i, int j, int k ) {},
+			[&]( size_t n, int nq, size_t m, double value ) { Lhs.set_neighbor(n,nq,m,value); },
+			[&]( size_t n, double value ) { Lhs.set_diagonal(n,value); });
+		//
+		console::dump( "Done. Took %s\n", timer.stock("build_highres_linsystem").c_str());
+		//
+		// Volume correction
+		if( m_param.gain && m_target_volume ) {
+			timer.tick(); console::dump( "Computing volume correction...");
+			const double rhs_correct = pressure_projection3::correct_volume(dt,m_param.gain,m_current_volume,m_target_volume,m_y_prev,rhs.get());
+			console::dump( "Done. Took %s\n", timer.stock("volume_correction").c_str());
+			console::write(get_argument_name()+"_volume_correct_rhs", rhs_correct);
+		}
+		//
+		// Merge the deep cells of each column into tall cells and build the interpolation
+		timer.tick(); console::dump( "Building tall cells...");
+		std::vector<size_t> lower(index), upper(index);
+		std::vector<double> weight(index,0.0);
+		m_parallel.for_each(index,[&]( size_t n ) { lower[n] = upper[n] = n; });
+		//
+		const int axis = std::min(m_param.axis,2u);
+		const int a1 = (axis+1) % 3, a2 = (axis+2) % 3;
+		//
+		// Cells within the band from the liquid surface or solids are kept uniform
+		shared_bitarray3 near(m_shape);
+		fluid.const_serial_actives([&]( int i, int j, int k, const auto &it ) {
+			if( std::abs(it()) < m_dx ) near().set(i,j,k);
+		});
+		const bool solid_nodal = solid.shape() == m_shape.nodal();
+		solid.const_serial_actives([&]( int i, int j, int k, const auto &it ) {
+			if( std::abs(it()) < m_dx ) {
+				//
+				// A nodal solid marks the eight cells that share the node
+				for( int q=0; q<(solid_nodal ? 8 : 1); ++q ) {
+					const vec3i pi = vec3i(i,j,k)-vec3i((q>>2)&1,(q>>1)&1,q&1);
+					if( ! m_shape.out_of_bounds(pi)) near().set(pi);
+				}
+			}
+		});
+		if( m_param.band_width ) near->dilate(m_param.band_width);
+		const int length = m_shape[axis];
+		m_parallel.for_each(m_shape[a1]*m_shape[a2],[&]( size_t column ) {
+			vec3i pi;
+			pi[a1] = column % m_shape[a1];
+			pi[a2] = column / m_shape[a1];
+			const auto deep = [&]( int t ) {
+				pi[axis] = t;
+				return index_map->active(pi) && ! near()(pi);
+			};
+			for( int t0=0; t0<length; ) {
+				if( ! deep(t0)) { ++ t0; continue; }
+				int t1 (t0);
+				while( t1+1 < length && deep(t1+1)) ++ t1;
+				if( t1-t0+1 >= (int)m_param.min_length ) {
+					pi[axis] = t0; const size_t n0 = index_map()(pi);
+					pi[axis] = t1; const size_t n1 = index_map()(pi);
+					for( int t=t0+1; t<t1; ++t ) {
+						pi[axis] = t;
+						const size_t n = index_map()(pi);
+						lower[n] = n0;
+						upper[n] = n1;
+						weight[n] = (t-t0) / (double)(t1-t0);
+					}
+				}
+				t0 = t1+1;
+			}
+		});
+		//
+		std::vector<size_t> reduced_index(index);
+		size_t reduced (0);
+		for( size_t n=0; n<index; ++n ) if( lower[n] == n ) reduced_index[n] = reduced ++;
+		//
+		const auto for_each_parent = [&]( size_t n, auto func ) {
+			if( lower[n] == n ) {
+				func(reduced_index[n],1.0);
+			} else {
+				func(reduced_index[lower[n]],1.0-weight[n]);
+				func(reduced_index[upper[n]],weight[n]);
+			}
+		};
+		//
+		// List the cells interpolated from each reduced unknown, which are the rows of P^T
+		std::vector<size_t> child_start(reduced+1,0);
+		for( size_t n=0; n<index; ++n ) for_each_parent(n,[&]( size_t c, double w ) { ++ child_start[c+1]; });
+		for( size_t c=0; c<reduced; ++c ) child_start[c+1] += child_start[c];
+		std::vector<std::pair<size_t,double> > children(child_start[reduced]);
+		std::vector<size_t> head (child_start.begin(),child_start.end()-1);
+		for( size_t n=0; n<index; ++n ) for_each_parent(n,[&]( size_t c, double w ) { children[head[c]++] = {n,w}; });
+		//
+		// Galerkin product P^T A P and the restricted right hand side P^T b, row by row of the reduced system
+		const double *diagonal = Lhs.get_diagonal();
+		const size_t *neighbor = Lhs.get_neighbors();
+		const double *neighbor_weight = Lhs.get_weights();
+		auto reduced_Lhs = m_factory->allocate_stencil_matrix(reduced,reduced,7);
+		auto reduced_rhs = m_factory->allocate_vector(reduced);
+		std::vector<std::vector<std::pair<size_t,double> > > thread_entries(m_parallel.get_thread_num());
+		m_parallel.for_each(reduced,[&]( size_t c, int tn ) {
+			auto &entries = thread_entries[tn];
+			entries.clear();
+			double b (0.0);
+			for( size_t q=child_start[c]; q<child_start[c+1]; ++q ) {
+				const size_t n = children[q].first;
+				const double wa = children[q].second;
+				b += wa * rhs->at(n);
+				for_each_parent(n,[&]( size_t cb, double wb ) { entries.push_back({cb,wa*diagonal[n]*wb}); });
+				for( int nq=0; nq<6; ++nq ) {
+					const double a = neighbor_weight[6*n+nq];
+					if( a ) for_each_parent(neighbor[6*n+nq],[&]( size_t cb, double wb ) { entries.push_back({cb,-wa*a*wb}); });
+				}
+			}
+			std::sort(entries.begin(),entries.end(),[]( const auto &x, const auto &y ) { return x.first < y.first; });
+			for( size_t q=0; q<entries.size(); ) {
+				double value (0.0);
+				const size_t column = entries[q].first;
+				for( ; q<entries.size() && entries[q].first == column; ++q ) value += entries[q].second;
+				if( value ) reduced_Lhs->add_to_element(c,column,value);
+			}
+			reduced_rhs->set(c,b);
+		});
+		//
+		std::vector<size_t> row_keys(reduced);
+		index_map->const_parallel_actives([&]( int i, int j, int k, const auto &it ) {
+			if( lower[it()] == it()) row_keys[reduced_index[it()]] = m_shape.encode(i,j,k);
+		});
+		console::dump( "Done. %zu unknowns reduced to %zu. Took %s\n", index, reduced, timer.stock("build_tall_cells").c_str());
+		console::write(get_argument_name()+"_reduced_ratio", index ? reduced / (double)index : 1.0);
+		RCMatrix_utility<size_t,double>::report(reduced_Lhs.get(),"Reduced Lhs");
+		//
+		// Solve the reduced linear system
+		timer.tick(); console::dump( "Solving the linear system...");
+		auto reduced_result = m_factory->allocate_vector(reduced);
+		m_solver->register_row_keys(row_keys);
+		auto status = m_solver->solve(reduced_Lhs.get(),reduced_rhs.get(),reduced_result.get());
+		console::write(get_argument_name()+"_number_projection_iteration", status.count);
+		RCMatrix_solver_interface<size_t,double>::write_result(get_argument_name()+"_linsolver",status,m_param.record_residual_history);
+		console::dump( "Done. Took %d iterations, Reresid=%e. Took %s\n", status.count, status.reresid, timer.stock("linsolve").c_str());
+		//
+		// Interpolate the pressure onto every cell
+		m_pressure.clear();
+		index_map->const_serial_actives([&](int i, int j, int k, const auto& it) {
+			double value (0.0);
+			for_each_parent(it(),[&]( size_t c, double w ) { value += w * reduced_result->at(c); });
+			m_pressure.set(i,j,k,value);
+		});
+		//
+		// Update the full velocity
+		timer.tick(); console::dump( "Updating the velocity...");
+		pressure_projection3::update_velocity(dt,m_dx,m_pressure,fluid,areas(),rhos(),velocity);
+		console::dump( "Done. Took %s\n", timer.stock("update_velocity").c_str());
+		//
+		console::dump( "<<< Projection done. Took %s.\n", timer.stock("projection").c_str());
+	}
+	//
+	virtual void configure( configuration &config ) override {
+		config.get_bool("SecondOrderAccurateFluid",m_param.second_order_accurate_fluid,"Whether to enforce second order accuracy");
+		config.get_bool("SecondOrderAccurateSolid",m_param.second_order_accurate_solid,"Whether to enforce second order accuracy for solid surfaces");
+		config.get_double("Gain",m_param.gain,"Rate for volume correction");
+		config.get_string("CurvatureStencil",m_param.curvature_stencil,"Stencil of the surface tension curvature (laplacian or fourth_order)");
+		config.get_unsigned("TallCellBand",m_param.band_width,"Distance in cells from the liquid surface and solids within which cells are kept uniform");
+		config.get_unsigned("TallCellMinLength",m_param.min_length,"Minimal number of cells merged into a tall cell");
+		config.get_unsigned("TallCellAxis",m_param.axis,"Axis along which cells are merged (usually the direction of gravity)");
+		config.get_bool("RecordResidualHistory",m_param.record_residual_history,"Write the residual of each linear solver iteration to the record directory");
+		config.set_default_bool("ReportProgress",false);
+	}
+	virtual void initialize( const shape3 &shape, double dx ) override {
+		//
+		m_shape = shape;
+		m_dx = dx;
+	}
+	//
+	virtual void post_initialize() override {
+		//
+		m_pressure.initialize(m_shape);
+		m_target_volume = m_current_volume = m_y_prev = 0.0;
+	}
+	virtual const array3<Real> * get_pressure() const override {
+		return &m_pressure;
+	}
+	//
+	struct Parameters {
+		//
+		double gain {1.0};
+		bool second_order_accurate_fluid {true};
+		bool second_order_accurate_solid {true};
+		std::string curvature_stencil {"laplacian"};
+		unsigned band_width {4};
+		unsigned min_length {3};
+		unsigned axis {1};
+		bool record_residual_history {false};
+	};
+	Parameters m_param;
+	//
+	shape3 m_shape;
+	double m_dx {0.0};
+	array3<Real> m_pressure{this};
+	//
+	macutility3_driver m_macutility{this,"macutility3"};
+	RCMatrix_factory_driver<size_t,double> m_factory{this,"RCMatrix"};
+	RCMatrix_solver_driver<size_t,double> m_solver{this,"pcg"};
+	parallel_driver m_parallel{this};
+	//
+	double m_target_volume {0.0};
+	double m_current_volume {0.0};
+	double m_y_prev {0.0};
+};
+//
+extern "C" module * create_instance() {
+	return new macadaptivepressuresolver3();
+}
+//
+extern "C" const char *license() {
+	return "MIT";
+}
+//
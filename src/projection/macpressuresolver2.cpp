@@ -31,6 +31,11 @@
 #include <shiokaze/visualizer/gridvisualizer2_interface.h>
 #include <shiokaze/projection/macproject2_interface.h>
 #include <shiokaze/rigidbody/rigidworld2_utility.h>
+#include <shiokaze/parallel/parallel_driver.h>
+#include <shiokaze/core/console.h>
+#include <shiokaze/core/filesystem.h>
+#include <shiokaze/math/RCMatrix_utility.h>
+#include "poisson_relaxation.h"
 #include <memory>
 //
 SHKZ_USING_NAMESPACE
@@ -142,13 +147,28 @@ protected:
 			});
 		}
 		//
-		auto Lhs = m_factory->allocate_matrix(index,index);
+		// The approximate projection relaxes directly on the stencil arrays instead of a matrix
+		const bool approximate = m_param.approximate.method != "none";
+		RCMatrix_ptr<size_t,double> Lhs;
+		std::vector<double> stencil_diagonal, stencil_weight;
+		std::vector<size_t> stencil_neighbor;
+		std::vector<char> color;
+		if( approximate ) {
+			stencil_diagonal.assign(index,0.0);
+			stencil_weight.assign(4*index,0.0);
+			stencil_neighbor.resize(4*index);
+			for( size_t n=0; n<stencil_neighbor.size(); ++n ) stencil_neighbor[n] = n / 4;
+			color.resize(index);
+		} else {
+			Lhs = m_factory->allocate_stencil_matrix(index,index,5);
+		}
 		auto rhs = m_factory->allocate_vector(index);
 		//
 		index_map->const_parallel_actives([&]( int i, int j, const auto &it, int tn ) {
 			//
 			size_t n_index = it();
 			rhs->set(n_index,0.0);
+			if( approximate ) color[n_index] = (i+j) % 2;
 			//
 			vec2i query[] = {vec2i(i+1,j),vec2i(i-1,j),vec2i(i,j+1),vec2i(i,j-1)};
 			vec2i face[] = {vec2i(i+1,j),vec2i(i,j),vec2i(i,j+1),vec2i(i,j)};
@@ -167,7 +187,12 @@ protected:
 							if( fluid(query[nq]) < 0.0 ) {
 								assert(index_map->active(query[nq]));
 								size_t m_index = index_map()(query[nq]);
-								Lhs->add_to_element(n_index,m_index,-value);
+								if( approximate ) {
+									stencil_neighbor[4*n_index+nq] = m_index;
+									stencil_weight[4*n_index+nq] = value;
+								} else {
+									Lhs->add_to_element(n_index,m_index,-value);
+								}
 							}
 							diagonal += value;
 						}
@@ -175,7 +200,8 @@ protected:
 					rhs->add(n_index,-sgn[nq]*area*velocity[dim](face[nq])/m_dx);
 				}
 			}
-			Lhs->add_to_element(n_index,n_index,diagonal);
+			if( approximate ) stencil_diagonal[n_index] = diagonal;
+			else Lhs->add_to_element(n_index,n_index,diagonal);
 		});
 		//
 		// Volume correction
@@ -192,22 +218,35 @@ protected:
 		}
 		//
 		if( m_param.warm_start ) {
-			// Tweak the linear system
 			if( ! m_prev_pressure ) {
 				m_prev_pressure = m_factory->allocate_vector(index);
 			} else {
 				m_prev_pressure->resize(index);
 			}
-			auto new_rhs = Lhs->multiply(m_prev_pressure.get());
-			rhs->subtract(new_rhs.get());
+			// Tweak the linear system
+			if( ! approximate ) {
+				auto new_rhs = Lhs->multiply(m_prev_pressure.get());
+				rhs->subtract(new_rhs.get());
+			}
 		}
 		//
 		// Solve the linear system
 		auto result = m_factory->allocate_vector(index);
-		m_solver->solve(Lhs.get(),rhs.get(),result.get());
-		//
+		if( approximate ) {
+			//
+			// The relaxation starts from the previous pressure directly
+			if( m_param.warm_start ) result->copy(m_prev_pressure.get());
+			poisson_relaxation<4> relaxation(index,stencil_diagonal.data(),stencil_neighbor.data(),stencil_weight.data(),color,m_parallel);
+			auto status = relaxation.solve(rhs.get(),result.get(),m_param.approximate);
+			console::write(get_argument_name()+"_number_projection_iteration", status.iterations);
+			console::write(get_argument_name()+"_max_divergence", status.max_residual);
+		} else {
+			if( m_param.dump_matrix ) dump_system(Lhs.get(),rhs.get());
+			auto status = m_solver->solve(Lhs.get(),rhs.get(),result.get());
+			RCMatrix_solver_interface<size_t,double>::write_result(get_argument_name()+"_linsolver",status,m_param.record_residual_history);
+			if( m_param.warm_start ) result->add(m_prev_pressure.get());
+		}
 		if( m_param.warm_start ) {
-			result->add(m_prev_pressure.get());
 			m_prev_pressure->copy(result.get());
 		}
 		//
@@ -255,9 +294,24 @@ protected:
 		config.get_bool("DrawPressure",m_param.draw_pressure,"Whether to draw pressure");
 		config.get_double("Gain",m_param.gain,"Rate for volume correction");
 		config.get_bool("WarmStart",m_param.warm_start,"Start from the solution of previous pressure");
+		config.get_bool("RecordResidualHistory",m_param.record_residual_history,"Write the residual of each linear solver iteration to the record directory");
+		config.get_bool("DumpMatrix",m_param.dump_matrix,"Write each linear system to the matrix directory for replaying in solver benchmarks");
+		config.get_string("ApproximateProjection",m_param.approximate.method,"Replace the linear solve with a fixed budget relaxation (none, sor or jacobi)");
+		config.get_unsigned("ApproximateIterations",m_param.approximate.max_iterations,"Maximal number of relaxation sweeps for the approximate projection");
+		config.get_double("ApproximateTimeBudget",m_param.approximate.time_budget,"Wall-clock budget of the approximate projection in milliseconds (0 for none)");
+		config.get_double("SORWeight",m_param.approximate.sor_weight,"Over-relaxation weight of the red-black SOR");
+		config.get_double("JacobiWeight",m_param.approximate.jacobi_weight,"Damping weight of the weighted Jacobi");
 		config.set_default_bool("ReportProgress",false);
 	}
 	//
+	// Write the system to the "matrix" directory, so that it can be replayed by linsolverbenchmark3-example
+	void dump_system( const RCMatrix_interface<size_t,double> *Lhs, const RCMatrix_vector_interface<size_t,double> *rhs ) {
+		const std::string directory = console::get_root_path().size() ? console::get_root_path()+"/matrix" : "matrix";
+		if( ! filesystem::is_exist(directory)) filesystem::create_directories(directory);
+		const std::string path = console::format_str("%s/pressure2_%d.dat",directory.c_str(),m_dump_count++);
+		if( ! RCMatrix_utility<size_t,double>::write_system(path,Lhs,rhs)) console::dump( "Failed to write the system to \"%s\"\n", path.c_str());
+	}
+	//
 	virtual void initialize( const shape2 &shape, double dx ) override {
 		//
 		m_shape = shape;
@@ -278,6 +332,9 @@ protected:
 		bool second_order_accurate_fluid {true};
 		bool second_order_accurate_solid {true};
 		bool warm_start {false};
+		poisson_relaxation<4>::Parameters approximate {"none"};
+		bool dump_matrix {false};
+		bool record_residual_history {false};
 	};
 	Parameters m_param;
 	//
@@ -289,11 +346,13 @@ protected:
 	gridvisualizer2_driver m_gridvisualizer{this,"gridvisualizer2"};
 	RCMatrix_factory_driver<size_t,double> m_factory{this,"RCMatrix"};
 	RCMatrix_solver_driver<size_t,double> m_solver{this,"pcg"};
+	parallel_driver m_parallel{this};
 	//
 	double m_assemble_time {0.0};
 	double m_target_volume {0.0};
 	double m_current_volume {0.0};
 	double m_y_prev {0.0};
+	unsigned m_dump_count {0};
 	//
 	RCMatrix_vector_ptr<size_t,double> m_prev_pressure;
 };
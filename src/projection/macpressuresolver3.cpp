@@ -31,9 +31,19 @@
 #include <shiokaze/utility/macutility3_interface.h>
 #include <shiokaze/projection/macproject3_interface.h>
 #include <shiokaze/rigidbody/rigidworld3_utility.h>
+#include <shiokaze/parallel/parallel_driver.h>
+#include <shiokaze/ordering/ordering_core.h>
 #include <shiokaze/core/console.h>
 #include <shiokaze/core/timer.h>
+#include <shiokaze/core/filesystem.h>
 #include <shiokaze/utility/utility.h>
+#include "poisson_operator3.h"
+#include "poisson_multigrid3.h"
+#include "poisson_schwarz3.h"
+#include "poisson_ordering3.h"
+#include "poisson_relaxation.h"
+#include "surface_tension3.h"
+#include "pressure_projection3.h"
 //
 SHKZ_USING_NAMESPACE
 //
@@ -87,30 +97,7 @@ protected:
 			timer.tick(); console::dump( "Computing surface tension force...");
 			double kappa = surface_tension;
 			//
-			// Compute curvature and store them into an array
-			shared_array3<Real> curvature(fluid.shape());
-			curvature->parallel_op([&]( int i, int j, int k, auto &it, int tn ) {
-				double value = (
-					+fluid(m_shape.clamp(i-1,j,k))+fluid(m_shape.clamp(i+1,j,k))
-					+fluid(m_shape.clamp(i,j-1,k))+fluid(m_shape.clamp(i,j+1,k))
-					+fluid(m_shape.clamp(i,j,k-1))+fluid(m_shape.clamp(i,j,k+1))
-					-6.0*fluid(i,j,k)
-				) / (m_dx*m_dx);
-				it.set(value);
-			});
-			//
-			velocity.parallel_actives([&](int dim, int i, int j, int k, auto &it, int tn ) {
-				double rho = rhos()[dim](i,j,k);
-				// Embed ordinary 2nd order surface tension force
-				if( rho && rho < 1.0 ) {
-					double sgn = fluid(m_shape.clamp(i,j,k)) < 0.0 ? -1.0 : 1.0;
-					double theta = sgn < 0 ? 1.0-rho : rho;
-					double face_c = 
-						theta*curvature()(m_shape.clamp(i,j,k))
-						+(1.0-theta)*curvature()(m_shape.clamp(i-(dim==0),j-(dim==1),k-(dim==2)));
-					it.increment( -sgn * dt / (m_dx*rho) * kappa * face_c );
-				}
-			});
+			surface_tension3::add_force(dt,kappa,fluid,rhos(),velocity,m_dx,m_param.curvature_stencil=="fourth_order",m_parallel);
 			console::dump( "Done. Took %s\n", timer.stock("surftension_force").c_str());
 		}
 		//
@@ -118,85 +105,62 @@ protected:
 		timer.tick(); console::dump( "Building the high-res linear system [Lhs] and [rhs]..." );
 		//
 		// Label cell indices
-		size_t index (0);
 		shared_array3<size_t> index_map(fluid.shape());
-		const auto mark_body = [&]( int i, int j, int k ) {
-			//
-			bool inside (false);
-			if( fluid(i,j,k) < 0.0 ) {
-				//
-				vec3i query[] = {vec3i(i+1,j,k),vec3i(i-1,j,k),vec3i(i,j+1,k),vec3i(i,j-1,k),vec3i(i,j,k+1),vec3i(i,j,k-1)};
-				vec3i face[] = {vec3i(i+1,j,k),vec3i(i,j,k),vec3i(i,j+1,k),vec3i(i,j,k),vec3i(i,j,k+1),vec3i(i,j,k)};
-				int direction[] = {0,0,1,1,2,2};
-				//
-				for( int nq=0; nq<6; nq++ ) {
-					if( ! m_shape.out_of_bounds(query[nq]) ) {
-						if( fluid(query[nq]) < 0.0 ) {
-							int dim = direction[nq];
-							if( areas()[dim](face[nq]) && rhos()[dim](face[nq]) ) {
-								inside = true;
-								break;
-							}
-						}
-					}
-				}
-			}
-			if( inside ) {
-				index_map->set(i,j,k,index++);
-			}
-		};
-		if( fluid.get_background_value() < 0.0 ) {
-			fluid.const_serial_all([&]( int i, int j, int k, const auto &it) {
-				mark_body(i,j,k);
-			});
-		} else {
-			fluid.const_serial_inside([&]( int i, int j, int k, const auto &it) {
-				mark_body(i,j,k);
+		const size_t index = pressure_projection3::mark_cells(fluid,areas(),rhos(),index_map());
+		//
+		// Relabel the unknowns in a cache friendly order
+		if( m_param.reorder != "none" && index ) {
+			timer.tick();
+			std::vector<vec3i> cells(index);
+			index_map->const_parallel_actives([&]( int i, int j, int k, const auto &it ) {
+				cells[it()] = vec3i(i,j,k);
 			});
+			std::vector<size_t> new_index;
+			if( m_param.reorder == "morton" ) new_index = poisson_ordering3::encoder(cells,m_shape,*m_morton.get(),m_parallel);
+			else if( m_param.reorder == "rcm" ) new_index = poisson_ordering3::reverse_cuthill_mckee(cells,index_map(),m_parallel);
+			else if( m_param.reorder == "tile" ) new_index = poisson_ordering3::tiled(cells,m_shape,m_param.reorder_tile_size,m_parallel);
+			else console::dump( "Unknown ordering %s. Keeping the original order...", m_param.reorder.c_str());
+			if( new_index.size()) {
+				index_map->parallel_actives([&]( auto &it ) {
+					it.set(new_index[it()]);
+				});
+			}
+			timer.stock("reorder_unknowns");
 		}
 		//
-		// Assemble the linear system for the Poisson equations for pressure solve
-		auto Lhs = m_factory->allocate_matrix(index,index);
+		// Assemble the linear system for the Poisson equations for pressure solve. The approximate
+		// projection relaxes directly on the stencil of the matrix-free operator.
+		const bool approximate = m_param.approximate.method != "none";
+		const bool matrix_free = (m_param.matrix_free && m_solver->supports_operator()) || approximate;
+		if( m_param.matrix_free && ! matrix_free ) {
+			console::dump( "The chosen linear solver does not accept matrix-free operators (use LinSolver=cg). Assembling a matrix instead...\n" );
+		}
+		RCMatrix_ptr<size_t,double> Lhs;
+		std::shared_ptr<poisson_operator3> Lhs_operator;
+		if( matrix_free ) Lhs_operator = std::make_shared<poisson_operator3>(index,*m_factory.get(),m_parallel);
+		else Lhs = m_factory->allocate_stencil_matrix(index,index,7);
+		const bool use_multigrid = matrix_free && ! approximate && m_param.preconditioner == "multigrid";
+		const bool use_schwarz = matrix_free && ! approximate && m_param.preconditioner == "schwarz";
+		std::vector<vec3i> positions(use_multigrid || use_schwarz ? index : 0);
+		std::vector<size_t> row_keys(matrix_free ? 0 : index);
+		std::vector<char> color(approximate ? index : 0);
 		auto rhs = m_factory->allocate_vector(index);
 		double assemble_time = utility::get_milliseconds();
 		//
-		index_map->const_parallel_actives([&]( int i, int j, int k, const auto &it, int tn ) {
-			//
-			size_t n_index = it();
-			rhs->set(n_index,0.0);
-			//
-			if( fluid(i,j,k) < 0.0 ) {
-				//
-				vec3i query[] = {vec3i(i+1,j,k),vec3i(i-1,j,k),vec3i(i,j+1,k),vec3i(i,j-1,k),vec3i(i,j,k+1),vec3i(i,j,k-1)};
-				vec3i face[] = {vec3i(i+1,j,k),vec3i(i,j,k),vec3i(i,j+1,k),vec3i(i,j,k),vec3i(i,j,k+1),vec3i(i,j,k)};
-				int direction[] = {0,0,1,1,2,2};
-				int sgn[] = {1,-1,1,-1,1,-1};
-				//
-				double diagonal = 0.0;
-				for( int nq=0; nq<6; nq++ ) {
-					int dim = direction[nq];
-					int qi(query[nq][0]), qj(query[nq][1]), qk(query[nq][2]);
-					int fi(face[nq][0]), fj(face[nq][1]), fk(face[nq][2]);
-					if( ! m_shape.out_of_bounds(query[nq]) ) {
-						double area = areas()[dim](face[nq]);
-						if( area ) {
-							double rho = rhos()[dim](face[nq]);
-							if( rho ) {
-								double value = dt*area/(m_dx*m_dx*rho);
-								if( fluid(query[nq]) < 0.0 ) {
-									assert(index_map->active(query[nq]));
-									size_t m_index = index_map()(query[nq]);
-									Lhs->add_to_element(n_index,m_index,-value);
-								}
-								diagonal += value;
-							}
-							rhs->add(n_index,-sgn[nq]*area*velocity[dim](face[nq])/m_dx);
-						}
-					}
-				}
-				Lhs->add_to_element(n_index,n_index,diagonal);
-			}
-		});
+		pressure_projection3::assemble(dt,m_dx,fluid,areas(),rhos(),velocity,index_map(),rhs.get(),
+			[&]( size_t n, int i, int j, int k ) {
+				if( use_multigrid || use_schwarz ) positions[n] = vec3i(i,j,k);
+				if( ! matrix_free ) row_keys[n] = m_shape.encode(i,j,k);
+				if( approximate ) color[n] = (i+j+k) % 2;
+			},
+			[&]( size_t n, int nq, size_t m, double value ) {
+				if( matrix_free ) Lhs_operator->set_neighbor(n,nq,m,value);
+				else Lhs->add_to_element(n,m,-value);
+			},
+			[&]( size_t n, double value ) {
+				if( matrix_free ) Lhs_operator->set_diagonal(n,value);
+				else Lhs->add_to_element(n,n,value);
+			});
 		//
 		console::dump( "Done. Took %s\n", timer.stock("build_highres_linsystem").c_str());
 		//
@@ -204,41 +168,104 @@ protected:
 		double rhs_correct = 0.0;
 		if( m_param.gain && m_target_volume ) {
 			timer.tick(); console::dump( "Computing volume correction...");
-			double x = (m_current_volume-m_target_volume)/m_target_volume;
-			double y = m_y_prev + x*dt; m_y_prev = y;
-			double kp = m_param.gain * 2.3/(25.0*0.01);
-			double ki = kp*kp/16.0;
-			rhs_correct = -(kp*x+ki*y)/(x+1.0);
-			rhs->for_each([&]( unsigned row, double &value ) {
-				value += rhs_correct;
-			});
+			rhs_correct = pressure_projection3::correct_volume(dt,m_param.gain,m_current_volume,m_target_volume,m_y_prev,rhs.get());
 			console::dump( "Done. Took %s\n", timer.stock("volume_correction").c_str());
 			console::write(get_argument_name()+"_volume_correct_rhs", rhs_correct);
 		}
 		//
-		RCMatrix_utility<size_t,double>::report(Lhs.get(),"Lhs");
+		if( ! matrix_free ) RCMatrix_utility<size_t,double>::report(Lhs.get(),"Lhs");
+		//
+		if( m_param.report_ordering && ! matrix_free ) {
+			timer.tick(); console::dump( "Measuring the matrix bandwidth and throughput (%s ordering)...", m_param.reorder.c_str());
+			auto report = poisson_ordering3::report(Lhs.get(),m_param.report_repeats);
+			console::dump( "Done. Took %s\n", timer.stock("report_ordering").c_str());
+			console::dump( "Bandwidth = %zu (average %.1f), SpMV = %.1f Mrows/s, IC(0) = %.1f Mrows/s\n",
+				report.bandwidth, report.average_bandwidth, report.spmv_throughput, report.ic_throughput );
+			console::write(get_argument_name()+"_bandwidth", report.bandwidth);
+			console::write(get_argument_name()+"_average_bandwidth", report.average_bandwidth);
+			console::write(get_argument_name()+"_spmv_throughput", report.spmv_throughput);
+			console::write(get_argument_name()+"_ic_throughput", report.ic_throughput);
+		}
 		//
+		RCMatrix_vector_ptr<size_t,double> initial_guess;
 		if( m_param.warm_start ) {
+			//
+			// Map the previous pressure through the current index_map. Cells that were not fluid in the
+			// previous step take the average of their previous fluid neighbors, or zero if there are none.
+			initial_guess = m_factory->allocate_vector(index);
+			index_map->const_parallel_actives([&]( int i, int j, int k, const auto &it ) {
+				double value (0.0);
+				if( m_pressure.active(i,j,k)) {
+					value = m_pressure(i,j,k);
+				} else {
+					double sum (0.0);
+					unsigned count (0);
+					const vec3i query[] = {vec3i(i+1,j,k),vec3i(i-1,j,k),vec3i(i,j+1,k),vec3i(i,j-1,k),vec3i(i,j,k+1),vec3i(i,j,k-1)};
+					for( const vec3i &q : query ) {
+						if( ! m_shape.out_of_bounds(q) && m_pressure.active(q)) {
+							sum += m_pressure(q);
+							++ count;
+						}
+					}
+					if( count ) value = sum / count;
+				}
+				initial_guess->set(it(),value);
+			});
+			//
 			// Tweak the linear system
-			if( ! m_prev_pressure ) {
-				m_prev_pressure = m_factory->allocate_vector(index);
+			RCMatrix_vector_ptr<size_t,double> new_rhs;
+			if( matrix_free ) {
+				new_rhs = m_factory->allocate_vector(index);
+				Lhs_operator->multiply(initial_guess.get(),new_rhs.get());
 			} else {
-				m_prev_pressure->resize(index);
+				new_rhs = Lhs->multiply(initial_guess.get());
 			}
-			auto new_rhs = Lhs->multiply(m_prev_pressure.get());
 			rhs->subtract(new_rhs.get());
 		}
 		//
+		// Build the preconditioner for the matrix-free operator
+		RCFixedMatrix_ptr<size_t,double> preconditioner;
+		if( use_multigrid ) {
+			timer.tick(); console::dump( "Building the multigrid hierarchy...");
+			auto multigrid = std::make_shared<poisson_multigrid3>(*Lhs_operator,std::move(positions),m_shape,m_parallel,m_param.multigrid);
+			console::dump( "Done. %u levels, %zu coarsest rows. Took %s\n", multigrid->get_level_count(), multigrid->get_coarsest_rows(), timer.stock("build_multigrid").c_str());
+			preconditioner = multigrid;
+		} else if( use_schwarz ) {
+			timer.tick(); console::dump( "Building the Schwarz subdomains...");
+			auto schwarz = std::make_shared<poisson_schwarz3>(*Lhs_operator,positions,m_parallel,m_param.schwarz);
+			console::dump( "Done. %zu subdomains, %zu rows at most. Took %s\n", schwarz->get_subdomain_count(), schwarz->get_max_subdomain_rows(), timer.stock("build_schwarz").c_str());
+			preconditioner = schwarz;
+		} else if( matrix_free && ! approximate && m_param.preconditioner == "jacobi" ) {
+			preconditioner = std::make_shared<poisson_jacobi3>(*Lhs_operator,m_parallel);
+		}
+		//
+		if( m_param.dump_matrix ) {
+			if( matrix_free ) console::dump( "Skipping the matrix dump since no matrix is assembled.\n" );
+			else dump_system(Lhs.get(),rhs.get());
+		}
+		//
 		// Solve the linear system
-		timer.tick(); console::dump( "Solving the linear system...");
 		auto result = m_factory->allocate_vector(index);
-		auto status = m_solver->solve(Lhs.get(),rhs.get(),result.get());
-		console::write(get_argument_name()+"_number_projection_iteration", status.count);
-		console::dump( "Done. Took %d iterations, Reresid=%e. Took %s\n", status.count, status.reresid, timer.stock("linsolve").c_str());
+		if( approximate ) {
+			timer.tick(); console::dump( "Relaxing the linear system (%s)...", m_param.approximate.method.c_str());
+			poisson_relaxation<6> relaxation(index,Lhs_operator->get_diagonal(),Lhs_operator->get_neighbors(),Lhs_operator->get_weights(),color,m_parallel);
+			auto status = relaxation.solve(rhs.get(),result.get(),m_param.approximate);
+			console::write(get_argument_name()+"_number_projection_iteration", status.iterations);
+			console::write(get_argument_name()+"_max_divergence", status.max_residual);
+			console::dump( "Done. Took %u iterations, max divergence=%e. Took %s\n", status.iterations, status.max_residual, timer.stock("relaxation").c_str());
+		} else {
+			timer.tick(); console::dump( "Solving the linear system...");
+			if( ! matrix_free ) m_solver->register_row_keys(row_keys);
+			auto status = matrix_free ?
+				m_solver->solve_operator(Lhs_operator.get(),preconditioner.get(),rhs.get(),result.get()) :
+				m_solver->solve(Lhs.get(),rhs.get(),result.get());
+			console::write(get_argument_name()+"_number_projection_iteration", status.count);
+			RCMatrix_solver_interface<size_t,double>::write_result(get_argument_name()+"_linsolver",status,m_param.record_residual_history);
+			console::dump( "Done. Took %d iterations, Reresid=%e. Took %s\n", status.count, status.reresid, timer.stock("linsolve").c_str());
+		}
 		//
 		if( m_param.warm_start ) {
-			result->add(m_prev_pressure.get());
-			m_prev_pressure->copy(result.get());
+			result->add(initial_guess.get());
 		}
 		//
 		// Re-arrange to the array
@@ -249,23 +276,7 @@ protected:
 		//
 		// Update the full velocity
 		timer.tick(); console::dump( "Updating the velocity...");
-		velocity.parallel_actives([&](int dim, int i, int j, int k, auto &it, int tn ) {
-			double rho = rhos()[dim](i,j,k);
-			vec3i pi(i,j,k);
-			if( areas()[dim](i,j,k) && rho ) {
-				if( pi[dim] == 0 || pi[dim] == velocity.shape()[dim] ) it.set(0.0);
-				else {
-					velocity[dim].subtract(i,j,k, dt * (
-						+ m_pressure(i,j,k)
-						- m_pressure(i-(dim==0),j-(dim==1),k-(dim==2))
-						) / (rho*m_dx));
-				}
-			} else {
-				if( pi[dim] == 0 && fluid(pi) < 0.0 ) it.set(0.0);
-				else if( pi[dim] == velocity.shape()[dim] && fluid(pi-vec3i(dim==0,dim==1,dim==2)) < 0.0 ) it.set(0.0);
-				else it.set_off();
-			}
-		});
+		pressure_projection3::update_velocity(dt,m_dx,m_pressure,fluid,areas(),rhos(),velocity);
 		console::dump( "Done. Took %s\n", timer.stock("update_velocity").c_str());
 		//
 		console::dump( "<<< Projection done. Took %s.\n", timer.stock("projection").c_str());
@@ -276,8 +287,38 @@ protected:
 		config.get_bool("SecondOrderAccurateSolid",m_param.second_order_accurate_solid,"Whether to enforce second order accuracy for solid surfaces");
 		config.get_double("Gain",m_param.gain,"Rate for volume correction");
 		config.get_bool("WarmStart",m_param.warm_start,"Start from the solution of previous pressure");
+		config.get_bool("MatrixFree",m_param.matrix_free,"Apply the Poisson operator without assembling a sparse matrix");
+		config.get_string("CurvatureStencil",m_param.curvature_stencil,"Stencil of the surface tension curvature (laplacian or fourth_order)");
+		config.get_string("MatrixFreePreconditioner",m_param.preconditioner,"Preconditioner for the matrix-free operator (none, jacobi, multigrid or schwarz)");
+		config.get_unsigned("MGMaxLevels",m_param.multigrid.max_levels,"Maximal number of multigrid levels");
+		config.get_unsigned("MGSmoothIterations",m_param.multigrid.smooth_iterations,"Number of red-black Gauss-Seidel sweeps before and after each coarse correction");
+		config.get_unsigned("MGCoarsestRows",m_param.multigrid.coarsest_rows,"Stop coarsening below this number of unknowns");
+		config.get_unsigned("MGCoarsestIterations",m_param.multigrid.coarsest_iterations,"Number of smoothing sweeps on the coarsest level");
+		config.get_double("MGCorrectionScale",m_param.multigrid.correction_scale,"Scaling of the coarse grid correction");
+		config.get_unsigned("SchwarzTileSize",m_param.schwarz.tile_size,"Tile size of the additive Schwarz subdomains");
+		config.get_unsigned("SchwarzOverlap",m_param.schwarz.overlap,"Number of overlap layers added to each Schwarz subdomain");
+		config.get_string("SchwarzLocalSolver",m_param.schwarz.local_solver,"Subdomain solver of the additive Schwarz preconditioner (ic or cholesky)");
+		config.get_string("Reorder",m_param.reorder,"Ordering of the unknowns (none, morton, rcm or tile)");
+		config.get_unsigned("ReorderTileSize",m_param.reorder_tile_size,"Tile size for the tile ordering");
+		config.get_bool("ReportOrdering",m_param.report_ordering,"Report the bandwidth and the SpMV and IC(0) throughputs of the matrix");
+		config.get_unsigned("ReportRepeats",m_param.report_repeats,"Number of repetitions to measure the throughputs");
+		config.get_bool("RecordResidualHistory",m_param.record_residual_history,"Write the residual of each linear solver iteration to the record directory");
+		config.get_bool("DumpMatrix",m_param.dump_matrix,"Write each linear system to the matrix directory for replaying in solver benchmarks");
+		config.get_string("ApproximateProjection",m_param.approximate.method,"Replace the linear solve with a fixed budget relaxation (none, sor or jacobi)");
+		config.get_unsigned("ApproximateIterations",m_param.approximate.max_iterations,"Maximal number of relaxation sweeps for the approximate projection");
+		config.get_double("ApproximateTimeBudget",m_param.approximate.time_budget,"Wall-clock budget of the approximate projection in milliseconds (0 for none)");
+		config.get_double("SORWeight",m_param.approximate.sor_weight,"Over-relaxation weight of the red-black SOR");
+		config.get_double("JacobiWeight",m_param.approximate.jacobi_weight,"Damping weight of the weighted Jacobi");
 		config.set_default_bool("ReportProgress",false);
 	}
+	//
+	// Write the system to the "matrix" directory, so that it can be replayed by linsolverbenchmark3-example
+	void dump_system( const RCMatrix_interface<size_t,double> *Lhs, const RCMatrix_vector_interface<size_t,double> *rhs ) {
+		const std::string directory = console::get_root_path().size() ? console::get_root_path()+"/matrix" : "matrix";
+		if( ! filesystem::is_exist(directory)) filesystem::create_directories(directory);
+		const std::string path = console::format_str("%s/pressure3_%d.dat",directory.c_str(),m_dump_count++);
+		if( ! RCMatrix_utility<size_t,double>::write_system(path,Lhs,rhs)) console::dump( "Failed to write the system to \"%s\"\n", path.c_str());
+	}
 	virtual void initialize( const shape3 &shape, double dx ) override {
 		//
 		m_shape = shape;
@@ -302,6 +343,18 @@ protected:
 		bool second_order_accurate_fluid {true};
 		bool second_order_accurate_solid {true};
 		bool warm_start {false};
+		bool matrix_free {false};
+		std::string curvature_stencil {"laplacian"};
+		std::string preconditioner {"jacobi"};
+		std::string reorder {"none"};
+		unsigned reorder_tile_size {8};
+		bool report_ordering {false};
+		unsigned report_repeats {10};
+		poisson_multigrid3::Parameters multigrid;
+		poisson_schwarz3::Parameters schwarz;
+		poisson_relaxation<6>::Parameters approximate {"none"};
+		bool dump_matrix {false};
+		bool record_residual_history {false};
 	};
 	Parameters m_param;
 	//
@@ -312,12 +365,13 @@ protected:
 	macutility3_driver m_macutility{this,"macutility3"};
 	RCMatrix_factory_driver<size_t,double> m_factory{this,"RCMatrix"};
 	RCMatrix_solver_driver<size_t,double> m_solver{this,"pcg"};
+	recursive_configurable_driver<ordering_core> m_morton{this,"zordering"};
+	parallel_driver m_parallel{this};
 	//
 	double m_target_volume {0.0};
 	double m_current_volume {0.0};
 	double m_y_prev {0.0};
-	//
-	RCMatrix_vector_ptr<size_t,double> m_prev_pressure;
+	unsigned m_dump_count {0};
 };
 //
 extern "C" module * create_instance() {
@@ -413,7 +413,8 @@ protected:
 			});
 			//
 			std::vector<double> compressed_result;
-			m_solver->solve(compressed_Lhs.get(),compressed_rhs,compressed_result);
+			auto status = m_solver->solve(compressed_Lhs.get(),compressed_rhs,compressed_result);
+			RCMatrix_solver_interface<size_t,double>::write_result(get_argument_name()+"_linsolver",status,m_param.record_residual_history);
 			//
 			if( m_param.diff_solve ) {
 				m_parallel.for_each(Lhs->rows(),[&]( size_t row ) {
@@ -562,7 +563,8 @@ protected:
 		//
 		// Solve the linear system
 		auto result = m_factory->allocate_vector();
-		m_solver->solve(Lhs.get(),rhs.get(),result.get());
+		auto status = m_solver->solve(Lhs.get(),rhs.get(),result.get());
+		RCMatrix_solver_interface<size_t,double>::write_result(get_argument_name()+"_volume_correction_linsolver",status,m_param.record_residual_history);
 		//
 		// Re-arrange to the array
 		pressure->clear();
@@ -605,6 +607,7 @@ protected:
 		config.get_bool("DrawStreamfunc",m_param.draw_streamfunc);
 		config.get_double("CorrectionGain",m_param.gain,"Volume correctino gain");
 		config.get_bool("DiffSolve",m_param.diff_solve,"Whether we should perform difference-based linear system solve");
+		config.get_bool("RecordResidualHistory",m_param.record_residual_history,"Write the residual of each linear solver iteration to the record directory");
 		config.set_default_bool("ReportProgress",false);
 	}
 	//
@@ -628,6 +631,7 @@ protected:
 		bool draw_streamfunc {true};
 		bool second_order_accurate_fluid {true};
 		bool second_order_accurate_solid {true};
+		bool record_residual_history {false};
 	};
 	Parameters m_param;
 	//
@@ -34,6 +34,7 @@
 #include <shiokaze/core/timer.h>
 #include <shiokaze/utility/utility.h>
 #include <numeric>
+#include <limits>
 //
 SHKZ_USING_NAMESPACE
 //
@@ -492,6 +493,10 @@ protected:
 			m_P = CZtCZ->add(DZtDZ.get());
 			//
 			console::dump( "Done. Took %s\n", timer.stock("buildmatrix_P").c_str());
+			//
+			timer.tick(); console::dump( "Computing the symbolic structure of [Lhs]...");
+			build_lhs_pattern(face_size);
+			console::dump( "Done. %zu entries, %zu terms. Took %s\n", m_pattern.column.size(), m_pattern.term_coef.size(), timer.stock("buildmatrix_symbolic").c_str());
 			console::dump( "<<< Done. Took %s\n", timer.stock("precompute_matrix").c_str());
 		}
 		//
@@ -507,46 +512,6 @@ protected:
 		});
 		console::dump("Done. Took %s\n", timer.stock("buildmatrix_iAF_iV").c_str());
 		//
-		// Hacked matrix operations
-		auto hacked_multiply = [&]( const RCMatrix_ptr<size_t,double> At, const RCMatrix_ptr<size_t,double> A,
-			const std::vector<Real> &diag, const std::vector<char> &invalidated, RCMatrix_ptr<size_t,double> result ) {
-			//
-			assert(diag.size()==A->rows());
-			result->initialize(At->rows(),A->columns());
-			//
-			// Run in parallel
-			m_parallel.for_each(At->rows(), [&]( size_t row ) {
-				if( ! invalidated[row] ) {
-					At->for_each(row,[&]( unsigned a_index, double a ) {
-						A->for_each(a_index,[&]( unsigned b_index, double b ) {
-							if( b_index < invalidated.size() && ! invalidated[b_index] ) {
-								result->add_to_element(row,b_index,diag[a_index]*a*b);
-							}
-						});
-					});
-				}
-			});
-		};
-		//
-		auto hacked_add = [&]( const RCMatrix_ptr<size_t,double> A, const RCMatrix_ptr<size_t,double> B, const RCMatrix_ptr<size_t,double> C, const std::vector<char> &invalidated, RCMatrix_ptr<size_t,double> result ) {
-			//
-			assert( A->rows() <= C->rows() && B->rows() <= C->rows() );
-			result->copy(C.get());
-			//
-			m_parallel.for_each(result->rows(),[&]( size_t row ) {
-				if( ! invalidated[row] ) {
-					if( row < A->rows() ) A->for_each(row,[&]( unsigned index, double value ) {
-						result->add_to_element(row,index,value);
-					});
-					if( row < B->rows() ) B->for_each(row,[&]( unsigned index, double value ) {
-						result->add_to_element(row,index,value);
-					});
-				} else {
-					result->clear(row);
-				}
-			});
-		};
-		//
 		// Mark invalidated matrix rows (completely surrounded by air)
 		timer.tick(); console::dump( "Invalidating edges...");
 		std::vector<char> invalidated_edges(m_CZ_t->rows(),0);
@@ -565,22 +530,8 @@ protected:
 		console::dump("Done. Invalidated %d edges. Took %s\n", num_invalidated, timer.stock("buildmatrix_invalidate").c_str());
 		console::write(get_argument_name()+"_buildmatrix_invalidate_num",num_invalidated);
 		//
-		auto L = m_factory->allocate_matrix(), R = m_factory->allocate_matrix();
-		//
-		timer.tick(); console::dump( "Computing [L] and [R]...");
-		std::vector<std::function<void()> > assemble_operations;
-		assemble_operations.push_back([&](){
-			hacked_multiply(m_CZ_t,m_CZ,iAF,invalidated_edges,L);
-		});
-		assemble_operations.push_back([&](){
-			hacked_multiply(m_DZ_t,m_DZ,iV,invalidated_edges,R);
-		});
-		m_parallel.run(assemble_operations);
-		console::dump("Done. Took %s\n", timer.stock("buildmatrix_L_and_R").c_str());
-		//
-		timer.tick(); console::dump( "Computing [Lhs] = [L]+[R]+[P]...");
-		auto Lhs = m_factory->allocate_matrix();
-		hacked_add(L,R,m_P,invalidated_edges,Lhs);
+		timer.tick(); console::dump( "Computing [Lhs] = [CZ]^T[iAF][CZ]+[DZ]^T[iV][DZ]+[P]...");
+		auto Lhs = assemble_lhs(iAF,iV,invalidated_edges);
 		console::dump("Done. Took %s\n", timer.stock("buildmatrix_Lhs").c_str());
 		//
 		// Compute intermediate full vorticity
@@ -655,7 +606,7 @@ protected:
 					compressed_index_map[row] = ++ compressed_index;
 				}
 			}
-			auto compressed_Lhs = m_factory->allocate_matrix(compressed_index,compressed_index);
+			auto compressed_Lhs = m_factory->allocate_stencil_matrix(compressed_index,compressed_index,m_pattern.max_row_size);
 			std::vector<double> compressed_rhs(compressed_index);
 			m_parallel.for_each(Lhs->rows(),[&]( size_t row ) {
 				size_t remap_row = compressed_index_map[row];
@@ -676,6 +627,7 @@ protected:
 			std::vector<double> compressed_result;
 			auto status = m_solver->solve(compressed_Lhs.get(),compressed_rhs,compressed_result);
 			console::write(get_argument_name()+"_number_projection_iteration", status.count);
+			RCMatrix_solver_interface<size_t,double>::write_result(get_argument_name()+"_linsolver",status,m_param.record_residual_history);
 			console::dump( "Done. Took %d iterations. Reresid=%e. Took %s\n", status.count, status.reresid, timer.stock("linsolve").c_str());
 			//
 			if( m_param.diff_solve ) {
@@ -844,6 +796,7 @@ protected:
 		auto result = m_factory->allocate_vector();
 		auto status = m_solver->solve(Lhs.get(),rhs.get(),result.get());
 		console::write(get_argument_name()+"_number_volume_correction_projection_iteration", status.count);
+		RCMatrix_solver_interface<size_t,double>::write_result(get_argument_name()+"_volume_correction_linsolver",status,m_param.record_residual_history);
 		console::dump( "Done. Took %d iterations. Took %s\n", status.count, timer.stock("linsolve").c_str());
 		//
 		// Re-arrange to the array
@@ -881,6 +834,7 @@ protected:
 		config.get_bool("SecondOrderAccurateSolid",m_param.second_order_accurate_solid,"Whether to enforce second order accuracy for solid surfaces");
 		config.get_double("CorrectionGain",m_param.gain,"Volume correctino gain");
 		config.get_bool("DiffSolve",m_param.diff_solve,"Whether we should perform difference-based linear system solve");
+		config.get_bool("RecordResidualHistory",m_param.record_residual_history,"Write the residual of each linear solver iteration to the record directory");
 	}
 	//
 	virtual void initialize( const shape3 &shape, double dx ) override {
@@ -905,6 +859,7 @@ protected:
 		bool diff_solve {true};
 		bool second_order_accurate_fluid {true};
 		bool second_order_accurate_solid {true};
+		bool record_residual_history {false};
 	};
 	Parameters m_param;
 	//
@@ -912,6 +867,97 @@ protected:
 	RCMatrix_solver_driver<size_t,double> m_solver{this,"pcg"};
 	RCMatrix_ptr<size_t,double> m_C, m_Ct, m_Z, m_CZ, m_CZ_t, m_DZ, m_DZ_t, m_P;
 	//
+	// Symbolic structure of [Lhs] = [CZ]^T[iAF][CZ]+[DZ]^T[iV][DZ]+[P]. Each entry keeps the value of [P]
+	// and the terms a*b of the two products, each with the index of the diagonal weight that scales it.
+	// Weights [0,face_size) refer to [iAF] and the rest refer to [iV].
+	struct lhs_pattern {
+		std::vector<size_t> rowstart;
+		std::vector<size_t> column;
+		std::vector<double> base;
+		std::vector<size_t> termstart;
+		std::vector<size_t> term_weight;
+		std::vector<double> term_coef;
+		size_t max_row_size {0};
+	};
+	lhs_pattern m_pattern;
+	//
+	void build_lhs_pattern( size_t face_size ) {
+		//
+		struct term { size_t column; size_t weight; double coef; };
+		const size_t rows = m_P->rows();
+		std::vector<std::vector<term> > row_terms(rows);
+		std::vector<std::vector<std::pair<size_t,double> > > row_base(rows);
+		m_parallel.for_each(rows,[&]( size_t row ) {
+			std::vector<term> &terms = row_terms[row];
+			const auto gather = [&]( const RCMatrix_ptr<size_t,double> &At, const RCMatrix_ptr<size_t,double> &A, size_t offset ) {
+				if( row < At->rows()) At->const_for_each(row,[&]( size_t a_index, double a ) {
+					A->const_for_each(a_index,[&]( size_t b_index, double b ) {
+						terms.push_back({b_index,offset+a_index,a*b});
+					});
+				});
+			};
+			gather(m_CZ_t,m_CZ,0);
+			gather(m_DZ_t,m_DZ,face_size);
+			std::stable_sort(terms.begin(),terms.end(),[]( const term &x, const term &y ) {
+				return x.column < y.column;
+			});
+			m_P->const_for_each(row,[&]( size_t column, double value ) {
+				row_base[row].push_back({column,value});
+			});
+		});
+		//
+		// Merge the product terms and the entries of [P] into the flattened structure
+		lhs_pattern &pattern = m_pattern;
+		pattern = lhs_pattern();
+		pattern.rowstart.resize(rows+1,0);
+		for( size_t row=0; row<rows; ++row ) {
+			const std::vector<term> &terms = row_terms[row];
+			const std::vector<std::pair<size_t,double> > &base = row_base[row];
+			size_t t (0), p (0);
+			while( t < terms.size() || p < base.size()) {
+				size_t column = std::numeric_limits<size_t>::max();
+				if( t < terms.size()) column = terms[t].column;
+				if( p < base.size()) column = std::min(column,base[p].first);
+				pattern.column.push_back(column);
+				pattern.termstart.push_back(pattern.term_weight.size());
+				pattern.base.push_back(p < base.size() && base[p].first == column ? base[p++].second : 0.0);
+				for( ; t < terms.size() && terms[t].column == column; ++t ) {
+					pattern.term_weight.push_back(terms[t].weight);
+					pattern.term_coef.push_back(terms[t].coef);
+				}
+			}
+			pattern.rowstart[row+1] = pattern.column.size();
+			pattern.max_row_size = std::max(pattern.max_row_size,pattern.rowstart[row+1]-pattern.rowstart[row]);
+			std::vector<term>().swap(row_terms[row]);
+		}
+		pattern.termstart.push_back(pattern.term_weight.size());
+	}
+	//
+	// Numeric phase that evaluates the symbolic structure with the current weights. Products are
+	// skipped on invalidated rows and columns, while entries of [P] are kept on valid rows.
+	RCMatrix_ptr<size_t,double> assemble_lhs( const std::vector<Real> &iAF, const std::vector<Real> &iV, const std::vector<char> &invalidated ) const {
+		//
+		const lhs_pattern &pattern = m_pattern;
+		const size_t rows = pattern.rowstart.size()-1;
+		const size_t face_size = iAF.size();
+		auto Lhs = m_factory->allocate_matrix(rows,m_P->columns());
+		m_parallel.for_each(rows,[&]( size_t row ) {
+			if( invalidated[row] ) return;
+			for( size_t n=pattern.rowstart[row]; n<pattern.rowstart[row+1]; ++n ) {
+				const size_t column = pattern.column[n];
+				double value = pattern.base[n];
+				if( column < invalidated.size() && ! invalidated[column] ) {
+					for( size_t t=pattern.termstart[n]; t<pattern.termstart[n+1]; ++t ) {
+						const size_t w = pattern.term_weight[t];
+						value += (w < face_size ? iAF[w] : iV[w-face_size]) * pattern.term_coef[t];
+					}
+				}
+				if( value ) Lhs->add_to_element(row,column,value);
+			}
+		});
+		return Lhs;
+	}
+	//
 	shape3 m_shape;
 	double m_dx {0.0};
 	std::vector<Real> m_vecpotential;
@@ -0,0 +1,257 @@
+/*
+**	poisson_multigrid3.h
+**
+**	This is part of Shiokaze, a research-oriented fluid solver for computer graphics.
+**	Created by Ryoichi Ando <rand@nii.ac.jp> on Oct 18, 2026.
+**
+**	Permission is hereby granted, free of charge, to any person obtaining a copy of
+**	this software and associated documentation files (the "Software"), to deal in
+**	the Software without restriction, including without limitation the rights to use,
+**	copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+**	Software, and to permit persons to whom the Software is furnished to do so,
+**	subject to the following conditions:
+**
+**	The above copyright notice and this permission notice shall be included in all copies
+**	or substantial portions of the Software.
+**
+**	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+**	INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+**	PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+**	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+**	CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+**	OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+//
+#ifndef SHKZ_POISSON_MULTIGRID3_H
+#define SHKZ_POISSON_MULTIGRID3_H
+//
+#include <shiokaze/array/array3.h>
+#include <shiokaze/math/RCMatrix_interface.h>
+#include <shiokaze/parallel/parallel_driver.h>
+#include "poisson_operator3.h"
+#include <vector>
+#include <limits>
+//
+SHKZ_BEGIN_NAMESPACE
+//
+// Geometric multigrid V-cycle for a poisson_operator3, used as a preconditioner for CG.
+// Coarse cells are 2x2x2 aggregates of fine cells labeled on sparse array3 levels, and coarse
+// operators are the Galerkin products of the piecewise constant prolongation. The ghost fluid
+// and solid face weights of the finest level therefore carry over to every level.
+// Smoothing is red-black Gauss-Seidel, with pre and post sweeps in reverse color order to keep the preconditioner symmetric.
+class poisson_multigrid3 : public RCFixedMatrix_interface<size_t,double> {
+public:
+	//
+	struct Parameters {
+		unsigned max_levels {16};
+		unsigned smooth_iterations {2};
+		unsigned coarsest_rows {512};
+		unsigned coarsest_iterations {32};
+		double correction_scale {1.8};
+	};
+	//
+	poisson_multigrid3( const poisson_operator3 &op, std::vector<vec3i> &&positions, const shape3 &shape, const parallel_driver &parallel, const Parameters &param ) :
+		m_op(op), m_parallel(parallel), m_param(param) {
+		//
+		m_levels.resize(1);
+		level3 &finest = m_levels[0];
+		finest.rows = op.rows();
+		finest.shape = shape;
+		finest.position = std::move(positions);
+		finest.diagonal = op.get_diagonal();
+		finest.neighbor = op.get_neighbors();
+		finest.weight = op.get_weights();
+		prepare(finest);
+		//
+		while( m_levels.size() < m_param.max_levels ) {
+			const level3 &fine = m_levels.back();
+			if( fine.rows <= m_param.coarsest_rows || fine.shape.w < 2 || fine.shape.h < 2 || fine.shape.d < 2 ) break;
+			level3 coarse;
+			coarsen(m_levels.back(),coarse);
+			if( coarse.rows == fine.rows ) break;
+			m_levels.push_back(std::move(coarse));
+		}
+	}
+	unsigned get_level_count() const {
+		return m_levels.size();
+	}
+	size_t get_coarsest_rows() const {
+		return m_levels.back().rows;
+	}
+	virtual void multiply( const RCMatrix_vector_interface<size_t,double> *rhs, RCMatrix_vector_interface<size_t,double> *result ) const override {
+		//
+		level3 &finest = m_levels[0];
+		const double *b = rhs->data();
+		if( b ) {
+			m_parallel.for_each(finest.rows,[&]( size_t row ) { finest.b[row] = b[row]; });
+		} else {
+			for( size_t row=0; row<finest.rows; ++row ) finest.b[row] = rhs->at(row);
+		}
+		vcycle(0);
+		result->resize(finest.rows);
+		double *x = result->data();
+		if( x ) {
+			m_parallel.for_each(finest.rows,[&]( size_t row ) { x[row] = finest.x[row]; });
+		} else {
+			for( size_t row=0; row<finest.rows; ++row ) result->set(row,finest.x[row]);
+		}
+	}
+	virtual RCMatrix_vector_ptr<size_t,double> allocate_vector( size_t size ) const override {
+		return m_op.allocate_vector(size);
+	}
+	virtual RCMatrix_ptr<size_t,double> allocate_matrix( size_t rows, size_t columns ) const override {
+		return m_op.allocate_matrix(rows,columns);
+	}
+	//
+private:
+	//
+	struct level3 {
+		size_t rows {0};
+		shape3 shape;
+		std::vector<vec3i> position;
+		std::vector<size_t> red, black;
+		std::vector<size_t> parent, children;
+		const double *diagonal {nullptr};
+		const size_t *neighbor {nullptr};
+		const double *weight {nullptr};
+		std::vector<double> own_diagonal, own_weight;
+		std::vector<size_t> own_neighbor;
+		std::vector<double> x, b, r;
+	};
+	//
+	void prepare( level3 &level ) const {
+		//
+		for( size_t row=0; row<level.rows; ++row ) {
+			const vec3i &pi = level.position[row];
+			if( (pi[0]+pi[1]+pi[2]) % 2 ) level.black.push_back(row);
+			else level.red.push_back(row);
+		}
+		level.x.resize(level.rows);
+		level.b.resize(level.rows);
+		level.r.resize(level.rows);
+	}
+	//
+	void coarsen( level3 &fine, level3 &coarse ) const {
+		//
+		const size_t unset = std::numeric_limits<size_t>::max();
+		coarse.shape = shape3((fine.shape.w+1)/2,(fine.shape.h+1)/2,(fine.shape.d+1)/2);
+		//
+		// Label coarse cells on a sparse grid
+		array3<size_t> index_map(coarse.shape);
+		fine.parent.resize(fine.rows);
+		for( size_t row=0; row<fine.rows; ++row ) {
+			const vec3i &pi = fine.position[row];
+			const vec3i ci (pi[0]/2,pi[1]/2,pi[2]/2);
+			if( ! index_map.active(ci)) {
+				index_map.set(ci,coarse.rows++);
+				coarse.position.push_back(ci);
+				coarse.children.insert(coarse.children.end(),8,unset);
+			}
+			const size_t parent = index_map(ci);
+			fine.parent[row] = parent;
+			coarse.children[8*parent+(pi[0]%2)+2*(pi[1]%2)+4*(pi[2]%2)] = row;
+		}
+		//
+		// Galerkin coarse operator of the piecewise constant prolongation
+		coarse.own_diagonal.resize(coarse.rows);
+		coarse.own_neighbor.resize(6*coarse.rows);
+		coarse.own_weight.resize(6*coarse.rows);
+		m_parallel.for_each(coarse.rows,[&]( size_t row ) {
+			double diagonal (0.0);
+			size_t *neighbor = coarse.own_neighbor.data()+6*row;
+			double *weight = coarse.own_weight.data()+6*row;
+			for( int nq=0; nq<6; ++nq ) {
+				neighbor[nq] = row;
+				weight[nq] = 0.0;
+			}
+			for( int n=0; n<8; ++n ) {
+				const size_t child = coarse.children[8*row+n];
+				if( child == unset ) continue;
+				diagonal += fine.diagonal[child];
+				for( int nq=0; nq<6; ++nq ) {
+					const double w = fine.weight[6*child+nq];
+					if( w ) {
+						const size_t parent = fine.parent[fine.neighbor[6*child+nq]];
+						if( parent == row ) diagonal -= w;
+						else {
+							neighbor[nq] = parent;
+							weight[nq] += w;
+						}
+					}
+				}
+			}
+			coarse.own_diagonal[row] = diagonal;
+		});
+		coarse.diagonal = coarse.own_diagonal.data();
+		coarse.neighbor = coarse.own_neighbor.data();
+		coarse.weight = coarse.own_weight.data();
+		prepare(coarse);
+	}
+	//
+	void sweep( level3 &level, const std::vector<size_t> &rows ) const {
+		//
+		m_parallel.for_each(rows.size(),[&]( size_t n ) {
+			const size_t row = rows[n];
+			const double diagonal = level.diagonal[row];
+			if( diagonal > 0.0 ) {
+				const size_t *neighbor = level.neighbor+6*row;
+				const double *weight = level.weight+6*row;
+				double value = level.b[row];
+				for( int nq=0; nq<6; ++nq ) value += weight[nq] * level.x[neighbor[nq]];
+				level.x[row] = value / diagonal;
+			}
+		});
+	}
+	//
+	void smooth( level3 &level, unsigned iterations, bool red_first ) const {
+		for( unsigned n=0; n<iterations; ++n ) {
+			sweep(level,red_first ? level.red : level.black);
+			sweep(level,red_first ? level.black : level.red);
+		}
+	}
+	//
+	void vcycle( unsigned depth ) const {
+		//
+		level3 &level = m_levels[depth];
+		m_parallel.for_each(level.rows,[&]( size_t row ) { level.x[row] = 0.0; });
+		if( depth+1 == m_levels.size()) {
+			smooth(level,m_param.coarsest_iterations,true);
+			smooth(level,m_param.coarsest_iterations,false);
+			return;
+		}
+		//
+		smooth(level,m_param.smooth_iterations,true);
+		m_parallel.for_each(level.rows,[&]( size_t row ) {
+			const size_t *neighbor = level.neighbor+6*row;
+			const double *weight = level.weight+6*row;
+			double value = level.b[row] - level.diagonal[row] * level.x[row];
+			for( int nq=0; nq<6; ++nq ) value += weight[nq] * level.x[neighbor[nq]];
+			level.r[row] = value;
+		});
+		//
+		level3 &coarse = m_levels[depth+1];
+		m_parallel.for_each(coarse.rows,[&]( size_t row ) {
+			double value (0.0);
+			for( int n=0; n<8; ++n ) {
+				const size_t child = coarse.children[8*row+n];
+				if( child != std::numeric_limits<size_t>::max()) value += level.r[child];
+			}
+			coarse.b[row] = value;
+		});
+		vcycle(depth+1);
+		m_parallel.for_each(level.rows,[&]( size_t row ) {
+			level.x[row] += m_param.correction_scale * coarse.x[level.parent[row]];
+		});
+		smooth(level,m_param.smooth_iterations,false);
+	}
+	//
+	const poisson_operator3 &m_op;
+	const parallel_driver &m_parallel;
+	Parameters m_param;
+	mutable std::vector<level3> m_levels;
+};
+//
+SHKZ_END_NAMESPACE
+//
+#endif
+//
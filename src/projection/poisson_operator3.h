@@ -0,0 +1,144 @@
+/*
+**	poisson_operator3.h
+**
+**	This is part of Shiokaze, a research-oriented fluid solver for computer graphics.
+**	Created by Ryoichi Ando <rand@nii.ac.jp> on Oct 18, 2026.
+**
+**	Permission is hereby granted, free of charge, to any person obtaining a copy of
+**	this software and associated documentation files (the "Software"), to deal in
+**	the Software without restriction, including without limitation the rights to use,
+**	copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+**	Software, and to permit persons to whom the Software is furnished to do so,
+**	subject to the following conditions:
+**
+**	The above copyright notice and this permission notice shall be included in all copies
+**	or substantial portions of the Software.
+**
+**	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+**	INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+**	PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+**	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+**	CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+**	OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+//
+#ifndef SHKZ_POISSON_OPERATOR3_H
+#define SHKZ_POISSON_OPERATOR3_H
+//
+#include <shiokaze/math/RCMatrix_interface.h>
+#include <shiokaze/parallel/parallel_driver.h>
+#include <vector>
+//
+SHKZ_BEGIN_NAMESPACE
+//
+// Matrix-free 7-point Poisson operator. Each row keeps its diagonal and up to six
+// off-diagonal face weights, so the Laplacian is applied without building a sparse matrix.
+// Missing neighbors point to the row itself with a zero weight.
+class poisson_operator3 : public RCFixedMatrix_interface<size_t,double> {
+public:
+	poisson_operator3( size_t rows, const RCMatrix_allocator_interface<size_t,double> &allocator, const parallel_driver &parallel ) :
+		m_rows(rows), m_allocator(allocator), m_parallel(parallel) {
+		//
+		m_diagonal.resize(m_rows);
+		m_neighbor.resize(6*m_rows);
+		m_weight.resize(6*m_rows);
+		m_parallel.for_each(m_rows,[&]( size_t row ) {
+			m_diagonal[row] = 0.0;
+			for( int nq=0; nq<6; ++nq ) {
+				m_neighbor[6*row+nq] = row;
+				m_weight[6*row+nq] = 0.0;
+			}
+		});
+	}
+	void set_diagonal( size_t row, double value ) {
+		m_diagonal[row] = value;
+	}
+	void set_neighbor( size_t row, int nq, size_t column, double value ) {
+		m_neighbor[6*row+nq] = column;
+		m_weight[6*row+nq] = value;
+	}
+	size_t rows() const { return m_rows; }
+	const double * get_diagonal() const { return m_diagonal.data(); }
+	const size_t * get_neighbors() const { return m_neighbor.data(); }
+	const double * get_weights() const { return m_weight.data(); }
+	//
+	virtual void multiply( const RCMatrix_vector_interface<size_t,double> *rhs, RCMatrix_vector_interface<size_t,double> *result ) const override {
+		//
+		result->resize(m_rows);
+		const double *x = rhs->data();
+		double *y = result->data();
+		if( x && y ) {
+			m_parallel.for_each(m_rows,[&]( size_t row ) {
+				const size_t *neighbor = m_neighbor.data()+6*row;
+				const double *weight = m_weight.data()+6*row;
+				double value = m_diagonal[row] * x[row];
+				for( int nq=0; nq<6; ++nq ) value -= weight[nq] * x[neighbor[nq]];
+				y[row] = value;
+			});
+		} else {
+			for( size_t row=0; row<m_rows; ++row ) {
+				double value = m_diagonal[row] * rhs->at(row);
+				for( int nq=0; nq<6; ++nq ) value -= m_weight[6*row+nq] * rhs->at(m_neighbor[6*row+nq]);
+				result->set(row,value);
+			}
+		}
+	}
+	virtual RCMatrix_vector_ptr<size_t,double> allocate_vector( size_t size ) const override {
+		return m_allocator.allocate_vector(size);
+	}
+	virtual RCMatrix_ptr<size_t,double> allocate_matrix( size_t rows, size_t columns ) const override {
+		return m_allocator.allocate_matrix(rows,columns);
+	}
+	//
+private:
+	//
+	size_t m_rows;
+	const RCMatrix_allocator_interface<size_t,double> &m_allocator;
+	const parallel_driver &m_parallel;
+	std::vector<double> m_diagonal;
+	std::vector<size_t> m_neighbor;
+	std::vector<double> m_weight;
+};
+//
+// Jacobi preconditioner that applies the inverse diagonal of a poisson_operator3
+class poisson_jacobi3 : public RCFixedMatrix_interface<size_t,double> {
+public:
+	poisson_jacobi3( const poisson_operator3 &op, const parallel_driver &parallel ) : m_op(op), m_parallel(parallel) {
+		//
+		const double *diagonal = m_op.get_diagonal();
+		m_inv_diagonal.resize(m_op.rows());
+		m_parallel.for_each(m_op.rows(),[&]( size_t row ) {
+			m_inv_diagonal[row] = diagonal[row] ? 1.0 / diagonal[row] : 1.0;
+		});
+	}
+	virtual void multiply( const RCMatrix_vector_interface<size_t,double> *rhs, RCMatrix_vector_interface<size_t,double> *result ) const override {
+		//
+		result->resize(m_inv_diagonal.size());
+		const double *x = rhs->data();
+		double *y = result->data();
+		if( x && y ) {
+			m_parallel.for_each(m_inv_diagonal.size(),[&]( size_t row ) {
+				y[row] = m_inv_diagonal[row] * x[row];
+			});
+		} else {
+			for( size_t row=0; row<m_inv_diagonal.size(); ++row ) result->set(row,m_inv_diagonal[row]*rhs->at(row));
+		}
+	}
+	virtual RCMatrix_vector_ptr<size_t,double> allocate_vector( size_t size ) const override {
+		return m_op.allocate_vector(size);
+	}
+	virtual RCMatrix_ptr<size_t,double> allocate_matrix( size_t rows, size_t columns ) const override {
+		return m_op.allocate_matrix(rows,columns);
+	}
+	//
+private:
+	//
+	const poisson_operator3 &m_op;
+	const parallel_driver &m_parallel;
+	std::vector<double> m_inv_diagonal;
+};
+//
+SHKZ_END_NAMESPACE
+//
+#endif
+//
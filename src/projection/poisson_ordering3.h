@@ -0,0 +1,269 @@
+/*
+**	poisson_ordering3.h
+**
+**	This is part of Shiokaze, a research-oriented fluid solver for computer graphics.
+**	Created by Ryoichi Ando <rand@nii.ac.jp> on Oct 18, 2026.
+**
+**	Permission is hereby granted, free of charge, to any person obtaining a copy of
+**	this software and associated documentation files (the "Software"), to deal in
+**	the Software without restriction, including without limitation the rights to use,
+**	copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+**	Software, and to permit persons to whom the Software is furnished to do so,
+**	subject to the following conditions:
+**
+**	The above copyright notice and this permission notice shall be included in all copies
+**	or substantial portions of the Software.
+**
+**	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+**	INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+**	PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+**	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+**	CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+**	OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+//
+//
+#ifndef SHKZ_POISSON_ORDERING3_H
+#define SHKZ_POISSON_ORDERING3_H
+//
+#include <shiokaze/array/array3.h>
+#include <shiokaze/ordering/ordering_core.h>
+#include <shiokaze/math/RCMatrix_interface.h>
+#include <shiokaze/parallel/parallel_driver.h>
+#include <shiokaze/utility/utility.h>
+#include <algorithm>
+#include <numeric>
+#include <vector>
+#include <limits>
+#include <cmath>
+//
+SHKZ_BEGIN_NAMESPACE
+//
+// Reorderings of the pressure unknowns. Each function takes the cell position of every unknown
+// and returns the new index of each unknown, so that index_map can be relabeled before assembly.
+class poisson_ordering3 {
+public:
+	//
+	// Sort the unknowns by the encoder of an ordering_core (e.g. zordering for the Morton curve)
+	static std::vector<size_t> encoder( const std::vector<vec3i> &positions, const shape3 &shape, const ordering_core &ordering, const parallel_driver &parallel ) {
+		//
+		const void *context = ordering.new_context(shape);
+		auto encode = ordering.get_encoder_func3(context);
+		std::vector<size_t> key(positions.size());
+		parallel.for_each(positions.size(),[&]( size_t n ) {
+			const vec3i &pi = positions[n];
+			key[n] = encode(context,pi[0],pi[1],pi[2]);
+		});
+		ordering.delete_context(context);
+		return sort_by_key(key);
+	}
+	//
+	// Group the unknowns into cubic tiles visited in x, y, z order, with a lexicographic order inside each tile
+	static std::vector<size_t> tiled( const std::vector<vec3i> &positions, const shape3 &shape, unsigned tile_size, const parallel_driver &parallel ) {
+		//
+		const size_t Z = std::max(1U,tile_size);
+		const size_t tw = (shape.w+Z-1)/Z, th = (shape.h+Z-1)/Z;
+		std::vector<size_t> key(positions.size());
+		parallel.for_each(positions.size(),[&]( size_t n ) {
+			const vec3i &pi = positions[n];
+			const size_t bi (pi[0]/Z), bj (pi[1]/Z), bk (pi[2]/Z);
+			const size_t tile = bi+tw*(bj+th*bk);
+			key[n] = tile*Z*Z*Z + (pi[0]-bi*Z)+Z*((pi[1]-bj*Z)+Z*(pi[2]-bk*Z));
+		});
+		return sort_by_key(key);
+	}
+	//
+	// Reverse Cuthill-McKee ordering on the 6-neighbor graph of the unknowns. Each connected
+	// component starts from a pseudo-peripheral node found by repeated breadth-first searches.
+	static std::vector<size_t> reverse_cuthill_mckee( const std::vector<vec3i> &positions, const array3<size_t> &index_map, const parallel_driver &parallel ) {
+		//
+		const size_t n_rows = positions.size();
+		const size_t none = std::numeric_limits<size_t>::max();
+		const shape3 shape = index_map.shape();
+		std::vector<size_t> neighbor(6*n_rows,none);
+		std::vector<unsigned char> degree(n_rows);
+		parallel.for_each(n_rows,[&]( size_t n ) {
+			const vec3i &pi = positions[n];
+			unsigned char count (0);
+			for( int nq=0; nq<6; ++nq ) {
+				const int dim = nq / 2;
+				vec3i q (pi); q[dim] += nq % 2 ? -1 : 1;
+				if( ! shape.out_of_bounds(q) && index_map.active(q)) {
+					neighbor[6*n+count++] = index_map(q);
+				}
+			}
+			degree[n] = count;
+		});
+		//
+		std::vector<size_t> order;
+		order.reserve(n_rows);
+		std::vector<size_t> level(n_rows,none);
+		std::vector<unsigned char> visited(n_rows,0);
+		//
+		// Breadth-first search from root that records levels, returning the last node of minimal degree in the deepest level
+		std::vector<size_t> queue, touched;
+		const auto search = [&]( size_t root, size_t &depth ) {
+			queue.clear(); queue.push_back(root);
+			level[root] = 0; touched.push_back(root);
+			for( size_t head=0; head<queue.size(); ++head ) {
+				const size_t n = queue[head];
+				for( unsigned k=0; k<degree[n]; ++k ) {
+					const size_t m = neighbor[6*n+k];
+					if( level[m] == none ) {
+						level[m] = level[n]+1;
+						queue.push_back(m);
+						touched.push_back(m);
+					}
+				}
+			}
+			depth = level[queue.back()];
+			size_t result (queue.back());
+			for( auto it=queue.rbegin(); it!=queue.rend() && level[*it]==depth; ++it ) {
+				if( degree[*it] < degree[result] ) result = *it;
+			}
+			for( size_t n : touched ) level[n] = none;
+			touched.clear();
+			return result;
+		};
+		//
+		for( size_t seed=0; seed<n_rows; ++seed ) {
+			if( visited[seed] ) continue;
+			//
+			// Find a pseudo-peripheral node
+			size_t root (seed), depth (0);
+			for( unsigned itr=0; itr<4; ++itr ) {
+				size_t new_depth;
+				const size_t candidate = search(root,new_depth);
+				if( itr && new_depth <= depth ) break;
+				depth = new_depth;
+				root = candidate;
+			}
+			//
+			// Cuthill-McKee sweep that visits neighbors in the order of increasing degree
+			size_t head = order.size();
+			order.push_back(root);
+			visited[root] = 1;
+			for( ; head<order.size(); ++head ) {
+				const size_t n = order[head];
+				const size_t begin = order.size();
+				for( unsigned k=0; k<degree[n]; ++k ) {
+					const size_t m = neighbor[6*n+k];
+					if( ! visited[m] ) {
+						visited[m] = 1;
+						order.push_back(m);
+					}
+				}
+				std::sort(order.begin()+begin,order.end(),[&]( size_t a, size_t b ) {
+					return degree[a] < degree[b];
+				});
+			}
+		}
+		//
+		std::vector<size_t> result(n_rows);
+		parallel.for_each(n_rows,[&]( size_t k ) {
+			result[order[k]] = n_rows-1-k;
+		});
+		return result;
+	}
+	//
+	struct Report {
+		size_t bandwidth {0};
+		double average_bandwidth {0.0};
+		double spmv_throughput {0.0};
+		double ic_throughput {0.0};
+	};
+	//
+	// Measure the bandwidth of a matrix, and the throughputs in million rows per second of the
+	// sparse matrix-vector product and of the forward and backward substitutions of IC(0)
+	static Report report( const RCMatrix_interface<size_t,double> *matrix, unsigned repeats ) {
+		//
+		Report result;
+		const size_t n_rows = matrix->rows();
+		if( ! n_rows ) return result;
+		repeats = std::max(1U,repeats);
+		//
+		std::vector<size_t> lower_start(n_rows+1,0), upper_start(n_rows+1,0);
+		std::vector<size_t> lower_index, upper_index;
+		std::vector<double> lower_value, upper_value, diagonal(n_rows,0.0);
+		double bandwidth_sum (0.0);
+		size_t entries (0);
+		for( size_t row=0; row<n_rows; ++row ) {
+			matrix->const_for_each(row,[&]( size_t column, double value ) {
+				const size_t distance = row > column ? row-column : column-row;
+				result.bandwidth = std::max(result.bandwidth,distance);
+				bandwidth_sum += distance;
+				++ entries;
+				if( column < row ) {
+					lower_index.push_back(column);
+					lower_value.push_back(value);
+				} else if( column > row ) {
+					upper_index.push_back(column);
+					upper_value.push_back(value);
+				} else {
+					diagonal[row] = value;
+				}
+			});
+			lower_start[row+1] = lower_index.size();
+			upper_start[row+1] = upper_index.size();
+		}
+		result.average_bandwidth = entries ? bandwidth_sum / entries : 0.0;
+		//
+		// Sparse matrix-vector product
+		auto fixed = matrix->make_fixed();
+		auto x = matrix->allocate_vector(n_rows);
+		auto y = matrix->allocate_vector(n_rows);
+		x->parallel_for_each([&]( size_t row, double &value ) { value = 1.0; });
+		fixed->multiply(x.get(),y.get());
+		double time = utility::get_milliseconds();
+		for( unsigned n=0; n<repeats; ++n ) fixed->multiply(x.get(),y.get());
+		time = utility::get_milliseconds()-time;
+		result.spmv_throughput = time ? n_rows * repeats / (1e3 * time) : 0.0;
+		//
+		// IC(0) factorization. The 7-point stencil graph has no triangles, so only the diagonal changes
+		std::vector<double> d(n_rows);
+		for( size_t row=0; row<n_rows; ++row ) {
+			double value = diagonal[row];
+			for( size_t k=lower_start[row]; k<lower_start[row+1]; ++k ) {
+				value -= lower_value[k] * lower_value[k] / d[lower_index[k]];
+			}
+			d[row] = value > 0.0 ? value : (diagonal[row] ? diagonal[row] : 1.0);
+		}
+		std::vector<double> r(n_rows,1.0), w(n_rows), z(n_rows);
+		time = utility::get_milliseconds();
+		for( unsigned n=0; n<repeats; ++n ) {
+			for( size_t row=0; row<n_rows; ++row ) {
+				double value = r[row];
+				for( size_t k=lower_start[row]; k<lower_start[row+1]; ++k ) value -= lower_value[k] * w[lower_index[k]];
+				w[row] = value / d[row];
+			}
+			for( size_t row=n_rows; row-- > 0; ) {
+				double value = 0.0;
+				for( size_t k=upper_start[row]; k<upper_start[row+1]; ++k ) value += upper_value[k] * z[upper_index[k]];
+				z[row] = w[row] - value / d[row];
+			}
+		}
+		time = utility::get_milliseconds()-time;
+		result.ic_throughput = time ? n_rows * repeats / (1e3 * time) : 0.0;
+		//
+		return result;
+	}
+	//
+private:
+	//
+	static std::vector<size_t> sort_by_key( const std::vector<size_t> &key ) {
+		//
+		std::vector<size_t> order(key.size());
+		std::iota(order.begin(),order.end(),0);
+		std::sort(order.begin(),order.end(),[&]( size_t a, size_t b ) {
+			return key[a] < key[b] || (key[a] == key[b] && a < b);
+		});
+		std::vector<size_t> result(key.size());
+		for( size_t k=0; k<order.size(); ++k ) result[order[k]] = k;
+		return result;
+	}
+};
+//
+SHKZ_END_NAMESPACE
+//
+#endif
+//
@@ -0,0 +1,134 @@
+/*
+**	poisson_relaxation.h
+**
+**	This is part of Shiokaze, a research-oriented fluid solver for computer graphics.
+**	Created by Ryoichi Ando <rand@nii.ac.jp> on Oct 18, 2026.
+**
+**	Permission is hereby granted, free of charge, to any person obtaining a copy of
+**	this software and associated documentation files (the "Software"), to deal in
+**	the Software without restriction, including without limitation the rights to use,
+**	copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+**	Software, and to permit persons to whom the Software is furnished to do so,
+**	subject to the following conditions:
+**
+**	The above copyright notice and this permission notice shall be included in all copies
+**	or substantial portions of the Software.
+**
+**	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+**	INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+**	PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+**	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+**	CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+**	OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+//
+//
+#ifndef SHKZ_POISSON_RELAXATION_H
+#define SHKZ_POISSON_RELAXATION_H
+//
+#include <shiokaze/math/RCMatrix_interface.h>
+#include <shiokaze/parallel/parallel_driver.h>
+#include <shiokaze/utility/utility.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <cmath>
+//
+SHKZ_BEGIN_NAMESPACE
+//
+// Fixed budget relaxation of a Poisson stencil stored as a diagonal and W neighbor weights per row
+// (missing neighbors point to the row itself with a zero weight), for fast approximate projections.
+// Rows are colored by the parity of their cell, so that each half sweep of the red-black SOR only
+// reads rows of the other color and runs in parallel.
+template <unsigned W> class poisson_relaxation {
+public:
+	//
+	struct Parameters {
+		std::string method {"sor"};
+		unsigned max_iterations {50};
+		double time_budget {0.0};
+		double sor_weight {1.7};
+		double jacobi_weight {0.8};
+	};
+	//
+	struct Result {
+		unsigned iterations {0};
+		double max_residual {0.0};
+	};
+	//
+	poisson_relaxation( size_t rows, const double *diagonal, const size_t *neighbor, const double *weight, const std::vector<char> &color, const parallel_driver &parallel ) :
+		m_rows(rows), m_diagonal(diagonal), m_neighbor(neighbor), m_weight(weight), m_parallel(parallel) {
+		//
+		for( size_t row=0; row<m_rows; ++row ) m_colored[color[row] ? 1 : 0].push_back(row);
+	}
+	//
+	// Run sweeps from the content of x (or zero if sized differently) until the iteration count or the
+	// time budget (in milliseconds, zero for none) is exhausted, and return the maximal residual
+	Result solve( const RCMatrix_vector_interface<size_t,double> *b, RCMatrix_vector_interface<size_t,double> *x, const Parameters &param ) const {
+		//
+		Result result;
+		std::vector<double> rhs, value, next;
+		b->convert_to(rhs);
+		if( x->size() == m_rows ) x->convert_to(value);
+		else value.assign(m_rows,0.0);
+		if( param.method == "jacobi" ) next.resize(m_rows);
+		const double start = utility::get_milliseconds();
+		//
+		for( ; result.iterations<param.max_iterations; ++result.iterations ) {
+			if( param.time_budget && utility::get_milliseconds()-start >= param.time_budget ) break;
+			if( param.method == "jacobi" ) {
+				for_each_block(m_rows,[&]( size_t row ) {
+					next[row] = value[row] + param.jacobi_weight * residual(rhs,value,row) / m_diagonal[row];
+				});
+				value.swap(next);
+			} else {
+				for( const auto &rows : m_colored ) {
+					for_each_block(rows.size(),[&]( size_t n ) {
+						const size_t row = rows[n];
+						value[row] += param.sor_weight * residual(rhs,value,row) / m_diagonal[row];
+					});
+				}
+			}
+		}
+		//
+		const size_t block_size (1024);
+		std::vector<double> block_max((m_rows+block_size-1)/block_size,0.0);
+		m_parallel.for_each(block_max.size(),[&]( size_t block ) {
+			const size_t end = std::min(m_rows,(block+1)*block_size);
+			for( size_t row=block*block_size; row<end; ++row ) block_max[block] = std::max(block_max[block],std::abs(residual(rhs,value,row)));
+		});
+		for( const double &v : block_max ) result.max_residual = std::max(result.max_residual,v);
+		x->convert_from(value);
+		return result;
+	}
+	//
+private:
+	//
+	double residual( const std::vector<double> &rhs, const std::vector<double> &value, size_t row ) const {
+		const size_t *neighbor = m_neighbor+W*row;
+		const double *weight = m_weight+W*row;
+		double Ax = m_diagonal[row] * value[row];
+		for( unsigned nq=0; nq<W; ++nq ) Ax -= weight[nq] * value[neighbor[nq]];
+		return rhs[row] - Ax;
+	}
+	//
+	template <class F> void for_each_block( size_t size, F func ) const {
+		const size_t block_size (1024);
+		m_parallel.for_each((size+block_size-1)/block_size,[&]( size_t block ) {
+			const size_t end = std::min(size,(block+1)*block_size);
+			for( size_t n=block*block_size; n<end; ++n ) func(n);
+		});
+	}
+	//
+	size_t m_rows;
+	const double *m_diagonal;
+	const size_t *m_neighbor;
+	const double *m_weight;
+	const parallel_driver &m_parallel;
+	std::vector<size_t> m_colored[2];
+};
+//
+SHKZ_END_NAMESPACE
+//
+#endif
+//
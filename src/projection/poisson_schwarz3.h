@@ -0,0 +1,295 @@
+/*
+**	poisson_schwarz3.h
+**
+**	This is part of Shiokaze, a research-oriented fluid solver for computer graphics.
+**	Created by Ryoichi Ando <rand@nii.ac.jp> on Oct 18, 2026.
+**
+**	Permission is hereby granted, free of charge, to any person obtaining a copy of
+**	this software and associated documentation files (the "Software"), to deal in
+**	the Software without restriction, including without limitation the rights to use,
+**	copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+**	Software, and to permit persons to whom the Software is furnished to do so,
+**	subject to the following conditions:
+**
+**	The above copyright notice and this permission notice shall be included in all copies
+**	or substantial portions of the Software.
+**
+**	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+**	INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+**	PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+**	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+**	CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+**	OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+//
+//
+#ifndef SHKZ_POISSON_SCHWARZ3_H
+#define SHKZ_POISSON_SCHWARZ3_H
+//
+#include <shiokaze/math/RCMatrix_interface.h>
+#include <shiokaze/math/shape.h>
+#include <shiokaze/parallel/parallel_driver.h>
+#include "poisson_operator3.h"
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+//
+SHKZ_BEGIN_NAMESPACE
+//
+// Additive Schwarz preconditioner for a poisson_operator3, used as a preconditioner for CG.
+// Unknowns are partitioned into tile aligned subdomains that are grown by a number of overlap
+// layers along the operator stencil. Each subdomain keeps its own block of the operator, factored
+// either by an incomplete Cholesky (IC0) or a dense Cholesky, and all the subdomains are solved
+// concurrently. Restrictions and prolongations are both scaled by one over the square root of the
+// number of subdomains sharing a row, which keeps the preconditioner symmetric without over correcting the overlap.
+class poisson_schwarz3 : public RCFixedMatrix_interface<size_t,double> {
+public:
+	//
+	struct Parameters {
+		unsigned tile_size {8};
+		unsigned overlap {1};
+		std::string local_solver {"ic"};
+	};
+	//
+	poisson_schwarz3( const poisson_operator3 &op, const std::vector<vec3i> &positions, const parallel_driver &parallel, const Parameters &param ) :
+		m_op(op), m_parallel(parallel), m_param(param) {
+		//
+		m_rows = op.rows();
+		m_dense = m_param.local_solver == "cholesky";
+		partition(positions);
+		m_parallel.for_each(m_subdomains.size(),[&]( size_t n ) {
+			grow(m_subdomains[n]);
+			if( m_dense ) factorize_dense(m_subdomains[n]);
+			else factorize_ic(m_subdomains[n]);
+		});
+		connect();
+	}
+	size_t get_subdomain_count() const {
+		return m_subdomains.size();
+	}
+	size_t get_max_subdomain_rows() const {
+		size_t result (0);
+		for( const auto &subdomain : m_subdomains ) result = std::max(result,subdomain.rows.size());
+		return result;
+	}
+	virtual void multiply( const RCMatrix_vector_interface<size_t,double> *rhs, RCMatrix_vector_interface<size_t,double> *result ) const override {
+		//
+		const double *b = rhs->data();
+		if( ! b ) {
+			m_rhs.resize(m_rows);
+			for( size_t row=0; row<m_rows; ++row ) m_rhs[row] = rhs->at(row);
+			b = m_rhs.data();
+		}
+		m_parallel.for_each(m_subdomains.size(),[&]( size_t n ) {
+			const subdomain3 &subdomain = m_subdomains[n];
+			double *x = m_solution.data()+subdomain.offset;
+			for( size_t i=0; i<subdomain.rows.size(); ++i ) x[i] = m_scale[subdomain.rows[i]] * b[subdomain.rows[i]];
+			if( m_dense ) solve_dense(subdomain,x);
+			else solve_ic(subdomain,x);
+		});
+		result->resize(m_rows);
+		double *y = result->data();
+		auto gather = [&]( size_t row ) {
+			double value (0.0);
+			for( size_t n=m_contribution_start[row]; n<m_contribution_start[row+1]; ++n ) value += m_solution[m_contribution[n]];
+			return m_scale[row] * value;
+		};
+		if( y ) {
+			m_parallel.for_each(m_rows,[&]( size_t row ) { y[row] = gather(row); });
+		} else {
+			for( size_t row=0; row<m_rows; ++row ) result->set(row,gather(row));
+		}
+	}
+	virtual RCMatrix_vector_ptr<size_t,double> allocate_vector( size_t size ) const override {
+		return m_op.allocate_vector(size);
+	}
+	virtual RCMatrix_ptr<size_t,double> allocate_matrix( size_t rows, size_t columns ) const override {
+		return m_op.allocate_matrix(rows,columns);
+	}
+	//
+private:
+	//
+	struct subdomain3 {
+		std::vector<size_t> rows;
+		size_t offset {0};
+		std::vector<unsigned> neighbor;
+		std::vector<double> weight;
+		std::vector<double> inv_pivot;
+		std::vector<double> factor;
+	};
+	//
+	// Group the rows by the tile that contains their cell
+	void partition( const std::vector<vec3i> &positions ) {
+		//
+		const int T = std::max(1u,m_param.tile_size);
+		vec3i tiles;
+		for( const auto &pi : positions ) for( int dim : DIMS3 ) tiles[dim] = std::max(tiles[dim],pi[dim]/T+1);
+		std::vector<int> tile_index(tiles[0]*tiles[1]*tiles[2],-1);
+		for( size_t row=0; row<m_rows; ++row ) {
+			const vec3i &pi = positions[row];
+			int &n = tile_index[pi[0]/T+tiles[0]*(pi[1]/T+tiles[1]*(pi[2]/T))];
+			if( n < 0 ) {
+				n = m_subdomains.size();
+				m_subdomains.emplace_back();
+			}
+			m_subdomains[n].rows.push_back(row);
+		}
+	}
+	//
+	// Add overlap layers and build the local block of the operator. Couplings to rows
+	// outside of the subdomain are dropped, which amounts to a zero Dirichlet condition.
+	void grow( subdomain3 &subdomain ) const {
+		//
+		const size_t *neighbor = m_op.get_neighbors();
+		const double *weight = m_op.get_weights();
+		std::unordered_set<size_t> member(subdomain.rows.begin(),subdomain.rows.end());
+		std::vector<size_t> front (subdomain.rows), next;
+		for( unsigned layer=0; layer<m_param.overlap; ++layer ) {
+			next.clear();
+			for( size_t row : front ) for( int nq=0; nq<6; ++nq ) {
+				if( weight[6*row+nq] && member.insert(neighbor[6*row+nq]).second ) next.push_back(neighbor[6*row+nq]);
+			}
+			subdomain.rows.insert(subdomain.rows.end(),next.begin(),next.end());
+			front.swap(next);
+		}
+		std::sort(subdomain.rows.begin(),subdomain.rows.end());
+		//
+		const size_t n = subdomain.rows.size();
+		std::unordered_map<size_t,unsigned> local;
+		for( unsigned i=0; i<n; ++i ) local[subdomain.rows[i]] = i;
+		subdomain.neighbor.resize(6*n);
+		subdomain.weight.resize(6*n);
+		for( unsigned i=0; i<n; ++i ) {
+			const size_t row = subdomain.rows[i];
+			for( int nq=0; nq<6; ++nq ) {
+				auto it = local.find(neighbor[6*row+nq]);
+				const bool inside = weight[6*row+nq] && it != local.end();
+				subdomain.neighbor[6*i+nq] = inside ? it->second : i;
+				subdomain.weight[6*i+nq] = inside ? weight[6*row+nq] : 0.0;
+			}
+		}
+	}
+	//
+	// Incomplete Cholesky with no fill, stored as the pivots of (D+L) D^-1 (D+U)
+	void factorize_ic( subdomain3 &subdomain ) const {
+		//
+		const double *diagonal = m_op.get_diagonal();
+		const size_t n = subdomain.rows.size();
+		subdomain.inv_pivot.resize(n);
+		for( unsigned i=0; i<n; ++i ) {
+			const double a = diagonal[subdomain.rows[i]];
+			double pivot (a);
+			for( int nq=0; nq<6; ++nq ) {
+				const unsigned k = subdomain.neighbor[6*i+nq];
+				const double w = subdomain.weight[6*i+nq];
+				if( k < i ) pivot -= w * w * subdomain.inv_pivot[k];
+			}
+			if( pivot < 1e-6 * a ) pivot = a;
+			subdomain.inv_pivot[i] = pivot ? 1.0 / pivot : 1.0;
+		}
+	}
+	void solve_ic( const subdomain3 &subdomain, double *x ) const {
+		//
+		const size_t n = subdomain.rows.size();
+		for( unsigned i=0; i<n; ++i ) {
+			double value = x[i];
+			for( int nq=0; nq<6; ++nq ) {
+				const unsigned k = subdomain.neighbor[6*i+nq];
+				if( k < i ) value += subdomain.weight[6*i+nq] * x[k];
+			}
+			x[i] = value * subdomain.inv_pivot[i];
+		}
+		for( unsigned i=n; i-- > 0; ) {
+			double value (0.0);
+			for( int nq=0; nq<6; ++nq ) {
+				const unsigned k = subdomain.neighbor[6*i+nq];
+				if( k > i ) value += subdomain.weight[6*i+nq] * x[k];
+			}
+			x[i] += value * subdomain.inv_pivot[i];
+		}
+	}
+	//
+	// Dense Cholesky of the local block, meant for small tiles
+	void factorize_dense( subdomain3 &subdomain ) const {
+		//
+		const double *diagonal = m_op.get_diagonal();
+		const size_t n = subdomain.rows.size();
+		std::vector<double> &L = subdomain.factor;
+		L.assign(n*n,0.0);
+		for( unsigned i=0; i<n; ++i ) {
+			L[i*n+i] = diagonal[subdomain.rows[i]];
+			for( int nq=0; nq<6; ++nq ) {
+				const unsigned k = subdomain.neighbor[6*i+nq];
+				if( k != i ) L[i*n+k] -= subdomain.weight[6*i+nq];
+			}
+		}
+		for( unsigned j=0; j<n; ++j ) {
+			const double a = L[j*n+j];
+			double pivot (a);
+			for( unsigned k=0; k<j; ++k ) pivot -= L[j*n+k] * L[j*n+k];
+			if( pivot < 1e-12 * a || pivot <= 0.0 ) pivot = a > 0.0 ? a : 1.0;
+			const double d = std::sqrt(pivot);
+			L[j*n+j] = d;
+			for( unsigned i=j+1; i<n; ++i ) {
+				double value = L[i*n+j];
+				for( unsigned k=0; k<j; ++k ) value -= L[i*n+k] * L[j*n+k];
+				L[i*n+j] = value / d;
+			}
+		}
+	}
+	void solve_dense( const subdomain3 &subdomain, double *x ) const {
+		//
+		const size_t n = subdomain.rows.size();
+		const std::vector<double> &L = subdomain.factor;
+		for( unsigned i=0; i<n; ++i ) {
+			double value = x[i];
+			for( unsigned k=0; k<i; ++k ) value -= L[i*n+k] * x[k];
+			x[i] = value / L[i*n+i];
+		}
+		for( unsigned i=n; i-- > 0; ) {
+			double value = x[i];
+			for( unsigned k=i+1; k<n; ++k ) value -= L[k*n+i] * x[k];
+			x[i] = value / L[i*n+i];
+		}
+	}
+	//
+	// Lay out the local solutions in one buffer and list, for each row, the entries to sum
+	void connect() {
+		//
+		size_t offset (0);
+		m_contribution_start.assign(m_rows+1,0);
+		for( auto &subdomain : m_subdomains ) {
+			subdomain.offset = offset;
+			offset += subdomain.rows.size();
+			for( size_t row : subdomain.rows ) ++ m_contribution_start[row+1];
+		}
+		for( size_t row=0; row<m_rows; ++row ) m_contribution_start[row+1] += m_contribution_start[row];
+		m_contribution.resize(offset);
+		std::vector<size_t> head (m_contribution_start.begin(),m_contribution_start.end()-1);
+		for( const auto &subdomain : m_subdomains ) {
+			for( size_t i=0; i<subdomain.rows.size(); ++i ) m_contribution[head[subdomain.rows[i]]++] = subdomain.offset+i;
+		}
+		m_solution.resize(offset);
+		m_scale.resize(m_rows);
+		m_parallel.for_each(m_rows,[&]( size_t row ) {
+			m_scale[row] = 1.0 / std::sqrt((double)(m_contribution_start[row+1]-m_contribution_start[row]));
+		});
+	}
+	//
+	const poisson_operator3 &m_op;
+	const parallel_driver &m_parallel;
+	Parameters m_param;
+	size_t m_rows {0};
+	bool m_dense {false};
+	std::vector<subdomain3> m_subdomains;
+	std::vector<size_t> m_contribution_start, m_contribution;
+	std::vector<double> m_scale;
+	mutable std::vector<double> m_solution, m_rhs;
+};
+//
+SHKZ_END_NAMESPACE
+//
+#endif
+//
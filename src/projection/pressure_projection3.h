@@ -0,0 +1,166 @@
+/*
+**	pressure_projection3.h
+**
+**	This is part of Shiokaze, a research-oriented fluid solver for computer graphics.
+**	Created by Ryoichi Ando <rand@nii.ac.jp> on Oct 18, 2026.
+**
+**	Permission is hereby granted, free of charge, to any person obtaining a copy of
+**	this software and associated documentation files (the "Software"), to deal in
+**	the Software without restriction, including without limitation the rights to use,
+**	copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+**	Software, and to permit persons to whom the Software is furnished to do so,
+**	subject to the following conditions:
+**
+**	The above copyright notice and this permission notice shall be included in all copies
+**	or substantial portions of the Software.
+**
+**	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+**	INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+**	PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+**	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+**	CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+**	OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+//
+#ifndef SHKZ_PRESSURE_PROJECTION3_H
+#define SHKZ_PRESSURE_PROJECTION3_H
+//
+#include <shiokaze/array/array3.h>
+#include <shiokaze/array/macarray3.h>
+#include <shiokaze/math/RCMatrix_interface.h>
+#include <cassert>
+//
+SHKZ_BEGIN_NAMESPACE
+//
+// Steps of the ghost fluid pressure projection shared by the uniform and the adaptive pressure solvers
+class pressure_projection3 {
+public:
+	//
+	// Label the fluid cells connected to a neighboring fluid cell through an open face, and return the number of them
+	static size_t mark_cells( const array3<Real> &fluid, const macarray3<Real> &areas, const macarray3<Real> &rhos, array3<size_t> &index_map ) {
+		//
+		const shape3 shape = fluid.shape();
+		size_t index (0);
+		const auto mark_body = [&]( int i, int j, int k ) {
+			//
+			bool inside (false);
+			if( fluid(i,j,k) < 0.0 ) {
+				//
+				vec3i query[] = {vec3i(i+1,j,k),vec3i(i-1,j,k),vec3i(i,j+1,k),vec3i(i,j-1,k),vec3i(i,j,k+1),vec3i(i,j,k-1)};
+				vec3i face[] = {vec3i(i+1,j,k),vec3i(i,j,k),vec3i(i,j+1,k),vec3i(i,j,k),vec3i(i,j,k+1),vec3i(i,j,k)};
+				int direction[] = {0,0,1,1,2,2};
+				//
+				for( int nq=0; nq<6; nq++ ) {
+					if( ! shape.out_of_bounds(query[nq]) ) {
+						if( fluid(query[nq]) < 0.0 ) {
+							int dim = direction[nq];
+							if( areas[dim](face[nq]) && rhos[dim](face[nq]) ) {
+								inside = true;
+								break;
+							}
+						}
+					}
+				}
+			}
+			if( inside ) {
+				index_map.set(i,j,k,index++);
+			}
+		};
+		if( fluid.get_background_value() < 0.0 ) {
+			fluid.const_serial_all([&]( int i, int j, int k, const auto &it) {
+				mark_body(i,j,k);
+			});
+		} else {
+			fluid.const_serial_inside([&]( int i, int j, int k, const auto &it) {
+				mark_body(i,j,k);
+			});
+		}
+		return index;
+	}
+	//
+	// Assemble the right hand side and walk the 7-point stencil of each labeled cell. cell_func(n,i,j,k) is called
+	// for every row, neighbor_func(n,nq,m,value) for each off-diagonal entry -value, and diagonal_func(n,value) for the diagonal.
+	template <class C, class F, class D> static void assemble( double dt, double dx,
+				const array3<Real> &fluid, const macarray3<Real> &areas, const macarray3<Real> &rhos, const macarray3<Real> &velocity,
+				const array3<size_t> &index_map, RCMatrix_vector_interface<size_t,double> *rhs,
+				C cell_func, F neighbor_func, D diagonal_func ) {
+		//
+		const shape3 shape = fluid.shape();
+		index_map.const_parallel_actives([&]( int i, int j, int k, const auto &it, int tn ) {
+			//
+			size_t n_index = it();
+			rhs->set(n_index,0.0);
+			cell_func(n_index,i,j,k);
+			//
+			if( fluid(i,j,k) < 0.0 ) {
+				//
+				vec3i query[] = {vec3i(i+1,j,k),vec3i(i-1,j,k),vec3i(i,j+1,k),vec3i(i,j-1,k),vec3i(i,j,k+1),vec3i(i,j,k-1)};
+				vec3i face[] = {vec3i(i+1,j,k),vec3i(i,j,k),vec3i(i,j+1,k),vec3i(i,j,k),vec3i(i,j,k+1),vec3i(i,j,k)};
+				int direction[] = {0,0,1,1,2,2};
+				int sgn[] = {1,-1,1,-1,1,-1};
+				//
+				double diagonal = 0.0;
+				for( int nq=0; nq<6; nq++ ) {
+					int dim = direction[nq];
+					if( ! shape.out_of_bounds(query[nq]) ) {
+						double area = areas[dim](face[nq]);
+						if( area ) {
+							double rho = rhos[dim](face[nq]);
+							if( rho ) {
+								double value = dt*area/(dx*dx*rho);
+								if( fluid(query[nq]) < 0.0 ) {
+									assert(index_map.active(query[nq]));
+									neighbor_func(n_index,nq,index_map(query[nq]),value);
+								}
+								diagonal += value;
+							}
+							rhs->add(n_index,-sgn[nq]*area*velocity[dim](face[nq])/dx);
+						}
+					}
+				}
+				diagonal_func(n_index,diagonal);
+			}
+		});
+	}
+	//
+	// PI control of the liquid volume. Adds the correction to the right hand side and returns it.
+	static double correct_volume( double dt, double gain, double current_volume, double target_volume, double &y_prev, RCMatrix_vector_interface<size_t,double> *rhs ) {
+		//
+		double x = (current_volume-target_volume)/target_volume;
+		double y = y_prev + x*dt; y_prev = y;
+		double kp = gain * 2.3/(25.0*0.01);
+		double ki = kp*kp/16.0;
+		const double rhs_correct = -(kp*x+ki*y)/(x+1.0);
+		rhs->for_each([&]( unsigned row, double &value ) {
+			value += rhs_correct;
+		});
+		return rhs_correct;
+	}
+	//
+	// Subtract the pressure gradient from the velocity faces open to the liquid, and turn off the others
+	static void update_velocity( double dt, double dx, const array3<Real> &pressure, const array3<Real> &fluid, const macarray3<Real> &areas, const macarray3<Real> &rhos, macarray3<Real> &velocity ) {
+		//
+		velocity.parallel_actives([&](int dim, int i, int j, int k, auto &it, int tn ) {
+			double rho = rhos[dim](i,j,k);
+			vec3i pi(i,j,k);
+			if( areas[dim](i,j,k) && rho ) {
+				if( pi[dim] == 0 || pi[dim] == velocity.shape()[dim] ) it.set(0.0);
+				else {
+					velocity[dim].subtract(i,j,k, dt * (
+						+ pressure(i,j,k)
+						- pressure(i-(dim==0),j-(dim==1),k-(dim==2))
+						) / (rho*dx));
+				}
+			} else {
+				if( pi[dim] == 0 && fluid(pi) < 0.0 ) it.set(0.0);
+				else if( pi[dim] == velocity.shape()[dim] && fluid(pi-vec3i(dim==0,dim==1,dim==2)) < 0.0 ) it.set(0.0);
+				else it.set_off();
+			}
+		});
+	}
+};
+//
+SHKZ_END_NAMESPACE
+//
+#endif
+//
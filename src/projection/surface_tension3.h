@@ -0,0 +1,108 @@
+/*
+**	surface_tension3.h
+**
+**	This is part of Shiokaze, a research-oriented fluid solver for computer graphics.
+**	Created by Ryoichi Ando <rand@nii.ac.jp> on Oct 18, 2026.
+**
+**	Permission is hereby granted, free of charge, to any person obtaining a copy of
+**	this software and associated documentation files (the "Software"), to deal in
+**	the Software without restriction, including without limitation the rights to use,
+**	copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+**	Software, and to permit persons to whom the Software is furnished to do so,
+**	subject to the following conditions:
+**
+**	The above copyright notice and this permission notice shall be included in all copies
+**	or substantial portions of the Software.
+**
+**	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+**	INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+**	PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+**	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+**	CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+**	OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+//
+#ifndef SHKZ_SURFACE_TENSION3_H
+#define SHKZ_SURFACE_TENSION3_H
+//
+#include <shiokaze/array/array3.h>
+#include <shiokaze/array/macarray3.h>
+#include <shiokaze/array/shared_array3.h>
+#include <shiokaze/parallel/parallel_driver.h>
+#include <vector>
+//
+SHKZ_BEGIN_NAMESPACE
+//
+// Ghost fluid surface tension force shared by the pressure projections. Curvature is only
+// evaluated on the cells next to the faces cut by the interface, so the cost scales with the interface area.
+class surface_tension3 {
+public:
+	//
+	// Add the surface tension force of coefficient kappa to the velocity faces where 0 < rho < 1
+	static void add_force( double dt, double kappa, const array3<Real> &fluid, const macarray3<Real> &rhos, macarray3<Real> &velocity, double dx, bool fourth_order, const parallel_driver &parallel ) {
+		//
+		const shape3 shape = fluid.shape();
+		//
+		// Collect the faces cut by the interface, which are the only ones that read curvature
+		std::vector<vec3i> faces[DIM3];
+		for( int dim : DIMS3 ) {
+			std::vector<std::vector<vec3i> > thread_faces(rhos[dim].get_thread_num());
+			rhos[dim].const_parallel_actives([&]( int i, int j, int k, const auto &it, int tn ) {
+				if( it() && it() < 1.0 ) thread_faces[tn].push_back(vec3i(i,j,k));
+			});
+			for( const auto &e : thread_faces ) faces[dim].insert(faces[dim].end(),e.begin(),e.end());
+		}
+		//
+		// Compute curvature only on the cells on both sides of these faces
+		shared_array3<Real> curvature(fluid.shape());
+		for( int dim : DIMS3 ) {
+			curvature->activate(faces[dim]);
+			curvature->activate(faces[dim],-vec3i(dim==0,dim==1,dim==2));
+		}
+		curvature->parallel_actives([&]( int i, int j, int k, auto &it, int tn ) {
+			double value;
+			if( fourth_order ) {
+				value = 0.0;
+				for( int dim : DIMS3 ) {
+					const vec3i pi (i,j,k), e (dim==0,dim==1,dim==2);
+					value += (
+						-fluid(shape.clamp(pi-2*e))+16.0*fluid(shape.clamp(pi-e))
+						-30.0*fluid(pi)
+						+16.0*fluid(shape.clamp(pi+e))-fluid(shape.clamp(pi+2*e))
+					) / 12.0;
+				}
+			} else {
+				value = (
+					+fluid(shape.clamp(i-1,j,k))+fluid(shape.clamp(i+1,j,k))
+					+fluid(shape.clamp(i,j-1,k))+fluid(shape.clamp(i,j+1,k))
+					+fluid(shape.clamp(i,j,k-1))+fluid(shape.clamp(i,j,k+1))
+					-6.0*fluid(i,j,k)
+				);
+			}
+			it.set(value / (dx*dx));
+		});
+		//
+		// Embed ordinary 2nd order surface tension force
+		for( int dim : DIMS3 ) {
+			std::vector<Real> force(faces[dim].size());
+			parallel.for_each(faces[dim].size(),[&]( size_t n ) {
+				const vec3i &pi = faces[dim][n];
+				double rho = rhos[dim](pi);
+				double sgn = fluid(shape.clamp(pi)) < 0.0 ? -1.0 : 1.0;
+				double theta = sgn < 0 ? 1.0-rho : rho;
+				double face_c =
+					theta*curvature()(shape.clamp(pi))
+					+(1.0-theta)*curvature()(shape.clamp(pi-vec3i(dim==0,dim==1,dim==2)));
+				force[n] = -sgn * dt / (dx*rho) * kappa * face_c;
+			});
+			for( size_t n=0; n<faces[dim].size(); ++n ) {
+				if( velocity[dim].active(faces[dim][n])) velocity[dim].increment(faces[dim][n],force[n]);
+			}
+		}
+	}
+};
+//
+SHKZ_END_NAMESPACE
+//
+#endif
+//
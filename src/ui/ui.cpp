@@ -47,6 +47,7 @@
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <shiokaze/array/shared_array2.h>
 #include <shiokaze/array/shared_array3.h>
+#include <shiokaze/array/full_velocity_cache_core3.h>
 //
 SHKZ_USING_NAMESPACE
 //
@@ -716,6 +717,7 @@ int ui::run ( int argc, const char* argv[] ) {
 	//
 	shared_array_core2::clear();
 	shared_array_core3::clear();
+	full_velocity_cache_core3::clear();
 	//
 	module::close_all_handles();
 	configuration::print_bar("");
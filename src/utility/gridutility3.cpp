@@ -28,6 +28,7 @@
 #include <shiokaze/array/array_utility3.h>
 #include <shiokaze/array/array_interpolator3.h>
 #include <shiokaze/array/array_derivative3.h>
+#include <shiokaze/array/version_cache.h>
 #include <shiokaze/utility/utility.h>
 #include <shiokaze/core/console.h>
 #include <algorithm>
@@ -65,18 +66,27 @@ protected:
 	virtual void combine_levelset( const array3<Real> &solid, const array3<Real> &fluid, array3<Real> &combined, double solid_offset=0.0 ) const override {
 		//
 		if( array_utility3::levelset_exist(solid) ) {
-			shared_array3<Real> copy_solid(fluid.type());
-			if( fluid.shape() == solid.shape()) {
-				copy_solid->copy(solid);
-			} else {
-				convert_to_cell(solid,copy_solid());
+			//
+			// Static solids are converted only once; later calls reuse the cached result
+			const auto lock = m_solid_cache.lock();
+			const solid_key key = {solid.get_version(),fluid.type()};
+			if( ! m_solid_cache.check(get_argument_name()+"_solid_cache_hit_rate",key)) {
+				shared_array3<Real> copy_solid(fluid.type());
+				if( fluid.shape() == solid.shape()) {
+					copy_solid->copy(solid);
+				} else {
+					convert_to_cell(solid,copy_solid());
+				}
+				copy_solid->flood_fill();
+				m_cached_solid.copy(copy_solid());
+				m_solid_cache.store(key);
 			}
-			copy_solid->flood_fill();
+			const array3<Real> &copy_solid = m_cached_solid;
 			//
 			combined.activate_as(fluid);
-			combined.activate_as(copy_solid());
+			combined.activate_as(copy_solid);
 			combined.parallel_actives([&](int i, int j, int k, auto& it, int tn) {
-				it.set(std::max(fluid(i,j,k),-(Real)solid_offset-copy_solid()(i,j,k)));
+				it.set(std::max(fluid(i,j,k),-(Real)solid_offset-copy_solid(i,j,k)));
 			});
 			combined.set_type(fluid.type());
 			combined.flood_fill();
@@ -320,26 +330,47 @@ protected:
 		shared_array3<Real> combined(fluid.type());
 		combine_levelset(solid,fluid,combined());
 		//
-		std::vector<Real> volume_buckets(combined->get_thread_num(),0.0);
+		// Only cells with an active corner can be cut by the surface. Every other cell is whole if its lower corner
+		// is filled inside and empty otherwise, so filled cells are only counted. The fractional volumes are then
+		// integrated on the band of cells around the active nodes, and both sums are reduced per thread.
+		std::vector<long> interior_buckets(combined->get_thread_num(),0);
+		std::vector<double> fraction_buckets(combined->get_thread_num(),0.0);
 		auto shrunk_shape = combined->shape()-shape3(1,1,1);
 		//
-		auto accumulation_body = [&]( int i, int j, int k, int tn ) {
-			double cell_fluid[2][2][2];
-			for( int ii=0; ii<2; ++ii ) for( int jj=0; jj<2; ++jj ) for( int kk=0; kk<2; ++kk ) {
-				cell_fluid[ii][jj][kk] = combined()(i+ii,j+jj,k+kk);
-				volume_buckets[tn] += get_cell_volume(cell_fluid);
-			}
-		};
-		//
 		combined->const_parallel_inside([&](int i, int j, int k, const auto &it, int tn) {
-			if( ! shrunk_shape.out_of_bounds(i,j,k)) accumulation_body(i,j,k,tn);
+			if( ! shrunk_shape.out_of_bounds(i,j,k)) ++ interior_buckets[tn];
 		});
 		combined->const_parallel_actives([&](int i, int j, int k, const auto &it, int tn) {
-			if( ! shrunk_shape.out_of_bounds(i,j,k) && ! it.filled() ) accumulation_body(i,j,k,tn);
+			for( int q=0; q<8; ++q ) {
+				//
+				// Visit the cell from its first active corner only
+				const vec3i pi = vec3i(i,j,k)-vec3i((q>>2)&1,(q>>1)&1,q&1);
+				if( shrunk_shape.out_of_bounds(pi)) continue;
+				bool owner (true);
+				for( int p=0; p<q && owner; ++p ) {
+					if( combined->active(pi+vec3i((p>>2)&1,(p>>1)&1,p&1))) owner = false;
+				}
+				if( ! owner ) continue;
+				//
+				double cell_fluid[2][2][2];
+				bool interior (true);
+				for( int ii=0; ii<2; ++ii ) for( int jj=0; jj<2; ++jj ) for( int kk=0; kk<2; ++kk ) {
+					cell_fluid[ii][jj][kk] = combined()(pi[0]+ii,pi[1]+jj,pi[2]+kk);
+					if( cell_fluid[ii][jj][kk] >= 0.0 ) interior = false;
+				}
+				const bool counted = combined->filled(pi);
+				if( interior ) {
+					if( ! counted ) ++ interior_buckets[tn];
+				} else {
+					if( counted ) -- interior_buckets[tn];
+					fraction_buckets[tn] += get_cell_volume(cell_fluid);
+				}
+			}
 		});
 		//
 		double volume (0.0);
-		for( auto e : volume_buckets ) volume += e;
+		for( auto e : interior_buckets ) volume += e;
+		for( auto e : fraction_buckets ) volume += e;
 		volume = (m_dx*m_dx*m_dx) * volume;
 		return volume;
 		//
@@ -384,6 +415,17 @@ protected:
 	Parameters m_param;
 	double m_dx;
 	shape3 m_shape;
+	//
+	struct solid_key {
+		bool operator==( const solid_key &rhs ) const {
+			return solid_version == rhs.solid_version && fluid_type == rhs.fluid_type;
+		}
+		uint64_t solid_version {0};
+		array3<Real>::type3 fluid_type;
+	};
+	//
+	mutable version_cache<solid_key> m_solid_cache;
+	mutable array3<Real> m_cached_solid{this};
 };
 //
 extern "C" module * create_instance() {
@@ -30,6 +30,7 @@
 #include <shiokaze/array/shared_bitarray3.h>
 #include <shiokaze/array/array_derivative3.h>
 #include <shiokaze/array/array_utility3.h>
+#include <shiokaze/array/version_cache.h>
 #include <shiokaze/cellmesher/cellmesher3_interface.h>
 #include <shiokaze/core/dylibloader.h>
 #include <shiokaze/core/console.h>
@@ -47,12 +48,19 @@ protected:
 	//
 	virtual double compute_max_u ( const macarray3<Real> &velocity ) const override {
 		//
-		shared_array3<vec3r> cell_velocity(m_shape);
-		velocity.convert_to_full(cell_velocity());
-		//
-		std::vector<double> max_u_t(cell_velocity->get_thread_num(),0.0);
-		cell_velocity->parallel_actives([&]( int i, int j, int k, auto &it, int tn ) {
-			max_u_t[tn] = std::max(max_u_t[tn],it().len());
+		// Visit every cell once through its lower x face and measure the cell centered velocity
+		// wherever all the six faces are active, as convert_to_full would do
+		const shape3 shape = velocity.shape();
+		std::vector<double> max_u_t(velocity[0].get_thread_num(),0.0);
+		velocity[0].const_parallel_actives([&]( int i, int j, int k, const auto &it, int tn ) {
+			if( shape.out_of_bounds(i,j,k)) return;
+			vec3d u;
+			for( unsigned dim : DIMS3 ) {
+				const vec3i pi(i,j,k), qi(pi+vec3i(dim==0,dim==1,dim==2));
+				if( ! velocity[dim].active(pi) || ! velocity[dim].active(qi)) return;
+				u[dim] = 0.5 * (velocity[dim](pi)+velocity[dim](qi));
+			}
+			max_u_t[tn] = std::max(max_u_t[tn],u.len());
 		});
 		double max_u (0.0);
 		for( double u : max_u_t ) max_u = std::max(max_u,u);
@@ -92,6 +100,20 @@ protected:
 		constrain_velocity(solid,velocity);
 	}
 	virtual void compute_area_fraction( const array3<Real> &solid, macarray3<Real> &areas ) const override {
+		//
+		// Static solids yield the same area fractions; reuse them while the solid stays unmodified
+		const auto lock = m_area_cache.lock();
+		const area_key key = {solid.get_version(),areas.shape()};
+		if( m_area_cache.check(get_argument_name()+"_area_fraction_cache_hit_rate",key)) {
+			if( areas.get_version() != m_cached_areas.get_version()) areas.copy(m_cached_areas);
+			return;
+		}
+		//
+		compute_area_fraction_body(solid,areas);
+		m_cached_areas.copy(areas);
+		m_area_cache.store(key);
+	}
+	void compute_area_fraction_body( const array3<Real> &solid, macarray3<Real> &areas ) const {
 		//
 		if( levelset_exist(solid) ) {
 			//
@@ -426,6 +448,17 @@ protected:
 	shape3 m_shape;
 	parallel_driver m_parallel{this};
 	cellmesher3_driver m_mesher{this,"marchingcubes"};
+	//
+	struct area_key {
+		bool operator==( const area_key &rhs ) const {
+			return solid_version == rhs.solid_version && shape == rhs.shape;
+		}
+		uint64_t solid_version {0};
+		shape3 shape;
+	};
+	//
+	mutable version_cache<area_key> m_area_cache;
+	mutable macarray3<Real> m_cached_areas{this};
 };
 //
 extern "C" module * create_instance() {